@@ -0,0 +1,200 @@
+/*
+ * bench.c - Benchmark Driver
+ *
+ * This program links the shell's modules (everything except main() in
+ * myshell.c) and measures the hot paths directly, printing one CSV row per
+ * measurement so runs can be compared between releases:
+ *
+ *   benchmark,case,iterations,value,unit
+ *
+ * Benchmarks:
+ * 1. parse    - parse_input() + split_pipeline() + parse_command() on
+ *               synthetic lines of varying length and quote density
+ * 2. spawn    - latency of execute_command() for an external 'true'
+ * 3. pipeline - bytes/sec through N-stage execute_pipeline() chains, with
+ *               in-process 'cat' stages and with spawned '/bin/cat' stages
+ *
+ * Usage: myshell_bench [-q]   (-q runs shorter measurements)
+ * Run through 'make bench', which also saves the output to bench_output.txt.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "executor.h"
+#include "arena.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds_between(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static void row(const char *benchmark, const char *name, long iterations, double value, const char *unit) {
+    printf("%s,%s,%ld,%.3f,%s\n", benchmark, name, iterations, value, unit);
+    fflush(stdout);
+}
+
+/*
+ * make_line: Builds a synthetic command line of 'words' words.
+ *
+ * Every 'quote_every'-th word is a double-quoted word with a space inside
+ * (0 = none); a pipe follows every 8th word and the line ends with an
+ * output redirection.
+ */
+static char *make_line(int words, int quote_every) {
+    size_t size = (size_t)words * 24 + 64;
+    char *line = malloc(size);
+    if (!line) {
+        fprintf(stderr, "myshell_bench: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    char *out = line;
+    out += sprintf(out, "cmd");
+    for (int i = 1; i < words; i++) {
+        if (i % 8 == 0)
+            out += sprintf(out, " | cmd%d", i);
+        else if (quote_every > 0 && i % quote_every == 0)
+            out += sprintf(out, " \"quoted arg %d\"", i);
+        else
+            out += sprintf(out, " arg%d", i);
+    }
+    sprintf(out, " > out.txt");
+    return line;
+}
+
+/*
+ * bench_parse: Measures the parser on one synthetic line.
+ */
+static void bench_parse(int words, int quote_every, double duration) {
+    char *line = make_line(words, quote_every);
+    size_t len = strlen(line);
+    Arena arena;
+    arena_init(&arena);
+
+    long iterations = 0;
+    double start = now(), elapsed;
+    do {
+        for (int batch = 0; batch < 256; batch++) {
+            TokenList *tokens = parse_input(&arena, line);
+            int cmd_count = 0;
+            StageRange *stages = split_pipeline(&arena, tokens, &cmd_count);
+            for (int i = 0; stages && i < cmd_count; i++)
+                parse_command(&arena, tokens, stages[i].start, stages[i].end);
+            arena_reset(&arena);
+        }
+        iterations += 256;
+        elapsed = now() - start;
+    } while (elapsed < duration);
+
+    char name[64];
+    snprintf(name, sizeof(name), "words=%d quoted=%d%%", words,
+             quote_every ? 100 / quote_every : 0);
+    row("parse", name, iterations, elapsed * 1e9 / iterations, "ns/line");
+    row("parse", name, iterations, len * iterations / elapsed / 1e6, "MB/s");
+    arena_free(&arena);
+    free(line);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * bench_spawn: Measures launch-to-reap latency of an external command.
+ */
+static void bench_spawn(int iterations) {
+    char *args[] = { "true", NULL };
+    Command cmd = { .args = args, .input_fd = -1, .output_fd = -1, .error_fd = -1 };
+    StageStats stats;
+    double *samples = malloc(iterations * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "myshell_bench: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    execute_command(&cmd, &stats);  // Warm the path cache
+    double total = 0;
+    for (int i = 0; i < iterations; i++) {
+        execute_command(&cmd, &stats);
+        samples[i] = seconds_between(&stats.start, &stats.end) * 1e6;
+        total += samples[i];
+    }
+    qsort(samples, iterations, sizeof(double), compare_double);
+
+    row("spawn", "true mean", iterations, total / iterations, "us");
+    row("spawn", "true p50", iterations, samples[iterations / 2], "us");
+    row("spawn", "true p99", iterations, samples[iterations * 99 / 100], "us");
+    free(samples);
+}
+
+/*
+ * bench_pipeline: Measures throughput of 'head -c BYTES /dev/zero | STAGE ... | wc -c'.
+ */
+static void bench_pipeline(const char *stage, int middle, long bytes, int runs) {
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "head -c %ld /dev/zero", bytes);
+    for (int i = 0; i < middle; i++)
+        len += snprintf(line + len, sizeof(line) - len, " | %s", stage);
+    snprintf(line + len, sizeof(line) - len, " | wc -c > /dev/null");
+
+    Arena arena;
+    arena_init(&arena);
+    double total = 0;
+    for (int run = 0; run < runs; run++) {
+        ParsedLine *parsed = parse_line(&arena, line);
+        int cmd_count = parsed->pipelines[0].cmd_count;
+        Command *cmds = arena_alloc(&arena, cmd_count * sizeof(Command));
+        for (int i = 0; i < cmd_count; i++)
+            cmds[i] = *parse_command(&arena, &parsed->tokens, parsed->stages[i].start, parsed->stages[i].end);
+        StageStats *stats = arena_alloc(&arena, cmd_count * sizeof(StageStats));
+
+        execute_pipeline(cmds, cmd_count, stats);
+        struct timespec *first = &stats[0].start, *last = &stats[0].end;
+        for (int i = 1; i < cmd_count; i++) {
+            if (seconds_between(last, &stats[i].end) > 0)
+                last = &stats[i].end;
+        }
+        total += seconds_between(first, last);
+        arena_reset(&arena);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s x%d", stage, middle);
+    row("pipeline", name, runs, bytes * (double)runs / total / 1e6, "MB/s");
+    arena_free(&arena);
+}
+
+int main(int argc, char **argv) {
+    int quick = argc > 1 && strcmp(argv[1], "-q") == 0;
+    double parse_time = quick ? 0.05 : 0.3;
+    int spawns = quick ? 100 : 1000;
+    long bytes = quick ? 64L << 20 : 512L << 20;
+
+    printf("benchmark,case,iterations,value,unit\n");
+
+    static const int lengths[] = { 4, 32, 256 };
+    static const int quoting[] = { 0, 4, 1 };   // none, 25%, all words
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (size_t q = 0; q < sizeof(quoting) / sizeof(quoting[0]); q++)
+            bench_parse(lengths[l], quoting[q], parse_time);
+    }
+
+    bench_spawn(spawns);
+
+    static const int stages[] = { 0, 1, 4, 8 };
+    for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) {
+        bench_pipeline("cat", stages[s], bytes, 3);
+        if (stages[s] > 0)
+            bench_pipeline("/bin/cat", stages[s], bytes, 3);
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// One block of arena memory
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;    // Usable bytes in data
+    size_t used;    // Bytes handed out since the last reset
+    char data[];
+} ArenaChunk;
+
+// Bump allocator whose allocations are all released together
+typedef struct {
+    ArenaChunk *head;     // First chunk (kept across resets)
+    ArenaChunk *current;  // Chunk currently being filled
+} Arena;
+
+// Initializes an empty arena (no memory is reserved until first use)
+void arena_init(Arena *arena);
+
+// Returns 'size' bytes of suitably aligned memory owned by the arena.
+// Exits the shell if memory allocation fails.
+void *arena_alloc(Arena *arena, size_t size);
+
+// Copies the first 'len' bytes of 's' into the arena as a string
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+
+// Copies a NUL-terminated string into the arena
+char *arena_strdup(Arena *arena, const char *s);
+
+// Releases every allocation at once; chunks are kept for reuse
+void arena_reset(Arena *arena);
+
+// Returns all chunks to the system
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
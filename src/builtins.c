@@ -0,0 +1,570 @@
+/*
+ * builtins.c - Builtin Commands
+ *
+ * This file holds the table of commands the shell runs itself, together
+ * with the small utilities that are cheaper to run in-process than to
+ * spawn (echo, true, false, pwd, test/[).
+ *
+ * Key Components:
+ *
+ * 1. Dispatch Table:
+ *    - Sorted by name and searched with bsearch(), so lookups do not
+ *      walk a chain of string comparisons
+ *    - Each entry maps a name to a function returning an exit status
+ *
+ * 2. Running Builtins:
+ *    - A simple command runs in the shell; its redirections are opened
+ *      and dup2()'d over fds 0-2 for the duration of the call, and the
+ *      saved fds are restored afterwards
+ *    - Pipeline stages and background jobs run in a forked subshell
+ *      (spawn_function()), since they must run concurrently
+ *
+ * 3. Utilities:
+ *    - echo [-neE] with the usual backslash escapes under -e
+ *    - test / [ with file, string and integer tests, !, -a, -o and ( )
+ *    - pwd, true, false, cd, exit
+ *    - timeout, which runs its command under a deadline enforced by the
+ *      executor's wait loop instead of a timeout(1) process
+ *    - ulimit and place (resources.c): resource limits, and the CPUs,
+ *      priorities and cgroup a command runs with
+ *
+ * Implementation Details:
+ * - stdout is flushed after every builtin, so its output stays ordered
+ *   with that of the commands that follow
+ * - Saved fds are close-on-exec and above 2
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "builtins.h"
+#include "pathcache.h"
+#include "options.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "parsecache.h"
+#include "redirect.h"
+#include "history.h"
+#include "expand.h"
+#include "procsub.h"
+#include "vars.h"
+#include "control.h"
+#include "resources.h"
+
+/*
+ * builtin_cd: Changes the shell's working directory.
+ */
+static int builtin_cd(char **args) {
+    char *dir = args[1];
+    if (dir == NULL) {
+        fprintf(stderr, "myshell: expected argument to \"cd\"\n");
+        return 1;
+    }
+    if (chdir(dir) != 0) {
+        if (errno == ENOENT)
+            fprintf(stderr, "cd: no such file or directory: %s\n", dir);
+        else
+            fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    redirect_cwd_changed();
+    return 0;
+}
+
+static int builtin_exit(char **args) {
+    exit(args[1] ? atoi(args[1]) & 0xff : last_status);
+}
+
+static int builtin_true(char **args) {
+    (void)args;
+    return 0;
+}
+
+static int builtin_false(char **args) {
+    (void)args;
+    return 1;
+}
+
+static int builtin_pwd(char **args) {
+    (void)args;
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        fprintf(stderr, "myshell: pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    puts(cwd);
+    free(cwd);
+    return 0;
+}
+
+/*
+ * echo_escaped: Writes 's' interpreting backslash escapes (echo -e).
+ *
+ * Returns:
+ *   1 if output must stop ('\c'), 0 otherwise.
+ */
+static int echo_escaped(const char *s) {
+    for (const char *p = s; *p; p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            putchar(*p);
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'a': putchar('\a'); break;
+        case 'b': putchar('\b'); break;
+        case 'c': return 1;
+        case 'e': putchar('\033'); break;
+        case 'f': putchar('\f'); break;
+        case 'n': putchar('\n'); break;
+        case 'r': putchar('\r'); break;
+        case 't': putchar('\t'); break;
+        case 'v': putchar('\v'); break;
+        case '\\': putchar('\\'); break;
+        case '0': {
+            // Up to three octal digits
+            int value = 0;
+            for (int n = 0; n < 3 && p[1] >= '0' && p[1] <= '7'; n++)
+                value = value * 8 + (*++p - '0');
+            putchar(value);
+            break;
+        }
+        default:
+            putchar('\\');
+            putchar(*p);
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ * builtin_echo: Writes its arguments separated by spaces.
+ *
+ * Leading option words made only of n, e and E are options, as in bash:
+ * -n omits the newline, -e enables escapes and -E disables them.
+ */
+static int builtin_echo(char **args) {
+    int newline = 1, escapes = 0;
+    int i = 1;
+    for (; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strspn(args[i] + 1, "neE") != strlen(args[i] + 1))
+            break;
+        for (const char *p = args[i] + 1; *p; p++) {
+            if (*p == 'n')
+                newline = 0;
+            else
+                escapes = *p == 'e';
+        }
+    }
+
+    for (int first = i; args[i] != NULL; i++) {
+        if (i > first)
+            putchar(' ');
+        if (!escapes)
+            fputs(args[i], stdout);
+        else if (echo_escaped(args[i]))
+            return 0;
+    }
+    if (newline)
+        putchar('\n');
+    return 0;
+}
+
+// Parser state of one 'test' expression
+typedef struct {
+    char **argv;
+    int pos;
+    int argc;
+    int error;
+} TestState;
+
+static int test_or(TestState *t);
+
+static int parse_integer(TestState *t, const char *s, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "myshell: test: %s: integer expression expected\n", s);
+        t->error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int is_binary_op(const char *op) {
+    static const char *const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"
+    };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (strcmp(op, ops[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int test_binary(TestState *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0)
+        return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0)
+        return strcmp(a, b) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (strcmp(op, "-ef") == 0)
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (strcmp(op, "-nt") == 0)
+            return ha && (!hb || sa.st_mtime > sb.st_mtime);
+        return hb && (!ha || sa.st_mtime < sb.st_mtime);
+    }
+
+    long long x, y;
+    if (!parse_integer(t, a, &x) || !parse_integer(t, b, &y))
+        return 0;
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+/*
+ * test_unary: Evaluates a unary test; returns -1 if 'op' is not one.
+ */
+static int test_unary(const char *op, const char *arg) {
+    struct stat st;
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0')
+        return -1;
+
+    switch (op[1]) {
+    case 'z': return arg[0] == '\0';
+    case 'n': return arg[0] != '\0';
+    case 'e': return stat(arg, &st) == 0;
+    case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+    case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+    case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+    case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+    case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+    case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+    case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 'u': return stat(arg, &st) == 0 && (st.st_mode & S_ISUID);
+    case 'g': return stat(arg, &st) == 0 && (st.st_mode & S_ISGID);
+    case 'k': return stat(arg, &st) == 0 && (st.st_mode & S_ISVTX);
+    case 't': return isatty(atoi(arg));
+    default: return -1;
+    }
+}
+
+/*
+ * test_primary: primary := '(' expr ')' | arg binop arg | unop arg | arg
+ */
+static int test_primary(TestState *t) {
+    int left = t->argc - t->pos;
+    char **a = t->argv + t->pos;
+    if (left <= 0) {
+        fprintf(stderr, "myshell: test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+
+    if (left >= 3 && is_binary_op(a[1])) {
+        t->pos += 3;
+        return test_binary(t, a[0], a[1], a[2]);
+    }
+    if (strcmp(a[0], "(") == 0 && left >= 2) {
+        t->pos++;
+        int value = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")") != 0) {
+            fprintf(stderr, "myshell: test: ')' expected\n");
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return value;
+    }
+    if (left >= 2) {
+        int value = test_unary(a[0], a[1]);
+        if (value >= 0) {
+            t->pos += 2;
+            return value;
+        }
+    }
+    t->pos++;
+    return a[0][0] != '\0';
+}
+
+static int test_not(TestState *t) {
+    if (t->pos < t->argc - 1 && strcmp(t->argv[t->pos], "!") == 0) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static int test_and(TestState *t) {
+    int value = test_not(t);
+    while (!t->error && t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0) {
+        t->pos++;
+        value = test_not(t) && value;
+    }
+    return value;
+}
+
+static int test_or(TestState *t) {
+    int value = test_and(t);
+    while (!t->error && t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0) {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+/*
+ * builtin_test: Implements 'test' and '['.
+ *
+ * Returns:
+ *   0 if the expression is true, 1 if false, 2 on syntax errors.
+ */
+static int builtin_test(char **args) {
+    int argc = 0;
+    while (args[argc] != NULL)
+        argc++;
+
+    if (strcmp(args[0], "[") == 0) {
+        if (strcmp(args[argc - 1], "]") != 0) {
+            fprintf(stderr, "myshell: [: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    if (argc == 1)
+        return 1;
+
+    TestState t = { args, 1, argc, 0 };
+    int value = test_or(&t);
+    if (!t.error && t.pos < argc) {
+        fprintf(stderr, "myshell: test: %s: unexpected argument\n", args[t.pos]);
+        t.error = 1;
+    }
+    if (t.error)
+        return 2;
+    return value ? 0 : 1;
+}
+
+/*
+ * parse_duration:
+ *
+ * Parses a 'timeout' duration: a non-negative number of seconds with an
+ * optional s, m, h or d suffix.
+ *
+ * Returns:
+ *   0 on success, -1 if 'text' is not a duration.
+ */
+static int parse_duration(const char *text, double *seconds) {
+    char *end;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (end == text || errno != 0 || value < 0)
+        return -1;
+    switch (*end) {
+    case '\0': case 's': break;
+    case 'm': value *= 60; break;
+    case 'h': value *= 60 * 60; break;
+    case 'd': value *= 24 * 60 * 60; break;
+    default: return -1;
+    }
+    if (*end != '\0' && end[1] != '\0')
+        return -1;
+    *seconds = value;
+    return 0;
+}
+
+/*
+ * parse_signal: Maps a signal name (with or without "SIG") or number to
+ * its number. Returns -1 if it is unknown.
+ */
+static int parse_signal(const char *text) {
+    static const struct { const char *name; int number; } signals[] = {
+        { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+        { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+        { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+        { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP },
+    };
+    char *end;
+    long number = strtol(text, &end, 10);
+    if (end != text && *end == '\0')
+        return number > 0 && number < NSIG ? (int)number : -1;
+    if (strncmp(text, "SIG", 3) == 0)
+        text += 3;
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        if (strcmp(text, signals[i].name) == 0)
+            return signals[i].number;
+    }
+    return -1;
+}
+
+/*
+ * builtin_timeout: Implements 'timeout [-s SIG] [-k DUR] DUR command...'.
+ *
+ * The command runs as a pipeline stage of the shell itself (see
+ * execute_limited()), so no timeout(1) process sits between the shell
+ * and the command.
+ *
+ * Returns:
+ *   The command's status, 124 if it timed out, 137 if it had to be
+ *   killed, or 125 on usage errors.
+ */
+static int builtin_timeout(char **args) {
+    ExecLimit limit = { 0, SIGTERM, 0 };
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(args[i], "-s") == 0 && args[i + 1]) {
+            limit.signal = parse_signal(args[++i]);
+            if (limit.signal < 0) {
+                fprintf(stderr, "myshell: timeout: %s: invalid signal\n", args[i]);
+                return 125;
+            }
+        } else if (strcmp(args[i], "-k") == 0 && args[i + 1]) {
+            if (parse_duration(args[++i], &limit.kill_after) < 0) {
+                fprintf(stderr, "myshell: timeout: %s: invalid duration\n", args[i]);
+                return 125;
+            }
+        } else {
+            break;
+        }
+    }
+    if (args[i] == NULL || args[i + 1] == NULL) {
+        fprintf(stderr, "usage: timeout [-s signal] [-k duration] duration command [args...]\n");
+        return 125;
+    }
+    if (parse_duration(args[i], &limit.seconds) < 0) {
+        fprintf(stderr, "myshell: timeout: %s: invalid duration\n", args[i]);
+        return 125;
+    }
+
+    Command cmd = { .args = &args[i + 1], .input_fd = -1, .output_fd = -1, .error_fd = -1 };
+    fflush(stdout);
+    return execute_limited(&cmd, 1, &limit);
+}
+
+// Sorted by name (strcmp order) for bsearch()
+static const Builtin builtin_table[] = {
+    { "[", builtin_test },
+    { "bg", bg_builtin },
+    { "break", break_builtin },
+    { "cd", builtin_cd },
+    { "continue", continue_builtin },
+    { "coproc", coproc_builtin },
+    { "echo", builtin_echo },
+    { "exit", builtin_exit },
+    { "export", export_builtin },
+    { "false", builtin_false },
+    { "fg", fg_builtin },
+    { "hash", path_cache_builtin },
+    { "history", history_builtin },
+    { "jobs", jobs_builtin },
+    { "parallel", parallel_builtin },
+    { "parsecache", parse_cache_builtin },
+    { "place", place_builtin },
+    { "pwd", builtin_pwd },
+    { "set", set_builtin },
+    { "test", builtin_test },
+    { "timeout", builtin_timeout },
+    { "true", builtin_true },
+    { "ulimit", ulimit_builtin },
+    { "unset", unset_builtin },
+    { "wait", wait_builtin },
+};
+
+static int compare_builtin(const void *key, const void *entry) {
+    return strcmp(key, ((const Builtin *)entry)->name);
+}
+
+const Builtin *builtin_lookup(const char *name) {
+    if (name == NULL)
+        return NULL;
+    return bsearch(name, builtin_table, sizeof(builtin_table) / sizeof(builtin_table[0]),
+                   sizeof(Builtin), compare_builtin);
+}
+
+void builtin_complete(const char *prefix, void (*add)(const char *name, void *ctx), void *ctx) {
+    size_t len = strlen(prefix);
+    for (size_t i = 0; i < sizeof(builtin_table) / sizeof(builtin_table[0]); i++) {
+        if (strncmp(builtin_table[i].name, prefix, len) == 0)
+            add(builtin_table[i].name, ctx);
+    }
+}
+
+/*
+ * builtin_run: Runs a builtin in the shell with its redirections applied.
+ *
+ * Each redirected fd is saved with F_DUPFD_CLOEXEC, replaced with dup2()
+ * for the call and restored afterwards. stdout is flushed on both sides
+ * of the swap so buffered output lands in the right file. With prefix
+ * assignments ('X=1 timeout ...'), 'environ' is the command's overlay
+ * (cmd->env) for the call, so getenv() and the commands the builtin starts
+ * see them.
+ *
+ * Returns:
+ *   The builtin's exit status, or 1 if a redirection could not be opened.
+ */
+int builtin_run(const Builtin *builtin, const Command *cmd) {
+    int fds[3], opened[3], saved[3] = { -1, -1, -1 };
+    if (redirect_resolve(cmd, fds, opened) < 0)
+        return 1;
+
+    fflush(stdout);
+    for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+        if (fds[fd] == -1)
+            continue;
+        saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        dup2(fds[fd], fd);
+    }
+
+    char **saved_env = environ;
+    if (cmd->env)
+        environ = cmd->env;
+    int status = builtin->func(cmd->args);
+    fflush(stdout);
+    // Unless the builtin changed the environment itself ('export', 'unset'),
+    // which makes 'environ' the shell's rebuilt array
+    if (cmd->env && environ == cmd->env)
+        environ = saved_env;
+
+    for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+        if (fds[fd] == -1)
+            continue;
+        if (saved[fd] != -1) {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        } else {
+            close(fd);
+        }
+    }
+    redirect_close(opened);
+    return status;
+}
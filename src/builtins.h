@@ -0,0 +1,24 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "executor.h"
+
+// A command implemented inside the shell; returns its exit status
+typedef int (*BuiltinFunc)(char **args);
+
+typedef struct {
+    const char *name;
+    BuiltinFunc func;
+} Builtin;
+
+// Returns the builtin called 'name', or NULL if there is none
+const Builtin *builtin_lookup(const char *name);
+
+// Calls add(name, ctx) for every builtin whose name starts with 'prefix'
+void builtin_complete(const char *prefix, void (*add)(const char *name, void *ctx), void *ctx);
+
+// Runs a builtin in the shell process with the command's redirections
+// applied by temporarily swapping the shell's fds. Returns its exit status.
+int builtin_run(const Builtin *builtin, const Command *cmd);
+
+#endif // BUILTINS_H
@@ -0,0 +1,212 @@
+/*
+ * cmdsub.c - Command Substitution
+ *
+ * This file runs the command list of a $(...) substitution for expand.c,
+ * which turns its output into words.
+ *
+ * Key Components:
+ *
+ * 1. Capture File:
+ *    - The output goes into a memfd instead of a pipe, so the command can
+ *      run in the foreground through execute_pipeline(), like a typed one
+ *      (fast paths, job control, pipefail), without the shell having to
+ *      read while it waits; its size is known once it is done
+ *    - Every pipeline of the list writes to the same file, one after another
+ *
+ * 2. Command Lists:
+ *    - The text is parsed like a command line: ';', '&&' and '||' work as
+ *      they do there, and '$?' tracks the list as it runs
+ *    - A list of several pipelines runs in a forked subshell, where its
+ *      builtins run in-process: $(cd dir; pwd) sees the new directory and
+ *      the shell keeps its own
+ *    - Background jobs ('&') and here-documents are not supported
+ *
+ * 3. In-Process Builtins:
+ *    - A substitution made of one builtin without side effects on the
+ *      shell (echo, pwd, true, false, test/[) runs in the shell through
+ *      builtin_run(), so $(pwd) costs no fork at all
+ *    - Any other builtin runs in a forked stage: $(cd dir) or $(exit)
+ *      cannot change the shell itself
+ *
+ * Implementation Details:
+ * - The status of the last pipeline run becomes $? (last_status)
+ * - Substitutions may nest; the inner one runs while the outer command
+ *   is being built
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "cmdsub.h"
+#include "parser.h"
+#include "executor.h"
+#include "builtins.h"
+#include "procsub.h"
+#include "expand.h"
+#include "spawn.h"
+
+// Builtins that only write output, and so may run in the shell itself
+static const char *const inline_builtins[] = {
+    "echo", "pwd", "true", "false", "test", "[", NULL
+};
+
+static Arena subshell_arena;    // Parse of a list run by subshell_main()
+
+/*
+ * inline_builtin: Returns the builtin 'cmd' runs if it may run in this
+ * process: any builtin in a subshell, otherwise only one without side
+ * effects on the shell. Returns NULL if it has to be forked.
+ */
+static const Builtin *inline_builtin(const Command *cmd, int subshell) {
+    if (subshell)
+        return builtin_lookup(cmd->args[0]);
+    for (int i = 0; inline_builtins[i]; i++) {
+        if (strcmp(cmd->args[0], inline_builtins[i]) == 0)
+            return builtin_lookup(cmd->args[0]);
+    }
+    return NULL;
+}
+
+/*
+ * run_captured:
+ *
+ * Runs one pipeline of a substitution's list with the stdout of its last
+ * stage going to 'out_fd' (unless the stage redirects it). 'subshell' is
+ * set when running in the forked subshell of a list.
+ *
+ * Returns:
+ *   The pipeline's exit status, or -1 for a syntax error.
+ */
+static int run_captured(Arena *arena, const ParsedLine *line, const Pipeline *pipeline,
+                        int out_fd, int subshell) {
+    const StageRange *stages = line->stages + pipeline->first_stage;
+    int cmd_count = pipeline->cmd_count;
+    Command *commands = arena_alloc(arena, cmd_count * sizeof(Command));
+    int parsed = 0;
+    int ok = 1;
+
+    while (ok && parsed < cmd_count) {
+        Command *cmd = parse_command(arena, &line->tokens, stages[parsed].start,
+                                     stages[parsed].end);
+        if (!cmd) {
+            ok = 0;
+            break;
+        }
+        commands[parsed] = *cmd;
+        ok = procsub_start(arena, &commands[parsed++]) == 0;
+    }
+
+    int status = -1;
+    if (ok) {
+        Command *last = &commands[cmd_count - 1];
+        last->output_fd = fcntl(out_fd, F_DUPFD_CLOEXEC, 0);
+        const Builtin *builtin = cmd_count == 1 && last->args[0] ? inline_builtin(last, subshell)
+                                                                 : NULL;
+        if (last->output_fd < 0) {
+            perror("myshell: command substitution");
+        } else if (cmd_count == 1 && last->args[0] == NULL) {
+            // Nothing but expansions: their status stands
+            status = last_status;
+        } else if (builtin) {
+            status = builtin_run(builtin, last);
+        } else {
+            status = execute_pipeline(commands, cmd_count, NULL);
+        }
+    }
+
+    for (int i = 0; i < parsed; i++) {
+        close_command_fds(&commands[i]);
+        procsub_finish(&commands[i]);
+    }
+    return status;
+}
+
+/*
+ * run_list: Runs the pipelines of a parsed list in order, honoring '&&'
+ * and '||', with their output going to 'out_fd'.
+ *
+ * Returns:
+ *   0 (the status is in last_status), or -1 for a syntax error.
+ */
+static int run_list(Arena *arena, const ParsedLine *line, int out_fd, int subshell) {
+    for (int i = 0; i < line->pipeline_count; i++) {
+        const Pipeline *pipeline = &line->pipelines[i];
+        if ((pipeline->op == LIST_AND && last_status != 0) ||
+            (pipeline->op == LIST_OR && last_status == 0))
+            continue;
+        int status = run_captured(arena, line, pipeline, out_fd, subshell);
+        if (status < 0)
+            return -1;
+        last_status = status;
+    }
+    return 0;
+}
+
+/*
+ * subshell_main: Runs the list args[0] in a forked subshell whose stdout is
+ * the capture file, and returns its status.
+ */
+static int subshell_main(char **args) {
+    ParsedLine *line = parse_line(&subshell_arena, args[0]);
+    if (!line || run_list(&subshell_arena, line, STDOUT_FILENO, 1) < 0)
+        return 2;
+    return last_status;
+}
+
+/*
+ * cmdsub_run: Runs a command substitution (see cmdsub.h).
+ */
+int cmdsub_run(Arena *arena, const char *text) {
+    ParsedLine *line = parse_line(arena, text);
+    if (!line)
+        return -1;
+    for (int i = 0; i < line->pipeline_count; i++) {
+        if (line->pipelines[i].background) {
+            fprintf(stderr, "myshell: command substitution: background jobs are not supported\n");
+            return -1;
+        }
+    }
+
+    int fd = memfd_create("command-substitution", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("myshell: command substitution");
+        return -1;
+    }
+
+    // A single pipeline runs like a typed one
+    if (line->pipeline_count <= 1) {
+        if (run_list(arena, line, fd, 0) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    SpawnPlan plan;
+    spawn_plan_init(&plan);
+    char *argv[] = { (char *)text, NULL };
+    pid_t pid;
+    int err = ENOMEM;
+    if (spawn_plan_dup2(&plan, fd, STDOUT_FILENO) == 0)
+        err = spawn_function(subshell_main, argv, &plan, &pid);
+    spawn_plan_free(&plan);
+    if (err != 0) {
+        fprintf(stderr, "myshell: command substitution: %s\n", strerror(err));
+        close(fd);
+        return -1;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = 1 << 8;
+            break;
+        }
+    }
+    last_status = exit_status(status);
+    return fd;
+}
@@ -0,0 +1,12 @@
+#ifndef CMDSUB_H
+#define CMDSUB_H
+
+#include "arena.h"
+
+// Runs the command list 'text' of a $(...) substitution with its stdout
+// captured, and sets last_status to its status. Returns a close-on-exec fd
+// whose whole contents (see fstat()) are the output, or -1 after printing
+// an error (a syntax error in 'text', or no capture file).
+int cmdsub_run(Arena *arena, const char *text);
+
+#endif // CMDSUB_H
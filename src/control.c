@@ -0,0 +1,645 @@
+/*
+ * control.c - Control Structures
+ *
+ * This file implements the shell's compound commands:
+ *
+ *   for NAME in WORDS...; do LIST; done
+ *   while LIST; do LIST; done        until LIST; do LIST; done
+ *   if LIST; then LIST; [elif LIST; then LIST;]... [else LIST;] fi
+ *
+ * together with 'break [n]' and 'continue [n]'. A block may span several
+ * lines (a newline counts as ';') and blocks nest.
+ *
+ * Key Components:
+ *
+ * 1. Reading a Block:
+ *    - control_scan() finds the reserved words of a line and how many
+ *      blocks it leaves open; myshell.c reads lines until none is, lexing
+ *      each line once and reading its here-documents as it goes
+ *    - control_join() makes the lines one token list
+ *
+ * 2. Command Tree:
+ *    - control_parse() turns the token list into a tree of nodes: a
+ *      pipeline, or a for/while/until/if node with its lists
+ *    - The pipelines are split into stages once, into a ParsedLine shared
+ *      by the whole block, as a command line's are; so an iteration never
+ *      lexes or splits again, it only builds each command's argv with
+ *      parse_command() (the expansions) and runs it
+ *    - Everything is allocated in the line's arena
+ *
+ * 3. Running:
+ *    - The status of a list is the status of its last command, as on a
+ *      command line; '&&' and '||' work between compound commands too
+ *    - Each loop level has an arena of its own for the commands built in
+ *      an iteration, reset after every iteration: a loop runs in constant
+ *      memory however many times it goes round
+ *    - A foreground command killed by SIGINT (Ctrl-C) also stops the
+ *      loops around it
+ *
+ * Implementation Details:
+ * - Reserved words are only recognized in command position, so
+ *   'echo done' prints "done"; quoting one does not make it a plain word
+ * - A compound command cannot be part of a pipeline, have redirections
+ *   or run in the background ('&')
+ * - The status of a loop is that of the last command its body ran (0 if
+ *   it never ran); that of an if without a matching branch is 0
+ * - With no loop running, 'break' and 'continue' only print an error
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "control.h"
+#include "parser.h"
+#include "arena.h"
+#include "expand.h"
+#include "vars.h"
+
+#define MAX_LOOP_DEPTH 32
+
+// Reserved words; openers first, then the words that close a list
+enum {
+    KW_FOR, KW_WHILE, KW_UNTIL, KW_IF,
+    KW_DO, KW_DONE, KW_THEN, KW_ELIF, KW_ELSE, KW_FI,
+    KW_NONE
+};
+
+static const char *const reserved_words[] = {
+    "for", "while", "until", "if", "do", "done", "then", "elif", "else", "fi"
+};
+
+typedef enum {
+    NODE_PIPELINE,
+    NODE_FOR,
+    NODE_WHILE,
+    NODE_UNTIL,
+    NODE_IF
+} NodeType;
+
+// One command of a list: a pipeline or a compound command
+typedef struct ControlNode {
+    NodeType type;
+    ListOp op;                      // How it depends on the command before it
+    int pipeline;                   // NODE_PIPELINE: index in the block's pipelines
+    const char *name;               // NODE_FOR: the loop variable
+    int words_start;                // NODE_FOR: tokens [words_start, words_end)
+    int words_end;                  //   of the words to loop over
+    struct ControlNode *cond;       // Condition (while, until, if)
+    struct ControlNode *body;       // Loop body; for if, the list run on success
+    struct ControlNode *orelse;     // NODE_IF: the elif (an if node) or else list
+    struct ControlNode *next;       // Next command of the list
+} ControlNode;
+
+struct ControlBlock {
+    ParsedLine line;        // The block's tokens and the stages of all its pipelines
+    ControlNode *list;      // Its top-level command list
+};
+
+// State of control_parse()
+typedef struct {
+    Arena *arena;
+    ControlBlock *block;
+    int pos;                // Next token
+    int error;              // A syntax error has been reported
+} BlockParser;
+
+// State of control_run()
+typedef struct {
+    const ControlBlock *block;
+    ControlRun run;
+} BlockRunner;
+
+static Arena loop_arenas[MAX_LOOP_DEPTH];   // Per-iteration memory of each loop level
+static int loop_depth = 0;                  // Loops running now
+static int pending_breaks = 0;              // Loops 'break'/'continue' still has to leave
+static int pending_continue = 0;            // The last of them goes round again
+
+static int is_list_operator(TokenType type) {
+    return type == TOK_SEMI || type == TOK_AND || type == TOK_OR || type == TOK_BACKGROUND;
+}
+
+/*
+ * keyword: Returns the reserved word (KW_*) token 'index' is, or KW_NONE.
+ */
+static int keyword(const TokenList *tokens, int index) {
+    if (index >= tokens->count || tokens->tokens[index].type != TOK_WORD)
+        return KW_NONE;
+    const char *text = token_text(tokens, index);
+    for (int kw = 0; kw < KW_NONE; kw++) {
+        if (strcmp(text, reserved_words[kw]) == 0)
+            return kw;
+    }
+    return KW_NONE;
+}
+
+static int is_closer(int kw) {
+    return kw >= KW_DO && kw != KW_NONE;
+}
+
+int control_scan(const TokenList *tokens, int *depth) {
+    int found = 0;
+    int command = 1;    // The next word is in command position
+    for (int i = 0; i < tokens->count; i++) {
+        TokenType type = tokens->tokens[i].type;
+        if (type != TOK_WORD) {
+            if (is_list_operator(type) || type == TOK_PIPE)
+                command = 1;
+            else if (type == TOK_PROCSUB_IN || type == TOK_PROCSUB_OUT)
+                command = 0;
+            else if (i + 1 < tokens->count && token_is_word(tokens->tokens[i + 1].type))
+                i++;    // A redirection's file is not a command
+            continue;
+        }
+        int kw = command ? keyword(tokens, i) : KW_NONE;
+        if (kw == KW_NONE) {
+            command = 0;
+            continue;
+        }
+        found = 1;
+        if (kw <= KW_IF)
+            (*depth)++;
+        else if (kw == KW_DONE || kw == KW_FI)
+            (*depth)--;
+        // 'do', 'then', 'while', ... are followed by a command
+        command = kw != KW_FOR && kw != KW_DONE && kw != KW_FI;
+    }
+    return found;
+}
+
+/*
+ * buf_length: Returns how many bytes of list->buf its tokens use.
+ */
+static size_t buf_length(const TokenList *list) {
+    size_t len = 0;
+    for (int i = 0; i < list->count; i++) {
+        const Token *token = &list->tokens[i];
+        if (token_is_word(token->type) && (size_t)(token->offset + token->length + 1) > len)
+            len = token->offset + token->length + 1;
+    }
+    return len;
+}
+
+static int here_doc_count(const TokenList *list) {
+    int count = 0;
+    for (int i = 0; i < list->count; i++)
+        count += list->tokens[i].type == TOK_HEREDOC;
+    return count;
+}
+
+TokenList *control_join(Arena *arena, TokenList **lines, int count) {
+    int token_count = count - 1;
+    int doc_count = 0;
+    size_t buf_len = 1;
+    for (int l = 0; l < count; l++) {
+        token_count += lines[l]->count;
+        doc_count += here_doc_count(lines[l]);
+        buf_len += buf_length(lines[l]);
+    }
+
+    TokenList *list = arena_alloc(arena, sizeof(TokenList));
+    list->tokens = arena_alloc(arena, (token_count + 1) * sizeof(Token));
+    list->count = 0;
+    list->capacity = token_count + 1;
+    list->buf = arena_alloc(arena, buf_len);
+    list->here_docs = arena_alloc(arena, (doc_count + 1) * sizeof(char *));
+
+    // Word offsets move by the text before them, here-document indices by
+    // the here-documents before them
+    size_t offset = 0;
+    int docs = 0;
+    for (int l = 0; l < count; l++) {
+        const TokenList *line = lines[l];
+        if (l > 0) {
+            Token *separator = &list->tokens[list->count++];
+            separator->type = TOK_SEMI;
+            separator->offset = 0;
+            separator->length = 0;
+            separator->expand = 0;
+        }
+        size_t len = buf_length(line);
+        memcpy(list->buf + offset, line->buf, len);
+        for (int i = 0; i < line->count; i++) {
+            Token *token = &list->tokens[list->count++];
+            *token = line->tokens[i];
+            if (token->type == TOK_HEREDOC) {
+                list->here_docs[docs + token->offset] = line->here_docs[token->offset];
+                token->offset += docs;
+            } else if (token_is_word(token->type)) {
+                token->offset += offset;
+            }
+        }
+        docs += here_doc_count(line);
+        offset += len;
+    }
+    list->buf[offset] = '\0';
+    return list;
+}
+
+/*
+ * unexpected: Reports a syntax error at the parser's position.
+ */
+static void unexpected(BlockParser *p) {
+    const TokenList *tokens = &p->block->line.tokens;
+    if (p->error)
+        return;
+    if (p->pos >= tokens->count)
+        fprintf(stderr, "myshell: syntax error: unexpected end of block\n");
+    else if (tokens->tokens[p->pos].type == TOK_WORD)
+        fprintf(stderr, "myshell: syntax error near unexpected word '%s'\n",
+                token_text(tokens, p->pos));
+    else
+        fprintf(stderr, "myshell: syntax error near unexpected token '%s'\n",
+                token_name(tokens->tokens[p->pos].type));
+    p->error = 1;
+}
+
+/*
+ * expect: Consumes reserved word 'kw'. Returns 0, or -1 after reporting an
+ * error if it is not next.
+ */
+static int expect(BlockParser *p, int kw) {
+    if (p->error)
+        return -1;
+    if (keyword(&p->block->line.tokens, p->pos) != kw) {
+        unexpected(p);
+        return -1;
+    }
+    p->pos++;
+    return 0;
+}
+
+static ControlNode *new_node(BlockParser *p, NodeType type, ListOp op) {
+    ControlNode *node = arena_alloc(p->arena, sizeof(ControlNode));
+    memset(node, 0, sizeof(ControlNode));
+    node->type = type;
+    node->op = op;
+    return node;
+}
+
+static void parse_compound(BlockParser *p, ControlNode *node, int kw);
+
+/*
+ * parse_list:
+ *
+ * Parses a command list up to the end of the tokens or a reserved word
+ * that closes a list, which is left for the caller. Empty commands between
+ * separators are skipped, since every newline became a ';'.
+ *
+ * Returns:
+ *   The list's first node (NULL for an empty list or after an error).
+ */
+static ControlNode *parse_list(BlockParser *p) {
+    const TokenList *tokens = &p->block->line.tokens;
+    ControlNode *head = NULL;
+    ControlNode **tail = &head;
+    ListOp op = LIST_SEQ;
+
+    while (!p->error) {
+        while (op == LIST_SEQ && p->pos < tokens->count &&
+               tokens->tokens[p->pos].type == TOK_SEMI)
+            p->pos++;
+        int kw = keyword(tokens, p->pos);
+        if (p->pos == tokens->count || is_closer(kw)) {
+            if (op != LIST_SEQ) {
+                fprintf(stderr, "myshell: syntax error: missing command after '%s'\n",
+                        op == LIST_AND ? "&&" : "||");
+                p->error = 1;
+            }
+            break;
+        }
+
+        ControlNode *node;
+        if (kw != KW_NONE) {
+            node = new_node(p, NODE_PIPELINE, op);
+            parse_compound(p, node, kw);
+        } else {
+            // A pipeline runs up to the next list operator
+            int end = p->pos;
+            while (end < tokens->count && !is_list_operator(tokens->tokens[end].type))
+                end++;
+            int background = end < tokens->count && tokens->tokens[end].type == TOK_BACKGROUND;
+            node = new_node(p, NODE_PIPELINE, op);
+            node->pipeline = p->block->line.pipeline_count;
+            if (add_pipeline(p->arena, &p->block->line, p->pos, end, op, background) < 0)
+                p->error = 1;
+            p->pos = end;
+        }
+        if (p->error)
+            break;
+        *tail = node;
+        tail = &node->next;
+
+        if (p->pos == tokens->count)
+            break;
+        TokenType type = tokens->tokens[p->pos].type;
+        if (!is_list_operator(type) || (type == TOK_BACKGROUND && node->type != NODE_PIPELINE)) {
+            unexpected(p);
+            break;
+        }
+        op = type == TOK_AND ? LIST_AND : type == TOK_OR ? LIST_OR : LIST_SEQ;
+        p->pos++;
+    }
+    return p->error ? NULL : head;
+}
+
+/*
+ * parse_required: Parses a list that may not be empty.
+ */
+static ControlNode *parse_required(BlockParser *p) {
+    ControlNode *list = parse_list(p);
+    if (!list)
+        unexpected(p);
+    return list;
+}
+
+/*
+ * parse_for: Parses 'NAME in WORDS...; do LIST; done' after 'for'.
+ */
+static void parse_for(BlockParser *p, ControlNode *node) {
+    const TokenList *tokens = &p->block->line.tokens;
+    node->type = NODE_FOR;
+
+    if (p->pos < tokens->count && tokens->tokens[p->pos].type == TOK_WORD &&
+        vars_name_length(token_text(tokens, p->pos)) != (size_t)tokens->tokens[p->pos].length) {
+        fprintf(stderr, "myshell: for: '%s': not a valid identifier\n", token_text(tokens, p->pos));
+        p->error = 1;
+        return;
+    }
+    if (p->pos >= tokens->count || tokens->tokens[p->pos].type != TOK_WORD) {
+        unexpected(p);
+        return;
+    }
+    node->name = token_text(tokens, p->pos++);
+    if (p->pos >= tokens->count || tokens->tokens[p->pos].type != TOK_WORD ||
+        strcmp(token_text(tokens, p->pos), "in") != 0) {
+        unexpected(p);
+        return;
+    }
+
+    node->words_start = ++p->pos;
+    while (p->pos < tokens->count && tokens->tokens[p->pos].type == TOK_WORD)
+        p->pos++;
+    node->words_end = p->pos;
+    if (p->pos >= tokens->count || tokens->tokens[p->pos].type != TOK_SEMI) {
+        unexpected(p);
+        return;
+    }
+    while (p->pos < tokens->count && tokens->tokens[p->pos].type == TOK_SEMI)
+        p->pos++;
+
+    if (expect(p, KW_DO) == 0) {
+        node->body = parse_required(p);
+        expect(p, KW_DONE);
+    }
+}
+
+/*
+ * parse_if: Parses 'LIST; then LIST; ... fi' after 'if' or 'elif'; an
+ * elif becomes an if node of its own, the else branch of this one.
+ */
+static void parse_if(BlockParser *p, ControlNode *node) {
+    node->type = NODE_IF;
+    node->cond = parse_required(p);
+    if (expect(p, KW_THEN) < 0)
+        return;
+    node->body = parse_required(p);
+    if (p->error)
+        return;
+
+    int kw = keyword(&p->block->line.tokens, p->pos);
+    if (kw == KW_ELIF) {
+        p->pos++;
+        node->orelse = new_node(p, NODE_IF, LIST_SEQ);
+        parse_if(p, node->orelse);
+    } else if (kw == KW_ELSE) {
+        p->pos++;
+        node->orelse = parse_required(p);
+        expect(p, KW_FI);
+    } else {
+        expect(p, KW_FI);
+    }
+}
+
+/*
+ * parse_compound: Parses the compound command opened by reserved word
+ * 'kw' into 'node'.
+ */
+static void parse_compound(BlockParser *p, ControlNode *node, int kw) {
+    p->pos++;
+    if (kw == KW_FOR) {
+        parse_for(p, node);
+    } else if (kw == KW_IF) {
+        parse_if(p, node);
+    } else {
+        node->type = kw == KW_WHILE ? NODE_WHILE : NODE_UNTIL;
+        node->cond = parse_required(p);
+        if (expect(p, KW_DO) == 0) {
+            node->body = parse_required(p);
+            expect(p, KW_DONE);
+        }
+    }
+}
+
+/*
+ * control_parse: Builds a block's command tree (see control.h).
+ *
+ * Every list operator may end a pipeline and every '|' a stage, which
+ * bounds the arrays of the block's ParsedLine as it does in parse_line().
+ */
+ControlBlock *control_parse(Arena *arena, const TokenList *tokens) {
+    ControlBlock *block = arena_alloc(arena, sizeof(ControlBlock));
+    int max_pipelines = 1, max_stages = 1;
+    for (int i = 0; i < tokens->count; i++) {
+        if (is_list_operator(tokens->tokens[i].type)) {
+            max_pipelines++;
+            max_stages++;
+        } else if (tokens->tokens[i].type == TOK_PIPE) {
+            max_stages++;
+        }
+    }
+    block->line.tokens = *tokens;
+    block->line.pipelines = arena_alloc(arena, max_pipelines * sizeof(Pipeline));
+    block->line.stages = arena_alloc(arena, max_stages * sizeof(StageRange));
+    block->line.pipeline_count = 0;
+
+    BlockParser p = { arena, block, 0, 0 };
+    block->list = parse_list(&p);
+    if (p.pos < tokens->count)
+        unexpected(&p);     // A closing word with nothing open
+    return p.error ? NULL : block;
+}
+
+/*
+ * leave_loop: Called after an iteration; returns 1 if a 'break' or
+ * 'continue' ends the loop.
+ */
+static int leave_loop(void) {
+    if (pending_breaks == 0)
+        return 0;
+    if (--pending_breaks > 0)
+        return 1;
+    int leave = !pending_continue;
+    pending_continue = 0;
+    return leave;
+}
+
+static int run_list(const BlockRunner *r, const ControlNode *node, Arena *arena);
+
+/*
+ * run_if: Runs an if node. Returns 0, or -1 if a syntax error ends the block.
+ */
+static int run_if(const BlockRunner *r, const ControlNode *node, Arena *arena) {
+    if (run_list(r, node->cond, arena) < 0)
+        return -1;
+    if (pending_breaks)
+        return 0;
+    if (last_status == 0)
+        return run_list(r, node->body, arena);
+    if (node->orelse)
+        return run_list(r, node->orelse, arena);
+    last_status = 0;
+    return 0;
+}
+
+/*
+ * run_loop:
+ *
+ * Runs a for, while or until node. The words of a for loop are expanded
+ * once, in the enclosing 'arena'; everything an iteration builds goes into
+ * this loop level's arena, which is reset after it.
+ *
+ * Returns:
+ *   0, or -1 if a syntax error ends the block.
+ */
+static int run_loop(const BlockRunner *r, const ControlNode *node, Arena *arena) {
+    if (loop_depth == MAX_LOOP_DEPTH) {
+        fprintf(stderr, "myshell: loops nested too deeply\n");
+        return -1;
+    }
+    char **values = NULL;
+    int count = 0;
+    size_t name_len = 0;
+    if (node->type == NODE_FOR) {
+        values = expand_words(arena, &r->block->line.tokens, node->words_start,
+                              node->words_end, &count);
+        if (!values)
+            return -1;
+        name_len = strlen(node->name);
+    }
+
+    Arena *iteration = &loop_arenas[loop_depth++];
+    int status = 0, result = 0;
+    for (int i = 0; node->type != NODE_FOR || i < count; i++) {
+        if (node->type == NODE_FOR) {
+            size_t value_len = strlen(values[i]);
+            char *assignment = arena_alloc(iteration, name_len + value_len + 2);
+            memcpy(assignment, node->name, name_len);
+            assignment[name_len] = '=';
+            memcpy(assignment + name_len + 1, values[i], value_len + 1);
+            vars_assign(assignment, 0);
+        } else {
+            result = run_list(r, node->cond, iteration);
+            if (result < 0)
+                break;
+            if (pending_breaks) {
+                arena_reset(iteration);
+                if (leave_loop())
+                    break;
+                continue;
+            }
+            if ((last_status == 0) != (node->type == NODE_WHILE))
+                break;
+        }
+        result = run_list(r, node->body, iteration);
+        status = last_status;
+        arena_reset(iteration);
+        if (result < 0 || leave_loop())
+            break;
+    }
+    arena_reset(iteration);
+    loop_depth--;
+    last_status = status;
+    return result;
+}
+
+/*
+ * run_list:
+ *
+ * Runs a command list: a command after '&&' only runs if the status so
+ * far is 0, one after '||' only if it is not. A pending 'break' or
+ * 'continue' ends the list.
+ *
+ * Returns:
+ *   0, or -1 if a syntax error ends the block.
+ */
+static int run_list(const BlockRunner *r, const ControlNode *node, Arena *arena) {
+    for (; node != NULL && pending_breaks == 0; node = node->next) {
+        if ((node->op == LIST_AND && last_status != 0) ||
+            (node->op == LIST_OR && last_status == 0))
+            continue;
+
+        int result = 0;
+        if (node->type == NODE_PIPELINE) {
+            const ParsedLine *line = &r->block->line;
+            int status = r->run(arena, line, &line->pipelines[node->pipeline]);
+            if (status < 0)
+                return -1;
+            last_status = status;
+            // Ctrl-C stops the loops around the command, not just the command
+            if (status == 128 + SIGINT) {
+                pending_breaks = loop_depth;
+                pending_continue = 0;
+            }
+        } else if (node->type == NODE_IF) {
+            result = run_if(r, node, arena);
+        } else {
+            result = run_loop(r, node, arena);
+        }
+        if (result < 0)
+            return -1;
+    }
+    return 0;
+}
+
+void control_run(const ControlBlock *block, Arena *arena, ControlRun run) {
+    BlockRunner runner = { block, run };
+    // A syntax error ends the whole block, as a parse error would
+    if (run_list(&runner, block->list, arena) < 0)
+        last_status = 2;
+    pending_breaks = 0;
+    pending_continue = 0;
+}
+
+/*
+ * loop_control: Implements 'break [n]' and 'continue [n]': leave the n
+ * innermost loops (all of them if there are fewer), or go round the nth
+ * one again.
+ */
+static int loop_control(char **args, int continuing) {
+    long levels = 1;
+    if (args[1]) {
+        char *end;
+        levels = strtol(args[1], &end, 10);
+        if (*args[1] == '\0' || *end != '\0' || levels < 1) {
+            fprintf(stderr, "myshell: %s: %s: loop count out of range\n", args[0], args[1]);
+            return 1;
+        }
+    }
+    if (loop_depth == 0) {
+        fprintf(stderr, "myshell: %s: only meaningful in a loop\n", args[0]);
+        return 0;
+    }
+    pending_breaks = levels < loop_depth ? (int)levels : loop_depth;
+    pending_continue = continuing;
+    return 0;
+}
+
+int break_builtin(char **args) {
+    return loop_control(args, 0);
+}
+
+int continue_builtin(char **args) {
+    return loop_control(args, 1);
+}
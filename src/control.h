@@ -0,0 +1,37 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "parser.h"
+
+// A parsed for/while/until/if block (see control.c)
+typedef struct ControlBlock ControlBlock;
+
+// Runs one pipeline of a block, as a command line's pipelines are run.
+// Returns its exit status, or -1 for a syntax error.
+typedef int (*ControlRun)(Arena *arena, const ParsedLine *line, const Pipeline *pipeline);
+
+// Returns 1 if a line's tokens use a reserved word (for, while, until, if,
+// do, done, then, elif, else, fi) in command position, and adds the number
+// of blocks it opens minus those it closes to *depth; a block goes on
+// until *depth is back to 0
+int control_scan(const TokenList *tokens, int *depth);
+
+// Joins the token lists of a block's 'count' lines into one, with a ';'
+// between lines; the here-documents of each line must have been read
+TokenList *control_join(Arena *arena, TokenList **lines, int count);
+
+// Parses a block's tokens into its command tree, allocated in 'arena'.
+// Returns NULL after printing an error.
+ControlBlock *control_parse(Arena *arena, const TokenList *tokens);
+
+// Runs a parsed block, its pipelines through 'run'; per-iteration state is
+// allocated in arenas reset after every iteration. Sets last_status.
+void control_run(const ControlBlock *block, Arena *arena, ControlRun run);
+
+// Implements the 'break' builtin: break [n]
+int break_builtin(char **args);
+
+// Implements the 'continue' builtin: continue [n]
+int continue_builtin(char **args);
+
+#endif // CONTROL_H
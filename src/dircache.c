@@ -0,0 +1,206 @@
+/*
+ * dircache.c - Directory Listing Cache
+ *
+ * This file caches the sorted contents of recently listed directories so
+ * that completion (and other users of directory listings) do not call
+ * readdir() again while a directory is unchanged.
+ *
+ * Key Components:
+ *
+ * 1. Validation:
+ *    - Every lookup stat()s the directory; a listing is reused while the
+ *      directory's device, inode and mtime match those it was read with
+ *    - A directory whose mtime is not older than the time it was read may
+ *      still change within the same timestamp tick, so such a listing is
+ *      read again on the next lookup
+ *
+ * 2. Storage:
+ *    - A small fixed set of slots; a miss replaces the least recently
+ *      used one
+ *    - Each listing keeps its names in a single block
+ *
+ * Implementation Details:
+ * - Listings are keyed by device and inode, so a relative path stays
+ *   correct across 'cd'
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dircache.h"
+
+#define DIR_CACHE_SLOTS 32
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;  // Directory mtime when read
+    int racy;               // Read within the mtime tick: re-read next time
+    unsigned long used;     // Lookup clock value of the last use
+    DirEntry *entries;
+    size_t count;
+    char *names;            // Storage for all entry names
+} DirSlot;
+
+static DirSlot slots[DIR_CACHE_SLOTS];
+static unsigned long clock_tick = 0;
+
+static void free_slot(DirSlot *slot) {
+    free(slot->entries);
+    free(slot->names);
+    memset(slot, 0, sizeof(*slot));
+}
+
+void dir_cache_clear(void) {
+    for (int i = 0; i < DIR_CACHE_SLOTS; i++)
+        free_slot(&slots[i]);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const DirEntry *)a)->name, ((const DirEntry *)b)->name);
+}
+
+static void *grow(void *ptr, size_t size) {
+    void *grown = realloc(ptr, size);
+    if (!grown) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+/*
+ * read_listing: Reads and sorts the entries of 'path' into 'slot'.
+ *
+ * Returns:
+ *   0 on success, -1 if the directory cannot be opened.
+ */
+static int read_listing(const char *path, DirSlot *slot) {
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+
+    size_t count = 0, capacity = 64;
+    size_t names_len = 0, names_cap = 1024;
+    unsigned char *types = grow(NULL, capacity);
+    size_t *offsets = grow(NULL, capacity * sizeof(size_t));
+    char *names = grow(NULL, names_cap);
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        size_t len = strlen(ent->d_name) + 1;
+        if (names_len + len > names_cap) {
+            while (names_len + len > names_cap)
+                names_cap *= 2;
+            names = grow(names, names_cap);
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            types = grow(types, capacity);
+            offsets = grow(offsets, capacity * sizeof(size_t));
+        }
+        memcpy(names + names_len, ent->d_name, len);
+        offsets[count] = names_len;
+        types[count] = ent->d_type;
+        names_len += len;
+        count++;
+    }
+    closedir(dir);
+
+    // Names are placed only now, since the block may have moved while growing
+    DirEntry *entries = grow(NULL, (count ? count : 1) * sizeof(DirEntry));
+    for (size_t i = 0; i < count; i++) {
+        entries[i].name = names + offsets[i];
+        entries[i].type = types[i];
+    }
+    qsort(entries, count, sizeof(DirEntry), compare_entries);
+    free(types);
+    free(offsets);
+
+    free(slot->entries);
+    free(slot->names);
+    slot->entries = entries;
+    slot->count = count;
+    slot->names = names;
+    return 0;
+}
+
+/*
+ * dir_cache_get: Returns the (possibly cached) listing of a directory.
+ *
+ * Parameters:
+ *   path    - Directory to list.
+ *   listing - Receives the sorted entries.
+ *
+ * Returns:
+ *   0 on success, -1 with errno set if the directory cannot be read.
+ */
+int dir_cache_get(const char *path, DirListing *listing) {
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return -1;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    DirSlot *slot = NULL, *oldest = &slots[0];
+    for (int i = 0; i < DIR_CACHE_SLOTS; i++) {
+        if (slots[i].entries && slots[i].dev == st.st_dev && slots[i].ino == st.st_ino) {
+            slot = &slots[i];
+            break;
+        }
+        if (slots[i].used < oldest->used)
+            oldest = &slots[i];
+    }
+
+    int fresh = slot && !slot->racy &&
+                slot->mtime.tv_sec == st.st_mtim.tv_sec &&
+                slot->mtime.tv_nsec == st.st_mtim.tv_nsec;
+    if (!fresh) {
+        if (!slot)
+            slot = oldest;
+        if (read_listing(path, slot) < 0) {
+            int saved = errno;
+            free_slot(slot);
+            errno = saved;
+            return -1;
+        }
+        slot->dev = st.st_dev;
+        slot->ino = st.st_ino;
+        slot->mtime = st.st_mtim;
+        slot->racy = st.st_mtim.tv_sec >= time(NULL);
+    }
+
+    slot->used = ++clock_tick;
+    listing->entries = slot->entries;
+    listing->count = slot->count;
+    return 0;
+}
+
+int dir_entry_is_dir(const char *dir, const DirEntry *entry) {
+    if (entry->type == DT_DIR)
+        return 1;
+    if (entry->type != DT_UNKNOWN && entry->type != DT_LNK)
+        return 0;
+
+    size_t dir_len = strlen(dir);
+    char *path = malloc(dir_len + strlen(entry->name) + 2);
+    if (!path) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%s/%s", dir, entry->name);
+    struct stat st;
+    int is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    free(path);
+    return is_dir;
+}
@@ -0,0 +1,30 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stddef.h>
+
+// One directory entry
+typedef struct {
+    const char *name;
+    unsigned char type;     // d_type from readdir() (DT_UNKNOWN if not reported)
+} DirEntry;
+
+// The entries of a directory, sorted by name (strcmp order), without . and ..
+typedef struct {
+    const DirEntry *entries;
+    size_t count;
+} DirListing;
+
+// Returns the listing of 'path', reading the directory only if it is not
+// cached or its mtime changed. Returns 0 and fills *listing, or -1 with
+// errno set. The listing stays valid until the next dir_cache_get() call.
+int dir_cache_get(const char *path, DirListing *listing);
+
+// Returns 1 if the entry of directory 'dir' is a directory (following
+// symlinks), 0 otherwise
+int dir_entry_is_dir(const char *dir, const DirEntry *entry);
+
+// Drops every cached listing
+void dir_cache_clear(void);
+
+#endif // DIRCACHE_H
@@ -7,35 +7,56 @@
  * Key Components:
  * 
  * 1. Process Management:
- *    - Creates child processes using fork()
+ *    - Creates child processes through the spawn engine (spawn.c)
  *    - Manages process synchronization
  *    - Handles process exit status
  * 
  * 2. Redirection Setup:
- *    - Input redirection (<)
- *    - Output redirection (>, >>)
- *    - Error redirection (2>)
- *    - File descriptor management
+ *    - Opens each command's input (<), output (>, >>) and error (2>) files
+ *      (redirect.c) right before it starts and applies them through the
+ *      child's spawn plan
+ *    - Closes them as soon as the stage is running
  * 
  * 3. Pipeline Implementation:
- *    - Creates and manages pipes between processes
- *    - Handles arbitrary pipeline length
+ *    - Creates each pipe just before the stage that writes to it
+ *    - Handles arbitrary pipeline length with O(1) open pipe fds
  *    - Ensures proper cleanup of pipe resources
  * 
- * 4. Error Handling:
+ * 4. Fast Paths:
+ *    - Pure data movement stages (cat, tee) run in shell threads (fastpath.c)
+ *    - Builtin stages run in a forked subshell without exec
+ * 
+ * 5. Error Handling:
  *    - Process creation failures
  *    - File operation errors
  *    - Command execution errors
  *    - Pipeline setup failures
  * 
  * Implementation Details:
- * - Uses execvp() for command execution
- * - Manages file descriptors for redirections
- * - Handles process synchronization with waitpid()
+ * - Redirections and pipe ends become spawn plans (fd action lists)
+ * - Shell-side fds are opened close-on-exec and closed after spawning
+ * - Waits for all stages at once: one epoll set over a pidfd per stage and
+ *   the SIGCHLD signalfd; each stage is reaped by pid with wait4() as it
+ *   exits, recording status and rusage, and SIGCHLD wake-ups also let the
+ *   job table reap background jobs
+ * - Under job control each pipeline is a process group that owns the
+ *   terminal while it runs; a stopped pipeline becomes a job
+ * - A time limit (execute_limited(), the 'timeout' builtin) is one more
+ *   epoll timeout, after which the pipeline's group is signalled
+ * - When a stage exits, the process writing into its input pipe is sent
+ *   SIGPIPE at once, so a producer feeding an early-exiting consumer (like
+ *   'head') stops without first having to reach its next write
+ * - Background pipelines (execute_background()) return right after launch
+ * - Placement (execute_placed(), the 'place' builtin; 'set cgroup=DIR';
+ *   'set -o spread') sets each stage's CPUs, priorities and cgroup in its
+ *   spawn plan; under spread, background stages take the shell's CPUs in
+ *   turn, so parallel and background jobs run on different cores
  * - Provides proper resource cleanup
  * 
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -44,261 +65,977 @@
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h> 
+#include <time.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <limits.h>
 #include "executor.h"
 #include "parser.h"
+#include "spawn.h"
+#include "pathcache.h"
+#include "fastpath.h"
+#include "options.h"
+#include "jobs.h"
+#include "redirect.h"
+#include "builtins.h"
+#include "trace.h"
+
+// How the stages of one command are grouped and waited for
+typedef struct {
+    int grouped;                // Stages run in a process group of their own
+    int foreground;             // The group owns the terminal (job control)
+    pid_t pgid;                 // The group, once its first stage started
+    const ExecLimit *limit;     // Time limit (NULL if none)
+    int expired;                // Limit actions taken: 1 signal sent, 2 SIGKILL sent
+    struct timespec start;      // When the limit started counting
+    const SpawnPlacement *placement;    // Where every stage runs (NULL: the shell's)
+    int spread;                 // Stages may be spread over CPUs ('set -o spread')
+} StageGroup;
+
+// State of one wait_stages() call
+typedef struct {
+    pid_t *pids;
+    StageStats *stats;
+    int *monitors;
+    const Command *commands;
+    int count;
+    int *pidfds;    // Per stage pidfd (-1 if none)
+    int *stopped;   // Per stage: stopped by a signal
+} StageWait;
 
 /*
- * setup_redirection:
+ * report_spawn_error:
  *
- * Processes the tokenized command to set up input and output redirection.
- * It scans the tokens for redirection operators ("<" and ">") and opens
- * the corresponding files. Then, dup2() is used to redirect STDIN or STDOUT
- * accordingly.
+ * Prints the diagnostic for a command that could not be started.
  *
- * This function returns a new arguments array with the redirection tokens
- * (and the filenames following them) removed.
+ * Parameters:
+ *   name - The command name (argv[0]).
+ *   err  - The errno value returned by spawn_process().
+ */
+static void report_spawn_error(const char *name, int err) {
+    if (err == ENOENT) {
+        fprintf(stderr, "myshell: command not found: %s\n", name);
+    } else {
+        fprintf(stderr, "myshell: %s: %s\n", name, strerror(err));
+    }
+}
+
+/*
+ * launch:
+ *
+ * Resolves argv[0] through the path cache and spawns it with the plan.
+ * If a cached path has disappeared (ENOENT), the entry is dropped and
+ * the lookup is retried once against the current $PATH.
+ *
+ * Returns:
+ *   0 on success, or an errno value describing the failure.
+ */
+static int launch(char **argv, const SpawnPlan *plan, pid_t *pid) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const char *path = path_cache_lookup(argv[0]);
+        if (path == NULL) {
+            return ENOENT;
+        }
+        int err = spawn_process(path, argv, plan, pid);
+        if (err != ENOENT || path == argv[0]) {
+            return err;
+        }
+        path_cache_forget(argv[0]);
+    }
+    return ENOENT;
+}
+
+/*
+ * build_stage_plan:
+ *
+ * Describes a command's stdin/stdout/stderr wiring as a spawn plan.
+ * Pipe ends are applied first so that file redirections of the command
+ * take precedence over the pipeline, as in other shells. The pipes of
+ * process substitutions in its arguments are inherited under their own
+ * numbers, so their /dev/fd/N paths work in the child. A command with
+ * prefix assignments gets their environment.
  *
  * Parameters:
- *   args - The original NULL-terminated tokenized command array.
+ *   plan    - The plan receiving the fd actions.
+ *   cmd     - The command.
+ *   fds     - The command's own fds for stdin, stdout and stderr (-1 if none).
+ *   in_fd   - Pipe read end to use as stdin, or -1.
+ *   out_fd  - Pipe write end to use as stdout, or -1.
+ *
+ * Returns:
+ *   0 on success, -1 on allocation failure.
+ */
+static int build_stage_plan(SpawnPlan *plan, const Command *cmd, const int fds[3],
+                            int in_fd, int out_fd) {
+    if (in_fd != -1 && spawn_plan_dup2(plan, in_fd, STDIN_FILENO) < 0)
+        return -1;
+    if (out_fd != -1 && spawn_plan_dup2(plan, out_fd, STDOUT_FILENO) < 0)
+        return -1;
+    for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+        if (fds[fd] != -1 && spawn_plan_dup2(plan, fds[fd], fd) < 0)
+            return -1;
+    }
+    // Redirection paths were opened by the shell; arguments are opened by the child
+    for (int i = 0; i < cmd->sub_count; i++) {
+        int fd = cmd->subs[i].fd;
+        if (fd != -1 && cmd->subs[i].arg >= 0 && spawn_plan_dup2(plan, fd, fd) < 0)
+            return -1;
+    }
+    plan->envp = cmd->env;
+    return 0;
+}
+
+/*
+ * pipe_max_size:
+ *
+ * Returns the largest pipe capacity an unprivileged process may request
+ * (/proc/sys/fs/pipe-max-size), read once and cached, or 0 if unknown.
+ */
+static long pipe_max_size(void) {
+    static long max_size = -1;
+    if (max_size < 0) {
+        max_size = 0;
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "re");
+        if (f) {
+            if (fscanf(f, "%ld", &max_size) != 1)
+                max_size = 0;
+            fclose(f);
+        }
+    }
+    return max_size;
+}
+
+/*
+ * set_pipe_size:
+ *
+ * Resizes a pipe with F_SETPIPE_SZ. Requests above the system limit (and
+ * the int that fcntl() takes) are clamped to it before the call instead of
+ * failing, so a large 'pipebuf' still gets the biggest buffer allowed.
  *
  * Returns:
- *   A new arguments array with redirection tokens removed.
- *   Exits the process if any errors occur.
+ *   The capacity granted by the kernel, or -1 with errno set.
  */
-char **setup_redirection(char **args) {
-    // Count non-redirection tokens first
-    int count = 0;
-    for (int i = 0; args[i] != NULL; i++) {
-        if (strcmp(args[i], ">") == 0 || strcmp(args[i], "<") == 0 || 
-            strcmp(args[i], "2>") == 0) {
-            i++; // skip the file token
+long set_pipe_size(int fd, long size) {
+    long max_size = pipe_max_size();
+    if (max_size > 0 && size > max_size)
+        size = max_size;
+    if (size > INT_MAX)
+        size = INT_MAX;
+    return fcntl(fd, F_SETPIPE_SZ, (int)size);
+}
+
+/*
+ * grow_full_pipes:
+ *
+ * Adaptive pipe sizing: a pipe whose queued bytes reach its capacity has
+ * a producer blocked on it, so its buffer is doubled (up to the system
+ * limit) to cut the context switches between the two stages.
+ */
+static void grow_full_pipes(const int *monitors, int count) {
+    long max_size = pipe_max_size();
+    for (int i = 0; i < count; i++) {
+        if (monitors[i] == -1)
+            continue;
+        int queued = 0;
+        long capacity = fcntl(monitors[i], F_GETPIPE_SZ);
+        if (capacity <= 0 || ioctl(monitors[i], FIONREAD, &queued) < 0)
             continue;
+        if (queued >= capacity && (max_size == 0 || capacity < max_size))
+            set_pipe_size(monitors[i], capacity * 2);
+    }
+}
+
+/*
+ * group_init:
+ *
+ * Decides how a foreground command's stages are grouped: with job control
+ * they form a process group that owns the terminal while it runs, and a
+ * time limit always puts them in a group of their own so the whole
+ * pipeline can be signalled at once.
+ */
+static void group_init(StageGroup *group, const ExecLimit *limit) {
+    group->foreground = jobs_job_control();
+    group->grouped = group->foreground || limit != NULL;
+    group->pgid = 0;
+    group->limit = limit;
+    group->expired = 0;
+    clock_gettime(CLOCK_MONOTONIC, &group->start);
+    group->placement = NULL;
+    group->spread = 0;
+}
+
+/*
+ * next_cpu:
+ *
+ * Returns the next CPU the shell may run on, in turn, for spreading
+ * background stages; -1 if the shell's affinity cannot be read.
+ */
+static int next_cpu(void) {
+    static cpu_set_t allowed;
+    static int known = -1;      // -1: not read yet, 0: unreadable, 1: read
+    static int next = 0;
+
+    if (known < 0)
+        known = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0;
+    if (!known)
+        return -1;
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        int cpu = (next + i) % CPU_SETSIZE;
+        if (CPU_ISSET(cpu, &allowed)) {
+            next = cpu + 1;
+            return cpu;
         }
-        count++;
     }
-    
-    char **new_args = malloc((count + 1) * sizeof(char*));
-    if (!new_args) {
-        perror("myshell");
+    return -1;
+}
+
+/*
+ * stage_placement:
+ *
+ * Works out where a stage runs: the group's placement, in the cgroup of
+ * 'set cgroup' unless the placement names one, and for a spread group under
+ * 'set -o spread' on the next CPU in turn unless it names CPUs.
+ *
+ * Returns:
+ *   'out', filled in, or NULL if the stage runs like the shell.
+ */
+static const SpawnPlacement *stage_placement(const StageGroup *group, SpawnPlacement *out) {
+    int spread = group->spread && shell_options.spread;
+    if (!group->placement && shell_options.cgroup_fd < 0 && !spread)
         return NULL;
+
+    if (group->placement)
+        *out = *group->placement;
+    else
+        spawn_placement_init(out);
+    if (out->cgroup_fd < 0)
+        out->cgroup_fd = shell_options.cgroup_fd;
+    if (spread && !out->set_cpus)
+        spawn_placement_add_cpu(out, next_cpu());
+    return out;
+}
+
+/*
+ * group_joined:
+ *
+ * Records a started stage: the first one leads the group, which then
+ * becomes the terminal's foreground group.
+ */
+static void group_joined(StageGroup *group, pid_t pid) {
+    if (!group->grouped || group->pgid != 0 || pid <= 0)
+        return;
+    group->pgid = pid;
+    if (group->foreground)
+        jobs_give_terminal(pid);
+}
+
+/*
+ * limit_timeout:
+ *
+ * Returns the milliseconds left until the group's next time limit action,
+ * or -1 if none is pending.
+ */
+static int limit_timeout(const StageGroup *group) {
+    const ExecLimit *limit = group->limit;
+    if (limit == NULL || group->pgid <= 0)
+        return -1;
+    double due;
+    if (group->expired == 0)
+        due = limit->seconds;
+    else if (group->expired == 1 && limit->kill_after > 0)
+        due = limit->seconds + limit->kill_after;
+    else
+        return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - group->start.tv_sec) +
+                     (now.tv_nsec - group->start.tv_nsec) / 1e9;
+    double left = (due - elapsed) * 1000.0;
+    if (left <= 0)
+        return 0;
+    return left > 1e9 ? 1000000000 : (int)left + 1;
+}
+
+/*
+ * enforce_limit:
+ *
+ * Signals the group once its time is up: first with limit->signal (plus
+ * SIGCONT, so a stopped stage receives it), then with SIGKILL after
+ * 'kill_after'.
+ */
+static void enforce_limit(StageGroup *group) {
+    if (limit_timeout(group) != 0)
+        return;
+    if (group->expired == 0) {
+        kill(-group->pgid, group->limit->signal);
+        if (group->limit->signal != SIGKILL && group->limit->signal != SIGCONT)
+            kill(-group->pgid, SIGCONT);
+    } else {
+        kill(-group->pgid, SIGKILL);
     }
-    
-    int j = 0;
-    for (int i = 0; args[i] != NULL; i++) {
-        if (strcmp(args[i], ">") == 0) {
-            i++;
-            if (args[i] == NULL) {
-                fprintf(stderr, "myshell: syntax error: missing output file\n");
-                free_args(new_args);
-                return NULL;
-            }
-            int fd = open(args[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror("myshell");
-                free_args(new_args);
-                return NULL;
-            }
-            if (dup2(fd, STDOUT_FILENO) < 0) {
-                perror("myshell");
-                close(fd);
-                free_args(new_args);
-                return NULL;
-            }
-            close(fd);
-        } else if (strcmp(args[i], "2>") == 0) {
-            i++;
-            if (args[i] == NULL) {
-                fprintf(stderr, "myshell: syntax error: missing error file\n");
-                free_args(new_args);
-                return NULL;
-            }
-            int fd = open(args[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror("myshell");
-                free_args(new_args);
-                return NULL;
-            }
-            if (dup2(fd, STDERR_FILENO) < 0) {
-                perror("myshell");
-                close(fd);
-                free_args(new_args);
-                return NULL;
-            }
-            close(fd);
-        } else if (strcmp(args[i], "<") == 0) {
-            i++;
-            if (args[i] == NULL) {
-                fprintf(stderr, "myshell: syntax error: missing input file\n");
-                free_args(new_args);
-                return NULL;
-            }
-            int fd = open(args[i], O_RDONLY);
-            if (fd < 0) {
-                fprintf(stderr, "myshell: %s: No such file or directory\n", args[i]);
-                free_args(new_args);
-                return NULL;
-            }
-            if (dup2(fd, STDIN_FILENO) < 0) {
-                perror("myshell");
-                close(fd);
-                free_args(new_args);
-                return NULL;
-            }
-            close(fd);
-        } else if (strcmp(args[i], ">>") == 0) {
-            i++;
-            if (args[i] == NULL) {
-                fprintf(stderr, "myshell: syntax error: missing output file\n");
-                exit(EXIT_FAILURE);
+    group->expired++;
+}
+
+/*
+ * open_pidfd: Returns a close-on-exec pidfd for a child, or -1.
+ */
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * reap_stage:
+ *
+ * Collects a state change of stage i without blocking. An exit records the
+ * stage's status, end time and resource usage and tears down its upstream
+ * neighbour (see wait_stages()); a stop or continue only updates its
+ * 'stopped' flag.
+ *
+ * Returns:
+ *   1 if the stage is gone, 0 if it is still alive.
+ */
+static int reap_stage(StageWait *wait, int i, int flags) {
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    do {
+        pid = wait4(wait->pids[i], &status, flags, &usage);
+    } while (pid < 0 && errno == EINTR);
+    if (pid == 0)
+        return 0;
+    if (pid > 0 && WIFSTOPPED(status)) {
+        wait->stopped[i] = 1;
+        wait->stats[i].status = status;
+        return 0;
+    }
+    if (pid > 0 && WIFCONTINUED(status)) {
+        wait->stopped[i] = 0;
+        return 0;
+    }
+
+    // Exited, killed, or no longer a child of ours (ECHILD)
+    wait->pids[i] = -1;
+    wait->stopped[i] = 0;
+    if (pid > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &wait->stats[i].end);
+        wait->stats[i].status = status;
+        wait->stats[i].usage = usage;
+        if (trace_enabled)
+            trace_span("stage", trace_time(&wait->stats[i].start), trace_time(&wait->stats[i].end),
+                       pid, "status", exit_status(status), NULL);
+    }
+    if (wait->pidfds[i] != -1) {
+        close(wait->pidfds[i]);
+        wait->pidfds[i] = -1;
+    }
+    if (wait->monitors && i > 0 && wait->monitors[i - 1] != -1) {
+        close(wait->monitors[i - 1]);
+        wait->monitors[i - 1] = -1;
+    }
+
+    // The writer has lost its reader; the pid is unreaped, so still ours
+    if (wait->commands && i > 0 && wait->pids[i - 1] > 0 &&
+        !redirects_fd(&wait->commands[i - 1], STDOUT_FILENO))
+        kill(wait->pids[i - 1], SIGPIPE);
+    return 1;
+}
+
+/*
+ * wait_stages:
+ *
+ * Waits for the stages' processes, reaping them in the order they exit
+ * with wait4() so each stage's wait status, end time and resource usage
+ * are recorded in 'stats'. Reaped pids are set to -1.
+ *
+ * Every stage gets a pidfd, and one epoll set waits on all of them
+ * together with the job table's SIGCHLD signalfd, so a stage is reaped by
+ * pid the moment it exits and a background job finishing meanwhile is
+ * handed to jobs_poll(). Nothing ever waits for "any child", so neither
+ * side can take the other's children. The signalfd also reports stops;
+ * when it fires, the live stages are checked with WUNTRACED under job
+ * control, and for stages whose pidfd could not be opened (e.g. kernels
+ * before 5.3). Without epoll the wait polls every 5 ms.
+ *
+ * With adaptive pipe sizing, 'monitors[i]' is the shell's extra read end of
+ * the pipe feeding stage i+1. The wait then wakes every 5 ms, sampling the
+ * pipes for fullness, and closes each monitor as soon as its reader exits
+ * so writers still get EPIPE from a vanished reader.
+ *
+ * With 'commands' (pipelines), a reaped stage's upstream neighbour is sent
+ * SIGPIPE if it is still running and writes into the pipe, which is what
+ * it would get from its next write; its own exit then tears down the stage
+ * before it in turn. A stage whose stdout is redirected to a file does not
+ * write into the pipe and is left alone. A helper thread stage stops at
+ * its next write instead.
+ *
+ * Returns:
+ *   1 if the stages still alive have all stopped (e.g. on Ctrl-Z; their
+ *   stop status is stored in 'stats'), 0 once all were reaped.
+ */
+static int wait_stages(pid_t *pids, StageStats *stats, int *monitors,
+                       const Command *commands, int count, StageGroup *group) {
+    const struct timespec tick = { 0, 5 * 1000 * 1000 };  // 5 ms
+    int *state = malloc(2 * count * sizeof(int));
+    if (!state) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    StageWait wait = { pids, stats, monitors, commands, count, state, state + count };
+
+    // Stops are only reported under job control; a time limit keeps running
+    int flags = WNOHANG;
+    if (group->foreground && group->limit == NULL)
+        flags |= WUNTRACED | WCONTINUED;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int signal_fd = jobs_signal_fd();
+    int missing = 0;   // Stages without a pidfd
+    int live = 0;
+    for (int i = 0; i < count; i++) {
+        wait.pidfds[i] = -1;
+        wait.stopped[i] = 0;
+        if (pids[i] <= 0)
+            continue;
+        live++;
+        if (epfd != -1)
+            wait.pidfds[i] = open_pidfd(pids[i]);
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        if (wait.pidfds[i] == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, wait.pidfds[i], &event) < 0)
+            missing++;
+    }
+    if (epfd != -1 && signal_fd != -1) {
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)count };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, signal_fd, &event);
+    }
+
+    // When the signalfd fires, which stages can it concern
+    int check_all = missing > 0 || (flags & WUNTRACED);
+    // No wake-up source for some changes: poll instead
+    int blind = epfd == -1 || (signal_fd == -1 && check_all);
+
+    int stopped = 0;
+    int sweep = 1;   // Check every live stage
+    while (live > 0) {
+        for (int i = 0; sweep && i < count; i++) {
+            if (pids[i] > 0)
+                live -= reap_stage(&wait, i, flags);
+        }
+        sweep = 0;
+        if (live == 0)
+            break;
+
+        int all_stopped = 1;
+        for (int i = 0; i < count && all_stopped; i++) {
+            if (pids[i] > 0 && !wait.stopped[i])
+                all_stopped = 0;
+        }
+        if (all_stopped) {
+            stopped = 1;
+            break;
+        }
+
+        enforce_limit(group);
+        int timeout = limit_timeout(group);
+        if ((monitors || blind) && (timeout < 0 || timeout > 5))
+            timeout = 5;
+
+        struct epoll_event events[16];
+        int ready = 0;
+        if (epfd != -1) {
+            ready = epoll_wait(epfd, events, 16, timeout);
+            if (ready < 0) {
+                if (errno != EINTR)
+                    break;
+                ready = 0;
             }
-            int fd = open(args[i], O_WRONLY | O_CREAT | O_APPEND, 0644);
-            if (fd < 0) {
-                perror("myshell");
-                exit(EXIT_FAILURE);
+        } else {
+            nanosleep(&tick, NULL);
+        }
+        if (ready == 0) {
+            if (monitors)
+                grow_full_pipes(monitors, count - 1);
+            if (blind)
+                sweep = 1;
+        }
+        for (int e = 0; e < ready; e++) {
+            uint32_t i = events[e].data.u32;
+            if (i == (uint32_t)count) {
+                // SIGCHLD: background jobs, stops, stages without pidfds
+                jobs_poll(0);
+                if (check_all)
+                    sweep = 1;
+            } else if (pids[i] > 0) {
+                live -= reap_stage(&wait, (int)i, flags);
             }
-            if (dup2(fd, STDOUT_FILENO) < 0) {
-                perror("myshell");
-                exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (wait.pidfds[i] != -1)
+            close(wait.pidfds[i]);
+    }
+    if (epfd != -1)
+        close(epfd);
+    if (monitors) {
+        for (int i = 0; i < count - 1; i++) {
+            if (monitors[i] != -1) {
+                close(monitors[i]);
+                monitors[i] = -1;
             }
-            close(fd);
-        } else {
-            new_args[j++] = strdup(args[i]);
         }
     }
-    new_args[j] = NULL;
-    return new_args;
+    free(state);
+    return stopped;
+}
+
+/*
+ * command_text:
+ *
+ * Rebuilds a pipeline's text from its arguments ("a x | b y") to name a
+ * stopped job. Returns a malloc'd string.
+ */
+static char *command_text(const Command *commands, int count) {
+    size_t len = 1;
+    for (int i = 0; i < count; i++) {
+        for (char **arg = commands[i].args; *arg; arg++)
+            len += strlen(*arg) + 1;
+        len += 3;
+    }
+    char *text = malloc(len);
+    if (!text) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    char *out = text;
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            out = stpcpy(out, " | ");
+        for (char **arg = commands[i].args; *arg; arg++) {
+            if (arg != commands[i].args)
+                *out++ = ' ';
+            out = stpcpy(out, *arg);
+        }
+    }
+    *out = '\0';
+    return text;
+}
+
+/*
+ * finish_group:
+ *
+ * Ends a foreground wait: the shell takes the terminal back, and stages
+ * that stopped become a stopped job.
+ */
+static void finish_group(const StageGroup *group, const pid_t *pids,
+                         const Command *commands, int count, int stopped) {
+    if (group->foreground)
+        jobs_take_terminal();
+    if (stopped) {
+        char *text = command_text(commands, count);
+        jobs_add_stopped(pids, count, group->pgid, text);
+        free(text);
+    }
+}
+
+/*
+ * start_stage_stats:
+ *
+ * Resets a stage's statistics and stamps its start time. Stages that never
+ * start keep exit status 127, like a command that was not found.
+ */
+static void start_stage_stats(StageStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->pid = -1;
+    stats->status = 127 << 8;
+    clock_gettime(CLOCK_MONOTONIC, &stats->start);
+    stats->end = stats->start;
+}
+
+/*
+ * stage_fd:
+ *
+ * Picks the fd a stage uses for one stream: its own redirection first,
+ * then the pipe end, then the shell's inherited fd.
+ */
+static int stage_fd(int redir_fd, int pipe_fd, int default_fd) {
+    if (redir_fd != -1)
+        return redir_fd;
+    if (pipe_fd != -1)
+        return pipe_fd;
+    return default_fd;
 }
 
 /*
  * execute_command:
  *
- * Executes a command with its arguments, handling input/output redirection.
- * This function forks a new process. In the child process, it calls setup_redirection()
- * to configure any requested redirection, then uses execvp() to execute the command.
- * If execvp() fails, it prints an error message. The parent process waits for the child.
+ * Executes a single parsed command. Its redirection files are opened
+ * now, turned into a spawn plan and closed once the command is running; the command is
+ * launched through spawn_process() without copying the shell's address
+ * space, using the path cached for the command name instead of a $PATH
+ * walk. If the command cannot be started, an error message is printed.
+ * The parent process waits for the child; under job control the child
+ * runs in its own process group holding the terminal, and becomes a
+ * stopped job if it is stopped.
  *
  * Parameters:
- *   args - A NULL-terminated array of strings, where the first element is the command
- *          and subsequent elements are its arguments (which may include redirection tokens).
+ *   cmd - The command to run; its fds remain owned by the caller.
+ *   stats - Optional entry receiving the wait status, timing and resource usage.
+ *
+ * Returns:
+ *   The command's exit status (127 if it could not be started, 1 if a
+ *   redirection failed).
  */
-void execute_command(char **args) {
+int execute_command(Command *cmd, StageStats *stats) {
     pid_t pid;
-    int status;
+    SpawnPlan plan;
+    SpawnPlacement placement;
+    StageStats local;
     
-    pid = fork();
-    if (pid < 0) {
-        perror("myshell");
-        return;
-    } else if (pid == 0) {
-        // Child process
-        char **new_args = setup_redirection(args);
-        if (!new_args) {
-            exit(EXIT_FAILURE);
+    int fds[3], opened[3];
+    
+    // The status is always recorded; a caller without stats gets it returned
+    if (!stats)
+        stats = &local;
+    start_stage_stats(stats);
+    uint64_t traced = trace_begin();
+    if (redirect_resolve(cmd, fds, opened) < 0) {
+        stats->status = 1 << 8;
+        return 1;
+    }
+    if (cmd->redir_count > 0)
+        trace_end("redirect", traced, "stage", 0, cmd->args[0]);
+    StageGroup group;
+    group_init(&group, NULL);
+    spawn_plan_init(&plan);
+    if (group.grouped)
+        plan.pgroup = 0;
+    plan.placement = stage_placement(&group, &placement);
+    int err = ENOMEM;
+    traced = trace_begin();
+    if (build_stage_plan(&plan, cmd, fds, -1, -1) == 0)
+        err = launch(cmd->args, &plan, &pid);
+    trace_end("spawn", traced, "stage", 0, cmd->args[0]);
+    spawn_plan_free(&plan);
+    redirect_close(opened);
+
+    if (err != 0) {
+        report_spawn_error(cmd->args[0], err);
+        return exit_status(stats->status);
+    }
+
+    stats->pid = pid;
+    group_joined(&group, pid);
+    traced = trace_begin();
+    int stopped = wait_stages(&pid, stats, NULL, NULL, 1, &group);
+    trace_end("wait", traced, "stages", 1, NULL);
+    finish_group(&group, &pid, cmd, 1, stopped);
+    return exit_status(stats->status);
+}
+
+/*
+ * start_stages:
+ *
+ * Launches the stages of a pipeline without waiting for them. The pipe feeding
+ * stage i+1 is created just before stage i starts, and the parent closes its
+ * copies as soon as the stages using them are running.
+ *
+ * Parameters:
+ *   commands, cmd_count - The pipeline.
+ *   pids - Receives each stage's pid, or -1 if it runs in a helper thread or
+ *          could not be started.
+ *   helpers - Receives the fast-path helper of each stage; NULL spawns every
+ *             stage as a process.
+ *   monitors - Adaptive pipe sizing: receives an extra read end of each pipe
+ *              (NULL when not used).
+ *   stats - Optional per-stage statistics to initialize.
+ *   group - The process group the stages join (NULL: the shell's own).
+ *
+ * Returns:
+ *   The number of stages that were attempted; a failed pipe() stops early.
+ */
+static int start_stages(Command *commands, int cmd_count, pid_t *pids,
+                        FastPathStage **helpers, int *monitors, StageStats *stats,
+                        StageGroup *group) {
+    int prev_read = -1;   // Read end of the pipe feeding the current stage
+    int launched = 0;
+    
+    for (int i = 0; i < cmd_count; i++) {
+        int pipe_fds[2] = { -1, -1 };
+
+        // Pipe output (if not last command)
+        if (i < cmd_count - 1) {
+            if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+                perror("myshell: pipe");
+                break;
+            }
+            if (shell_options.pipe_buffer_size > 0)
+                set_pipe_size(pipe_fds[1], shell_options.pipe_buffer_size);
+            if (monitors)
+                monitors[i] = fcntl(pipe_fds[0], F_DUPFD_CLOEXEC, 0);
         }
-        
-        // Execute the command
-        if (execvp(new_args[0], new_args) == -1) {
-            if (errno == ENOENT) {
-                fprintf(stderr, "myshell: command not found: %s\n", new_args[0]);
-            } else {
-                fprintf(stderr, "myshell: %s: %s\n", new_args[0], strerror(errno));
+
+        pids[i] = -1;
+        launched = i + 1;
+        if (stats)
+            start_stage_stats(&stats[i]);
+
+        // The stage's files are only open while it is being started
+        int fds[3], opened[3];
+        uint64_t traced = trace_begin();
+        int ready = redirect_resolve(&commands[i], fds, opened) == 0;
+        if (!ready && stats)
+            stats[i].status = 1 << 8;
+        if (ready && commands[i].redir_count > 0)
+            trace_end("redirect", traced, "stage", i, commands[i].args[0]);
+
+        // A stage whose words expanded to nothing succeeds without running
+        int empty = commands[i].args[0] == NULL;
+        if (ready && empty && stats)
+            stats[i].status = 0;
+
+        // Pure data movement stages run in a helper thread instead
+        FastPathStage *helper = NULL;
+        if (ready && !empty && helpers && fastpath_supported(&commands[i])) {
+            helper = fastpath_start(&commands[i],
+                stage_fd(fds[STDIN_FILENO], prev_read, STDIN_FILENO),
+                stage_fd(fds[STDOUT_FILENO], pipe_fds[1], STDOUT_FILENO),
+                stage_fd(fds[STDERR_FILENO], -1, STDERR_FILENO));
+        }
+        if (helpers)
+            helpers[i] = helper;
+
+        if (ready && !empty && helper == NULL) {
+            SpawnPlan plan;
+            SpawnPlacement placement;
+            spawn_plan_init(&plan);
+            if (group && group->grouped)
+                plan.pgroup = group->pgid;
+            if (group)
+                plan.placement = stage_placement(group, &placement);
+            traced = trace_begin();
+            if (build_stage_plan(&plan, &commands[i], fds, prev_read, pipe_fds[1]) == 0) {
+                // Builtin stages run in a forked subshell
+                const Builtin *builtin = builtin_lookup(commands[i].args[0]);
+                int err = builtin ? spawn_function(builtin->func, commands[i].args, &plan, &pids[i])
+                                  : launch(commands[i].args, &plan, &pids[i]);
+                trace_end("spawn", traced, "stage", i, commands[i].args[0]);
+                if (err != 0) {
+                    report_spawn_error(commands[i].args[0], err);
+                    pids[i] = -1;
+                } else if (group) {
+                    group_joined(group, pids[i]);
+                }
             }
-            free_args(new_args);
-            exit(EXIT_FAILURE);
+            spawn_plan_free(&plan);
+            if (stats)
+                stats[i].pid = pids[i];
         }
-    } else {
-        // Parent process
-        while (waitpid(pid, &status, WUNTRACED) > 0) {
-            if (WIFEXITED(status) || WIFSIGNALED(status))
-                break;
+        if (ready)
+            redirect_close(opened);
+
+        // Only pipes read by a running process are monitored
+        if (monitors && i > 0 && pids[i] <= 0 && monitors[i - 1] != -1) {
+            close(monitors[i - 1]);
+            monitors[i - 1] = -1;
         }
+
+        // The stage owns its ends now; keep only the read end for the next one
+        if (prev_read != -1)
+            close(prev_read);
+        if (pipe_fds[1] != -1)
+            close(pipe_fds[1]);
+        prev_read = pipe_fds[0];
     }
+
+    if (prev_read != -1)
+        close(prev_read);
+
+    // A failed launch leaves the last pipe without a reader
+    if (monitors && launched < cmd_count && launched > 0 && monitors[launched - 1] != -1) {
+        close(monitors[launched - 1]);
+        monitors[launched - 1] = -1;
+    }
+    return launched;
 }
 
 /*
- * execute_pipeline:
+ * run_stages:
  *
  * Executes a pipeline of commands, connecting the output of each command to the input
- * of the next command using pipes. This function creates all necessary pipes, then
- * forks a child process for each command in the pipeline. It sets up the appropriate
- * input/output redirections for each process, including any file redirections specified
- * in the Command structures.
+ * of the next command using pipes. Pipes are created lazily: the pipe feeding stage
+ * i+1 is opened just before stage i is spawned, and the parent closes its copies of
+ * both ends as soon as the stage that uses them is running. The parent therefore
+ * never holds more than one pipe plus one read end, whatever the pipeline length.
+ * The pipe ends and any file redirections specified in the Command structures are
+ * expressed as a spawn plan per stage; all shell-side fds are close-on-exec, so
+ * children only inherit their own ends. With 'set pipebuf=SIZE' each pipe is resized
+ * with F_SETPIPE_SZ; with 'set pipebuf=auto' the parent samples the pipes while
+ * waiting and grows those it finds full. Plain 'cat'/'tee' stages are not spawned at
+ * all: they run in a helper thread that moves the data with splice()/tee().
  *
- * The parent process waits for all child processes to complete before returning.
+ * The parent process waits for all child processes to complete before returning,
+ * reaping them in exit order. A grouped pipeline (job control, time limit) runs in
+ * a process group of its own and spawns every stage; under job control the group
+ * holds the terminal while it runs, and a pipeline stopped with Ctrl-Z is handed to
+ * the job table.
  *
  * Parameters:
  *   commands - An array of Command structures, each containing the command to execute
  *              and any associated redirections.
  *   cmd_count - The number of commands in the pipeline.
+ *   stats - Optional array of cmd_count entries receiving each stage's wait status,
+ *           timing and resource usage.
+ *   group - How the stages are grouped and waited for.
+ *
+ * Returns:
+ *   The exit status of the last stage; with 'set -o pipefail', that of the
+ *   rightmost stage that failed (0 if all succeeded).
  */
-
-void execute_pipeline(Command *commands, int cmd_count) {
-    int pipes[10][2];  // Support up to 10 pipes (11 commands)
-    pid_t pids[11];    // Store process IDs
-    
-    // Create necessary pipes
-    for (int i = 0; i < cmd_count - 1; i++) {
-        if (pipe(pipes[i]) < 0) {
-            perror("myshell: pipe");
-            return;
-        }
+static int run_stages(Command *commands, int cmd_count, StageStats *stats,
+                      StageGroup *group) {
+    pid_t *pids = malloc(cmd_count * sizeof(pid_t));
+    FastPathStage **helpers = malloc(cmd_count * sizeof(FastPathStage *));
+    int *monitors = NULL;   // Adaptive mode: extra read end of each pipe
+    StageStats *local = NULL;   // Statuses of a pipeline run without stats
+    if (shell_options.pipe_buffer_adaptive)
+        monitors = malloc(cmd_count * sizeof(int));
+    if (!stats)
+        stats = local = malloc(cmd_count * sizeof(StageStats));
+    if (!pids || !helpers || !stats || (shell_options.pipe_buffer_adaptive && !monitors)) {
+        perror("myshell: allocation error");
+        free(pids);
+        free(helpers);
+        free(monitors);
+        free(local);
+        return 1;
     }
-    
-    // Launch all processes
-    for (int i = 0; i < cmd_count; i++) {
-        pids[i] = fork();
-        if (pids[i] < 0) {
-            perror("myshell: fork");
-            return;
-        }
-        
-        if (pids[i] == 0) {  // Child process
-            // Set up pipe input (if not first command)
-            if (i > 0) {
-                if (dup2(pipes[i-1][0], STDIN_FILENO) < 0) {
-                    perror("myshell: dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            // Set up pipe output (if not last command)
-            if (i < cmd_count - 1) {
-                if (dup2(pipes[i][1], STDOUT_FILENO) < 0) {
-                    perror("myshell: dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            // Close all pipe fds in child
-            for (int j = 0; j < cmd_count - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            
-            // Handle any redirections for this command
-            if (commands[i].input_fd != -1)
-                dup2(commands[i].input_fd, STDIN_FILENO);
-            if (commands[i].output_fd != -1)
-                dup2(commands[i].output_fd, STDOUT_FILENO);
-            if (commands[i].error_fd != -1)
-                dup2(commands[i].error_fd, STDERR_FILENO);
-            
-            // Execute the command
-            execvp(commands[i].args[0], commands[i].args);
-            fprintf(stderr, "myshell: %s: command not found\n", commands[i].args[0]);
-            exit(EXIT_FAILURE);
-        }
-    }
-    
-    // Parent closes all pipe fds
-    for (int i = 0; i < cmd_count - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+
+    // Helper threads can be neither stopped nor moved into a process group,
+    // a cgroup or another CPU
+    int threads = !group->grouped && !group->placement && shell_options.cgroup_fd < 0;
+    int launched = start_stages(commands, cmd_count, pids, threads ? helpers : NULL,
+                                monitors, stats, group);
+
+    // Wait for all children, then for the helper threads
+    uint64_t traced = trace_begin();
+    int stopped = wait_stages(pids, stats, monitors, commands, launched, group);
+    free(monitors);
+    for (int i = 0; threads && i < launched; i++) {
+        if (helpers[i] != NULL)
+            fastpath_wait(helpers[i], &stats[i]);
     }
-    
-    // Wait for all children
-    for (int i = 0; i < cmd_count; i++) {
-        int status;
-        waitpid(pids[i], &status, 0);
+    finish_group(group, pids, commands, launched, stopped);
+    trace_end("wait", traced, "stages", launched, NULL);
+
+    // Stages that were never attempted count as not started
+    int status = launched < cmd_count ? 127 : exit_status(stats[cmd_count - 1].status);
+    if (shell_options.pipefail) {
+        for (int i = launched; i-- > 0 && status == 0;)
+            status = exit_status(stats[i].status);
     }
-}
\ No newline at end of file
+    free(pids);
+    free(helpers);
+    free(local);
+    return status;
+}
+
+/*
+ * execute_pipeline: Runs a pipeline in the foreground (see run_stages()).
+ */
+int execute_pipeline(Command *commands, int cmd_count, StageStats *stats) {
+    StageGroup group;
+    group_init(&group, NULL);
+    return run_stages(commands, cmd_count, stats, &group);
+}
+
+/*
+ * execute_limited:
+ *
+ * Runs a pipeline like execute_pipeline(), in a process group of its own
+ * that is signalled when the limit expires. The deadline is one more
+ * timeout of the same epoll wait, so no timer or helper process is used.
+ *
+ * Returns:
+ *   The pipeline's status; 124 if the limit expired, 137 if the group
+ *   had to be killed.
+ */
+int execute_limited(Command *commands, int cmd_count, const ExecLimit *limit) {
+    StageGroup group;
+    group_init(&group, limit);
+    int status = run_stages(commands, cmd_count, NULL, &group);
+    if (group.expired == 2 || (group.expired == 1 && limit->signal == SIGKILL))
+        return 128 + SIGKILL;
+    if (group.expired == 1)
+        return 124;
+    return status;
+}
+
+/*
+ * execute_placed:
+ *
+ * Runs a pipeline like execute_pipeline() with every stage placed as
+ * 'placement' says; each child applies it between its fork and its exec,
+ * so the shell's own CPUs, priorities and cgroup stay as they are.
+ *
+ * Returns:
+ *   The pipeline's status.
+ */
+int execute_placed(Command *commands, int cmd_count, const SpawnPlacement *placement) {
+    StageGroup group;
+    group_init(&group, NULL);
+    group.placement = placement;
+    return run_stages(commands, cmd_count, NULL, &group);
+}
+
+/*
+ * exit_status: Converts a wait status into a shell exit status.
+ */
+int exit_status(int wait_status) {
+    if (WIFSIGNALED(wait_status))
+        return 128 + WTERMSIG(wait_status);
+    if (WIFSTOPPED(wait_status))
+        return 128 + WSTOPSIG(wait_status);
+    return WEXITSTATUS(wait_status);
+}
+
+/*
+ * execute_background:
+ *
+ * Launches a pipeline without waiting for it. Every stage is spawned as a
+ * process (no fast-path helper threads), so the job consists only of
+ * children the job table can reap. Under 'set -o spread' each stage is
+ * pinned to the next of the shell's CPUs.
+ *
+ * Parameters:
+ *   commands - The pipeline's commands; their fds remain owned by the caller.
+ *   cmd_count - The number of commands in the pipeline.
+ *   pids - Array of cmd_count entries receiving each stage's pid (-1 if the
+ *          stage could not be started).
+ *   pgid - If non-NULL, receives the job's process group: with job control,
+ *          the stages get one of their own (-1 otherwise).
+ *
+ * Returns:
+ *   The number of entries of 'pids' that were filled in.
+ */
+int execute_background(Command *commands, int cmd_count, pid_t *pids, pid_t *pgid) {
+    StageGroup group;
+    group_init(&group, NULL);
+    group.grouped = pgid != NULL && group.foreground;
+    group.foreground = 0;
+    group.spread = 1;
+    int launched = start_stages(commands, cmd_count, pids, NULL, NULL, NULL, &group);
+    if (pgid)
+        *pgid = group.grouped && group.pgid > 0 ? group.pgid : -1;
+    return launched;
+}
@@ -1,19 +1,95 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "spawn.h"
+
+// A file redirection, opened only when the command is started
+typedef struct {
+    int target_fd;      // STDIN_FILENO, STDOUT_FILENO or STDERR_FILENO
+    int flags;          // open() flags
+    const char *path;
+    const char *data;   // Here-document or here-string text (NULL for a file)
+} Redirection;
+
+// A process substitution, <(...) or >(...), standing for an argument or a
+// redirection path; it is replaced by /dev/fd/N when started (procsub.c)
+typedef struct {
+    const char *text;   // The command line inside the parentheses
+    int writable;       // >(...): writes to the path feed the command
+    int arg;            // Index of the argument it stands for (-1 if a path)
+    int redir;          // Index of the redirection whose path it is (-1 if an argument)
+    int fd;             // The shell's end of its pipe (-1 until started)
+    pid_t *pids;        // Processes running the substitution
+    int pid_count;
+} ProcessSub;
+
 // Structure to hold command information
 typedef struct {
-    char **args;    // Command arguments
-    int input_fd;   // Input redirection fd (-1 if none)
-    int output_fd;  // Output redirection fd (-1 if none)
-    int error_fd;   // Error redirection fd (-1 if none)
+    char **args;            // Command arguments
+    Redirection *redirs;    // File redirections in command-line order
+    int redir_count;
+    int input_fd;   // Input fd supplied by the shell (-1 if none)
+    int output_fd;  // Output fd supplied by the shell (-1 if none)
+    int error_fd;   // Error fd supplied by the shell (-1 if none)
+    ProcessSub *subs;       // Process substitutions in its arguments and paths
+    int sub_count;
+    char **assigns;         // Leading NAME=value words, expanded
+    int assign_count;
+    char **env;             // Environment with the assignments (NULL: the shell's)
 } Command;
 
-// Executes a command with its arguments.
-// 'args' is a NULL-terminated array of strings, where args[0] is the command.
-void execute_command(char **args);
+// Outcome and resource usage of one pipeline stage
+typedef struct {
+    pid_t pid;              // Child pid (-1 if the stage ran in-process or never started)
+    int status;             // Wait status (exit code 127 if it never started)
+    struct timespec start;  // CLOCK_MONOTONIC launch time
+    struct timespec end;    // CLOCK_MONOTONIC reap time
+    struct rusage usage;    // Resource usage reported by wait4()
+} StageStats;
+
+// Executes a single parsed command with its redirections and returns its
+// exit status. 'stats' (may be NULL) receives its status, timing and
+// resource usage.
+int execute_command(Command *cmd, StageStats *stats);
+
+// Executes a pipeline of commands and returns the exit status of the last
+// stage, or with 'set -o pipefail' that of the last stage that failed.
+// 'stats' (may be NULL) is an array of cmd_count per-stage results.
+int execute_pipeline(Command *commands, int cmd_count, StageStats *stats);
+
+// A time limit for execute_limited()
+typedef struct {
+    double seconds;     // Run time allowed (measured from the launch)
+    int signal;         // Signal sent to the process group when it expires
+    double kill_after;  // If > 0, SIGKILL follows this much later
+} ExecLimit;
+
+// Executes a pipeline in a process group of its own, which is sent
+// limit->signal if it is still running after limit->seconds. Returns the
+// pipeline's status, 124 if it timed out, or 137 if SIGKILL was needed.
+int execute_limited(Command *commands, int cmd_count, const ExecLimit *limit);
+
+// Executes a pipeline with every stage on the CPUs, at the priorities and
+// in the cgroup 'placement' names (the 'place' builtin). Returns the
+// pipeline's status.
+int execute_placed(Command *commands, int cmd_count, const SpawnPlacement *placement);
+
+// Launches a pipeline without waiting; stores each stage's pid (-1 if it did
+// not start) and returns the number of stages attempted. With 'pgid'
+// non-NULL and job control enabled, the stages get a process group of
+// their own, stored in *pgid (-1 otherwise). Under 'set -o spread' each
+// stage is pinned to the next of the shell's CPUs.
+int execute_background(Command *commands, int cmd_count, pid_t *pids, pid_t *pgid);
+
+// Converts a wait status into a shell exit status (128 + signal number for
+// a process killed or stopped by a signal)
+int exit_status(int wait_status);
 
-// Executes a pipeline of commands
-void execute_pipeline(Command *commands, int cmd_count);
+// Resizes a pipe's buffer (F_SETPIPE_SZ), clamped to the system limit.
+// Returns the capacity granted, or -1 on failure.
+long set_pipe_size(int fd, long size);
 
 #endif // EXECUTOR_H
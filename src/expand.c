@@ -0,0 +1,302 @@
+/*
+ * expand.c - Word Expansion
+ *
+ * This file expands the words the lexer flagged as containing '$'. It runs
+ * when a command is built from its tokens rather than when the line is
+ * lexed, so a line served from the parse cache still sees current values.
+ *
+ * Supported Expansions:
+ * - $?          exit status of the most recent pipeline
+ * - $NAME       value of a shell variable (vars.c), also written ${NAME};
+ *               empty if it is not set
+ * - $(command)  output of a command list, run by cmdsub.c
+ * - *, ?, [...] pathname expansion of unquoted wildcards (wildcard.c),
+ *               for words that become arguments
+ *
+ * Implementation Details:
+ * - A '$' not followed by a known expansion stays literal
+ * - EXPAND_ESCAPE marks bytes that were quoted in the input (e.g. '$?' in
+ *   single quotes); the escape is removed and the byte kept as is
+ * - The result is built in one arena buffer whose capacity doubles; a
+ *   substitution's output is read straight into it (its size is known up
+ *   front, so one read normally takes all of it), trailing newlines are
+ *   dropped and NUL bytes removed in place
+ * - Word splitting happens in the same buffer: in the output of a
+ *   substitution or the value of a variable marked with EXPAND_SPLIT
+ *   (unquoted in the input), blanks and newlines become NUL
+ *   bytes, and the words are the non-empty runs between them, so the
+ *   output is neither copied again nor lexed a second time
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "expand.h"
+#include "parser.h"
+#include "cmdsub.h"
+#include "vars.h"
+#include "wildcard.h"
+
+int last_status = 0;
+
+// An expansion being built in the arena
+typedef struct {
+    Arena *arena;
+    char *data;
+    size_t len;
+    size_t capacity;    // Bytes in data, including room for the NUL terminator
+    int split;          // Some output was split (NUL bytes separate words)
+    int fields;         // Building words for expand_fields(): literal wildcards keep their escape
+} Expansion;
+
+/*
+ * is_wildcard: Returns 1 for the bytes pathname expansion interprets.
+ */
+static int is_wildcard(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+/*
+ * reserve: Makes room for 'extra' more bytes (and the terminator),
+ * doubling the buffer as often as needed.
+ */
+static void reserve(Expansion *e, size_t extra) {
+    if (e->len + extra < e->capacity)
+        return;
+    size_t capacity = e->capacity;
+    while (e->len + extra >= capacity)
+        capacity *= 2;
+    char *grown = arena_alloc(e->arena, capacity);
+    memcpy(grown, e->data, e->len);
+    e->data = grown;
+    e->capacity = capacity;
+}
+
+/*
+ * needs_escape: Returns 1 if byte 'c' of an expansion must be escaped in
+ * a word for expand_fields(): escape bytes always, wildcards if quoted.
+ */
+static int needs_escape(const Expansion *e, char c, int split) {
+    return e->fields && (c == EXPAND_ESCAPE || (!split && is_wildcard(c)));
+}
+
+/*
+ * settle: Finishes 'n' bytes just copied to the end of e: NUL bytes are
+ * dropped and, with 'split', blanks and newlines become word separators.
+ * Bytes that must stay literal in a pattern get their escape, inserted
+ * from the end so the bytes move only once.
+ */
+static void settle(Expansion *e, size_t n, int split) {
+    char *out = e->data + e->len;
+    size_t kept = 0;
+    size_t escapes = 0;
+    for (size_t i = 0; i < n; i++) {
+        char c = out[i];
+        if (c == '\0')
+            continue;
+        if (split && (c == ' ' || c == '\t' || c == '\n'))
+            c = '\0';
+        out[kept++] = c;
+        escapes += needs_escape(e, c, split);
+    }
+
+    if (escapes > 0) {
+        size_t len = e->len;
+        e->len += kept;
+        reserve(e, escapes);
+        e->len = len;
+        out = e->data + e->len;
+        for (size_t i = kept, j = kept + escapes; i-- > 0;) {
+            out[--j] = out[i];
+            if (needs_escape(e, out[i], split))
+                out[--j] = EXPAND_ESCAPE;
+        }
+        kept += escapes;
+    }
+    e->len += kept;
+    e->split |= split;
+}
+
+/*
+ * append_value: Appends the value of a variable (nothing if it is unset).
+ */
+static void append_value(Expansion *e, const char *value, int split) {
+    size_t n = value ? strlen(value) : 0;
+    reserve(e, n);
+    memcpy(e->data + e->len, value ? value : "", n);
+    settle(e, n, split);
+}
+
+/*
+ * append_output:
+ *
+ * Runs command substitution 'text' and appends its output. With 'split',
+ * its blanks and newlines become word separators (NUL bytes).
+ *
+ * Returns:
+ *   0 on success, -1 if the command could not be run.
+ */
+static int append_output(Expansion *e, const char *text, int split) {
+    int fd = cmdsub_run(e->arena, text);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    reserve(e, size);
+
+    char *out = e->data + e->len;
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(fd, out + got, size - got, got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(fd);
+
+    while (got > 0 && out[got - 1] == '\n')
+        got--;
+    settle(e, got, split);
+    return 0;
+}
+
+/*
+ * expand: Expands a word into e (see expand_word()); 'split' enables word
+ * splitting of marked substitutions.
+ *
+ * Returns:
+ *   0 on success, -1 if a command substitution failed.
+ */
+static int expand(Expansion *e, const char *word, int split) {
+    size_t len = strlen(word);
+
+    // Every '$?' grows by at most a few bytes; substitutions grow the buffer
+    size_t expansions = 0;
+    for (const char *p = word; (p = strchr(p, '$')) != NULL; p++)
+        expansions++;
+    e->capacity = len + expansions * 16 + 1;
+    e->data = arena_alloc(e->arena, e->capacity);
+    e->len = 0;
+    e->split = 0;
+    e->fields = split;
+
+    const char *end = word + len;
+    for (const char *p = word; *p; p++) {
+        // 'd' is the '$' of an expansion, after its EXPAND_SPLIT marker
+        int marked = *p == EXPAND_SPLIT && p[1] == '$';
+        const char *d = p + marked;
+        int braced = *d == '$' && d[1] == '{';
+        const char *name = d + 1 + braced;
+        size_t name_len = *d == '$' ? vars_name_length(name) : 0;
+        if (braced && name[name_len] != '}')
+            name_len = 0;   // Not a ${NAME} form: kept literally
+
+        if (*p == EXPAND_ESCAPE && p[1] != '\0') {
+            reserve(e, 2);
+            if (needs_escape(e, p[1], 0))
+                e->data[e->len++] = EXPAND_ESCAPE;
+            e->data[e->len++] = *++p;
+        } else if (*p == '$' && p[1] == '?') {
+            reserve(e, 16);
+            e->len += snprintf(e->data + e->len, 16, "%d", last_status);
+            p++;
+        } else if (*d == '$' && d[1] == '(') {
+            const char *text = d + 2;
+            const char *close = substitution_end(text, end);
+            if (append_output(e, arena_strndup(e->arena, text, close - text),
+                              split && marked) < 0)
+                return -1;
+            p = close < end ? close : end - 1;
+        } else if (name_len > 0) {
+            append_value(e, vars_lookup(name, name_len), split && marked);
+            p = name + name_len + braced - 1;
+        } else {
+            reserve(e, 1);
+            e->data[e->len++] = *p;
+        }
+    }
+    e->data[e->len] = '\0';
+    return 0;
+}
+
+/*
+ * expand_word: Expands a word into the arena.
+ *
+ * Parameters:
+ *   arena - The per-line arena that owns the result.
+ *   word  - The lexed word, possibly containing escapes.
+ *
+ * Returns:
+ *   The expanded, NUL-terminated word, or NULL if a command substitution
+ *   failed.
+ */
+char *expand_word(Arena *arena, const char *word) {
+    Expansion e = { arena, NULL, 0, 0, 0, 0 };
+    return expand(&e, word, 0) == 0 ? e.data : NULL;
+}
+
+/*
+ * unescape: Removes the escapes of a word in place.
+ */
+static char *unescape(char *word) {
+    char *out = word;
+    for (const char *p = word; *p; p++) {
+        if (*p == EXPAND_ESCAPE && p[1] != '\0')
+            p++;
+        *out++ = *p;
+    }
+    *out = '\0';
+    return word;
+}
+
+/*
+ * expand_fields: Expands a word into the words it splits into, each
+ * subject to pathname expansion.
+ *
+ * The words point into the expansion buffer itself. Matched paths are
+ * added through an array whose capacity doubles.
+ */
+char **expand_fields(Arena *arena, const char *word, int *count) {
+    Expansion e = { arena, NULL, 0, 0, 0, 0 };
+    if (expand(&e, word, 1) < 0)
+        return NULL;
+
+    // Words are the non-empty runs between NUL bytes, if anything was split
+    int n = 0;
+    if (!e.split)
+        n = 1;
+    for (size_t i = 0; e.split && i < e.len; i++)
+        n += e.data[i] != '\0' && (i == 0 || e.data[i - 1] == '\0');
+    int capacity = n ? n : 1;
+    char **fields = arena_alloc(arena, capacity * sizeof(char *));
+    int total = 0;
+    size_t stop = e.split ? e.len : 1;
+    for (size_t i = 0; i < stop; i++) {
+        if (e.split && (e.data[i] == '\0' || (i > 0 && e.data[i - 1] != '\0')))
+            continue;
+        char *field = e.data + i;
+        int matched = 0;
+        char **paths = wildcard_active(field) ? wildcard_expand(arena, field, &matched) : NULL;
+        if (total + (matched ? matched : 1) > capacity) {
+            while (total + (matched ? matched : 1) > capacity)
+                capacity *= 2;
+            char **grown = arena_alloc(arena, capacity * sizeof(char *));
+            memcpy(grown, fields, total * sizeof(char *));
+            fields = grown;
+        }
+        if (paths) {
+            memcpy(fields + total, paths, matched * sizeof(char *));
+            total += matched;
+        } else {
+            // No match: the pattern stays as it was written
+            fields[total++] = unescape(field);
+        }
+    }
+    *count = total;
+    return fields;
+}
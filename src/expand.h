@@ -0,0 +1,29 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "arena.h"
+
+// Byte the lexer puts before a character that must stay literal (a '$'
+// inside single quotes, or one of these marker bytes itself)
+#define EXPAND_ESCAPE '\x01'
+
+// Byte the lexer puts before an unquoted '$(', whose output is split into
+// words by expand_fields()
+#define EXPAND_SPLIT '\x02'
+
+// Exit status of the most recent pipeline, expanded by '$?'
+extern int last_status;
+
+// Returns the expansion of a word flagged by the lexer: '$?' becomes the
+// last exit status, '$(command)' the command's output without trailing
+// newlines, and escaped bytes lose their escape. Other '$' are kept.
+// Returns NULL after printing an error if a command substitution failed.
+char *expand_word(Arena *arena, const char *word);
+
+// Expands a word like expand_word(), splitting the output of its unquoted
+// command substitutions at blanks and newlines. Returns an arena array of
+// *count words (none if an unquoted substitution produced only blanks and
+// nothing else is left), or NULL after printing an error.
+char **expand_fields(Arena *arena, const char *word, int *count);
+
+#endif // EXPAND_H
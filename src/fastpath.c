@@ -0,0 +1,412 @@
+/*
+ * fastpath.c - In-Process Data Movement Stages
+ *
+ * This file implements pipeline stages whose only job is moving bytes,
+ * such as 'cat file | ...' or '... | tee out.log | ...'. Instead of
+ * spawning the program, the executor hands the stage's fds to a helper
+ * thread in the shell, which moves the data inside the kernel.
+ *
+ * Key Components:
+ *
+ * 1. Recognition:
+ *    - 'cat' with file operands (or '-' for stdin) and no options
+ *    - 'tee' with file operands and optionally '-a'
+ *
+ * 2. Data Movement:
+ *    - splice() between a pipe and any fd
+ *    - tee() + splice() to feed the next stage and one file in parallel
+ *    - copy_file_range() between regular files
+ *    - read()/write() fallback when the kernel refuses the fd pair
+ *
+ * 3. Threads:
+ *    - One helper thread per stage, started with SIGPIPE blocked so a
+ *      closed reader ends the stage with EPIPE instead of killing the shell
+ *    - The thread owns duplicates of its fds and closes them when done,
+ *      so downstream stages see EOF exactly as with a real process
+ *
+ * Error Handling:
+ * - Diagnostics use the program's own format ("cat: file: reason") on the
+ *   stage's stderr; a broken pipe ends the stage quietly
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "fastpath.h"
+
+#define SPLICE_CHUNK (1 << 20)      // Upper bound per splice/tee call
+#define COPY_BUFFER_SIZE 65536      // read()/write() fallback buffer
+
+typedef enum {
+    FAST_CAT,
+    FAST_TEE
+} FastPathKind;
+
+struct FastPathStage {
+    pthread_t thread;
+    FastPathKind kind;
+    char **args;    // argv of the stage (owned by the caller)
+    int append;     // tee -a
+    int in_fd;      // Duplicated fds owned by the stage
+    int out_fd;
+    int err_fd;
+    int status;     // Exit status once the thread has finished
+    struct timespec end;    // CLOCK_MONOTONIC time the stage finished
+    struct rusage usage;    // CPU usage of the helper thread
+};
+
+/*
+ * fastpath_supported: Checks whether a command is a plain cat or tee.
+ *
+ * Any option other than 'tee -a' sends the command down the normal spawn
+ * path, so behaviour never differs from the real program.
+ */
+int fastpath_supported(const Command *cmd) {
+    char **args = cmd->args;
+    int first = 1;
+
+    if (strcmp(args[0], "cat") == 0) {
+        for (int i = first; args[i] != NULL; i++) {
+            if (args[i][0] == '-' && args[i][1] != '\0')
+                return 0;
+        }
+        return 1;
+    }
+
+    if (strcmp(args[0], "tee") == 0) {
+        if (args[1] != NULL && strcmp(args[1], "-a") == 0)
+            first = 2;
+        for (int i = first; args[i] != NULL; i++) {
+            if (args[i][0] == '-')
+                return 0;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * stage_error: Prints "<program>: <what>: <reason>" on the stage's stderr.
+ */
+static void stage_error(const FastPathStage *stage, const char *what, int err) {
+    dprintf(stage->err_fd, "%s: %s: %s\n", stage->args[0], what, strerror(err));
+}
+
+/*
+ * write_all: Writes the whole buffer, retrying short writes.
+ *
+ * Returns:
+ *   0 on success, or an errno value.
+ */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * copy_read_write: Copies 'in' to every fd in 'outs' through a user buffer.
+ *
+ * Returns:
+ *   0 at end of input, or the errno value of the first failure.
+ */
+static int copy_read_write(int in, const int *outs, int out_count) {
+    char buf[COPY_BUFFER_SIZE];
+    while (1) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (n == 0)
+            return 0;
+        for (int i = 0; i < out_count; i++) {
+            int err = write_all(outs[i], buf, n);
+            if (err != 0)
+                return err;
+        }
+    }
+}
+
+/*
+ * fastpath_copy: Moves all data from 'in' to 'out' without userspace copies
+ * when the kernel supports the fd pair.
+ *
+ * splice() is used when either side is a pipe and copy_file_range() when
+ * both are regular files. If the first call is refused, the copy falls
+ * back to read()/write().
+ *
+ * Returns:
+ *   0 at end of input, or an errno value.
+ */
+int fastpath_copy(int in, int out) {
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) < 0 || fstat(out, &out_st) < 0)
+        return errno;
+
+    int use_splice = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+    int use_copy_range = S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode);
+
+    if (use_splice || use_copy_range) {
+        int moved_any = 0;
+        while (1) {
+            ssize_t n;
+            if (use_splice)
+                n = splice(in, NULL, out, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            else
+                n = copy_file_range(in, NULL, out, NULL, SPLICE_CHUNK, 0);
+            if (n > 0) {
+                moved_any = 1;
+                continue;
+            }
+            if (n == 0)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            if (moved_any || (errno != EINVAL && errno != EXDEV &&
+                              errno != ENOSYS && errno != EBADF))
+                return errno;
+            break;  // Unsupported fd pair: fall back
+        }
+    }
+
+    return copy_read_write(in, &out, 1);
+}
+
+/*
+ * tee_fd: Copies the stage's stdin to its stdout and to 'files'.
+ *
+ * When input and output are pipes, tee() duplicates each chunk into the
+ * output pipe and splice() then consumes the same bytes into the file.
+ * Other combinations (or several files, or append mode, which splice()
+ * rejects) use read()/write().
+ *
+ * Returns:
+ *   0 at end of input, or an errno value.
+ */
+static int tee_fd(FastPathStage *stage, const int *files, int file_count) {
+    struct stat in_st, out_st;
+    if (fstat(stage->in_fd, &in_st) < 0 || fstat(stage->out_fd, &out_st) < 0)
+        return errno;
+
+    if (file_count == 0)
+        return fastpath_copy(stage->in_fd, stage->out_fd);
+
+    if (file_count == 1 && !stage->append &&
+        S_ISFIFO(in_st.st_mode) && S_ISFIFO(out_st.st_mode)) {
+        int moved_any = 0;
+        while (1) {
+            ssize_t n = tee(stage->in_fd, stage->out_fd, SPLICE_CHUNK, 0);
+            if (n == 0)
+                return 0;
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (moved_any || errno != EINVAL)
+                    return errno;
+                break;  // Unsupported: fall back
+            }
+            moved_any = 1;
+
+            // Consume exactly the duplicated bytes into the file
+            while (n > 0) {
+                ssize_t m = splice(stage->in_fd, NULL, files[0], NULL, n, SPLICE_F_MOVE);
+                if (m < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return errno;
+                }
+                n -= m;
+            }
+        }
+    }
+
+    int outs[file_count + 1];
+    outs[0] = stage->out_fd;
+    memcpy(&outs[1], files, file_count * sizeof(int));
+    return copy_read_write(stage->in_fd, outs, file_count + 1);
+}
+
+/*
+ * run_cat: Thread body of a 'cat' stage.
+ */
+static void run_cat(FastPathStage *stage) {
+    if (stage->args[1] == NULL) {
+        int err = fastpath_copy(stage->in_fd, stage->out_fd);
+        if (err == EPIPE)
+            stage->status = 128 + SIGPIPE;
+        else if (err != 0) {
+            stage_error(stage, "write error", err);
+            stage->status = 1;
+        }
+        return;
+    }
+
+    for (int i = 1; stage->args[i] != NULL; i++) {
+        const char *name = stage->args[i];
+        int fd = stage->in_fd;
+        if (strcmp(name, "-") != 0) {
+            fd = open(name, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                stage_error(stage, name, errno);
+                stage->status = 1;
+                continue;
+            }
+        }
+
+        int err = fastpath_copy(fd, stage->out_fd);
+        if (fd != stage->in_fd)
+            close(fd);
+        if (err == EPIPE) {
+            stage->status = 128 + SIGPIPE;
+            return;
+        }
+        if (err != 0) {
+            stage_error(stage, name, err);
+            stage->status = 1;
+        }
+    }
+}
+
+/*
+ * run_tee: Thread body of a 'tee' stage.
+ */
+static void run_tee(FastPathStage *stage) {
+    int first = stage->append ? 2 : 1;
+    int file_count = 0;
+    while (stage->args[first + file_count] != NULL)
+        file_count++;
+
+    int files[file_count > 0 ? file_count : 1];
+    int opened = 0;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (stage->append ? O_APPEND : O_TRUNC);
+    for (int i = 0; i < file_count; i++) {
+        const char *name = stage->args[first + i];
+        int fd = open(name, flags, 0644);
+        if (fd < 0) {
+            stage_error(stage, name, errno);
+            stage->status = 1;
+            continue;
+        }
+        files[opened++] = fd;
+    }
+
+    int err = tee_fd(stage, files, opened);
+    if (err == EPIPE)
+        stage->status = 128 + SIGPIPE;
+    else if (err != 0) {
+        stage_error(stage, "write error", err);
+        stage->status = 1;
+    }
+
+    for (int i = 0; i < opened; i++)
+        close(files[i]);
+}
+
+/*
+ * stage_thread: Runs the stage, then closes its fds so EOF propagates.
+ */
+static void *stage_thread(void *arg) {
+    FastPathStage *stage = arg;
+
+    if (stage->kind == FAST_CAT)
+        run_cat(stage);
+    else
+        run_tee(stage);
+
+    close(stage->in_fd);
+    close(stage->out_fd);
+    close(stage->err_fd);
+    getrusage(RUSAGE_THREAD, &stage->usage);
+    clock_gettime(CLOCK_MONOTONIC, &stage->end);
+    return NULL;
+}
+
+/*
+ * discard_stage: Releases a stage whose thread was never started.
+ */
+static void discard_stage(FastPathStage *stage) {
+    if (stage->in_fd >= 0) close(stage->in_fd);
+    if (stage->out_fd >= 0) close(stage->out_fd);
+    if (stage->err_fd >= 0) close(stage->err_fd);
+    free(stage);
+}
+
+/*
+ * fastpath_start: Starts a recognized stage in a helper thread.
+ *
+ * Parameters:
+ *   cmd    - The command (must stay valid until fastpath_wait()).
+ *   in_fd  - The stage's stdin (pipe, redirection or the shell's stdin).
+ *   out_fd - The stage's stdout.
+ *   err_fd - The stage's stderr.
+ *
+ * Returns:
+ *   The running stage, or NULL if it could not be started (the caller
+ *   should then spawn the real program).
+ */
+FastPathStage *fastpath_start(const Command *cmd, int in_fd, int out_fd, int err_fd) {
+    FastPathStage *stage = malloc(sizeof(FastPathStage));
+    if (!stage) {
+        return NULL;
+    }
+
+    stage->kind = strcmp(cmd->args[0], "cat") == 0 ? FAST_CAT : FAST_TEE;
+    stage->args = cmd->args;
+    stage->append = stage->kind == FAST_TEE && cmd->args[1] != NULL &&
+                    strcmp(cmd->args[1], "-a") == 0;
+    stage->status = 0;
+    stage->in_fd = fcntl(in_fd, F_DUPFD_CLOEXEC, 0);
+    stage->out_fd = fcntl(out_fd, F_DUPFD_CLOEXEC, 0);
+    stage->err_fd = fcntl(err_fd, F_DUPFD_CLOEXEC, 0);
+    if (stage->in_fd < 0 || stage->out_fd < 0 || stage->err_fd < 0) {
+        discard_stage(stage);
+        return NULL;
+    }
+
+    // The thread inherits a mask with SIGPIPE blocked
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int err = pthread_create(&stage->thread, NULL, stage_thread, stage);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        discard_stage(stage);
+        return NULL;
+    }
+    return stage;
+}
+
+/*
+ * fastpath_wait: Joins the helper thread and returns the stage's status.
+ */
+int fastpath_wait(FastPathStage *stage, StageStats *stats) {
+    pthread_join(stage->thread, NULL);
+    int status = stage->status;
+    if (stats) {
+        stats->status = status << 8;
+        stats->end = stage->end;
+        stats->usage = stage->usage;
+    }
+    free(stage);
+    return status;
+}
@@ -0,0 +1,27 @@
+#ifndef FASTPATH_H
+#define FASTPATH_H
+
+#include "executor.h"
+
+// A pipeline stage running in a helper thread of the shell
+typedef struct FastPathStage FastPathStage;
+
+// Returns 1 if 'cmd' only moves bytes (plain 'cat' or 'tee') and can run
+// in-process without spawning a program, 0 otherwise
+int fastpath_supported(const Command *cmd);
+
+// Starts 'cmd' in a helper thread reading 'in_fd' and writing 'out_fd',
+// with diagnostics on 'err_fd'. The fds are duplicated, so the caller keeps
+// ownership of its own copies. 'cmd' must stay valid until fastpath_wait().
+// Returns NULL if the thread could not be started.
+FastPathStage *fastpath_start(const Command *cmd, int in_fd, int out_fd, int err_fd);
+
+// Waits for the stage to finish, releases it and returns its exit status.
+// 'stats' (may be NULL) receives the status, end time and the thread's usage.
+int fastpath_wait(FastPathStage *stage, StageStats *stats);
+
+// Copies everything from 'in' to 'out' using splice()/copy_file_range() when
+// the fd pair allows it. Returns 0 at end of input, or an errno value.
+int fastpath_copy(int in, int out);
+
+#endif // FASTPATH_H
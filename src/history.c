@@ -0,0 +1,384 @@
+/*
+ * history.c - Persistent Command History
+ *
+ * This file keeps the history of interactive command lines on disk in two
+ * append-only files, both memory-mapped at startup so loading costs the
+ * same regardless of how long the history is:
+ *
+ *   ~/.myshell_history      the lines, each terminated by '\n'
+ *   ~/.myshell_history.idx  an 8-byte header followed by one 64-bit offset
+ *                           per line, giving where the line starts in the log
+ *
+ * Key Components:
+ *
+ * 1. Loading:
+ *    - Both files are mapped, never read; entry i spans from offset i to
+ *      offset i+1 (minus its newline), so lookups are O(1)
+ *    - An index that is behind the log (e.g. after a crash between the two
+ *      appends) is completed by scanning only the unindexed tail; an index
+ *      that is corrupt or belongs to another log is rebuilt
+ *
+ * 2. Appending:
+ *    - A line is appended to the log and its offset to the index under an
+ *      exclusive flock(), so concurrent shells keep the files consistent
+ *    - The mappings are refreshed lazily when an entry past them is needed
+ *
+ * 3. Builtin:
+ *    - history [N]            list all (or the last N) entries
+ *    - history -p PREFIX      list entries starting with PREFIX
+ *    - history -s TEXT        list entries containing TEXT
+ *    - history -c             clear the history
+ *
+ * Implementation Details:
+ * - Only interactive lines are recorded (see main() in myshell.c)
+ * - $MYSHELL_HISTFILE overrides the log path; the index is "<log>.idx"
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "history.h"
+
+#define INDEX_MAGIC "MSHIDX1\n"
+#define INDEX_HEADER 8
+
+static int log_fd = -1;
+static int idx_fd = -1;
+static char *log_map = NULL;        // Mapping of the log (log_mapped bytes)
+static size_t log_mapped = 0;
+static char *idx_map = NULL;        // Mapping of the index (idx_mapped bytes)
+static size_t idx_mapped = 0;
+static size_t log_size = 0;         // Bytes of the log covered by the index
+static size_t entries = 0;          // Indexed lines
+
+static void unmap_files(void) {
+    if (log_map)
+        munmap(log_map, log_mapped);
+    if (idx_map)
+        munmap(idx_map, idx_mapped);
+    log_map = idx_map = NULL;
+    log_mapped = idx_mapped = 0;
+}
+
+/*
+ * map_files: Maps both files at their current sizes.
+ *
+ * Returns:
+ *   0 on success, -1 on failure (history is then unavailable).
+ */
+static int map_files(void) {
+    struct stat log_st, idx_st;
+    unmap_files();
+    if (fstat(log_fd, &log_st) < 0 || fstat(idx_fd, &idx_st) < 0)
+        return -1;
+    if (log_st.st_size > 0) {
+        log_map = mmap(NULL, log_st.st_size, PROT_READ, MAP_SHARED, log_fd, 0);
+        if (log_map == MAP_FAILED) {
+            log_map = NULL;
+            return -1;
+        }
+        log_mapped = log_st.st_size;
+    }
+    if (idx_st.st_size > 0) {
+        idx_map = mmap(NULL, idx_st.st_size, PROT_READ, MAP_SHARED, idx_fd, 0);
+        if (idx_map == MAP_FAILED) {
+            idx_map = NULL;
+            return -1;
+        }
+        idx_mapped = idx_st.st_size;
+    }
+    return 0;
+}
+
+static uint64_t entry_offset(size_t index) {
+    uint64_t offset;
+    memcpy(&offset, idx_map + INDEX_HEADER + index * sizeof(uint64_t), sizeof(offset));
+    return offset;
+}
+
+/*
+ * append_index: Appends offsets (and the header, for an empty index).
+ */
+static int append_index(const uint64_t *offsets, size_t count) {
+    struct stat st;
+    if (fstat(idx_fd, &st) < 0)
+        return -1;
+    if (st.st_size == 0 && write(idx_fd, INDEX_MAGIC, INDEX_HEADER) != INDEX_HEADER)
+        return -1;
+    ssize_t size = count * sizeof(uint64_t);
+    return write(idx_fd, offsets, size) == size ? 0 : -1;
+}
+
+/*
+ * index_range: Indexes the lines of log bytes [start, end).
+ */
+static int index_range(size_t start, size_t end) {
+    size_t capacity = 256, count = 0;
+    uint64_t *offsets = malloc(capacity * sizeof(uint64_t));
+    if (!offsets)
+        return -1;
+
+    size_t pos = start;
+    while (pos < end) {
+        if (count == capacity) {
+            uint64_t *grown = realloc(offsets, 2 * capacity * sizeof(uint64_t));
+            if (!grown) {
+                free(offsets);
+                return -1;
+            }
+            offsets = grown;
+            capacity *= 2;
+        }
+        offsets[count++] = pos;
+        const char *nl = memchr(log_map + pos, '\n', end - pos);
+        pos = nl ? (size_t)(nl - log_map) + 1 : end;
+    }
+
+    int result = count ? append_index(offsets, count) : 0;
+    free(offsets);
+    return result;
+}
+
+/*
+ * load_index: Validates the mapped index against the log, completing or
+ * rebuilding it if needed, and sets 'entries' and 'log_size'.
+ */
+static int load_index(void) {
+    size_t count = idx_mapped >= INDEX_HEADER ? (idx_mapped - INDEX_HEADER) / sizeof(uint64_t) : 0;
+    int valid = idx_mapped == 0 ||
+                (idx_mapped >= INDEX_HEADER && memcmp(idx_map, INDEX_MAGIC, INDEX_HEADER) == 0);
+    if (valid && count > 0)
+        valid = entry_offset(0) == 0 && entry_offset(count - 1) < log_mapped;
+
+    size_t indexed_end = 0;
+    if (!valid) {
+        // Rebuild from scratch
+        count = 0;
+        if (ftruncate(idx_fd, 0) < 0)
+            return -1;
+    } else if (count > 0) {
+        uint64_t last = entry_offset(count - 1);
+        const char *nl = memchr(log_map + last, '\n', log_mapped - last);
+        indexed_end = nl ? (size_t)(nl - log_map) + 1 : log_mapped;
+    }
+
+    if (indexed_end < log_mapped) {
+        if (index_range(indexed_end, log_mapped) < 0 || map_files() < 0)
+            return -1;
+        count = (idx_mapped - INDEX_HEADER) / sizeof(uint64_t);
+    }
+    entries = count;
+    log_size = log_mapped;
+    return 0;
+}
+
+static char *history_path(const char *suffix) {
+    const char *base = getenv("MYSHELL_HISTFILE");
+    const char *home = getenv("HOME");
+    char *path;
+    int n;
+    if (base && *base)
+        n = asprintf(&path, "%s%s", base, suffix);
+    else if (home && *home)
+        n = asprintf(&path, "%s/.myshell_history%s", home, suffix);
+    else
+        return NULL;
+    return n < 0 ? NULL : path;
+}
+
+static void disable_history(void) {
+    unmap_files();
+    if (log_fd >= 0)
+        close(log_fd);
+    if (idx_fd >= 0)
+        close(idx_fd);
+    log_fd = idx_fd = -1;
+    entries = log_size = 0;
+}
+
+void history_init(void) {
+    char *log_path = history_path("");
+    char *idx_path = history_path(".idx");
+    if (log_path && idx_path) {
+        log_fd = open(log_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        idx_fd = open(idx_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    }
+    free(log_path);
+    free(idx_path);
+    if (log_fd < 0 || idx_fd < 0) {
+        disable_history();
+        return;
+    }
+
+    flock(log_fd, LOCK_EX);
+    int ok = map_files() == 0 && load_index() == 0;
+    flock(log_fd, LOCK_UN);
+    if (!ok)
+        disable_history();
+}
+
+/*
+ * refresh: Makes sure entry 'index' is covered by the mappings.
+ */
+static int refresh(size_t index) {
+    if (log_fd < 0)
+        return -1;
+    if (index < entries && INDEX_HEADER + (index + 1) * sizeof(uint64_t) <= idx_mapped &&
+        log_size <= log_mapped)
+        return 0;
+    if (map_files() < 0) {
+        disable_history();
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * history_add: Appends a line to the log and its offset to the index.
+ *
+ * Lines written meanwhile by other shells are indexed first, so the
+ * offset always matches the end of the log.
+ */
+void history_add(const char *line) {
+    if (log_fd < 0 || line[0] == '\0')
+        return;
+
+    flock(log_fd, LOCK_EX);
+    struct stat st;
+    if (fstat(log_fd, &st) == 0) {
+        if ((size_t)st.st_size != log_size) {
+            // Another shell appended: pick up its lines
+            if (map_files() == 0)
+                load_index();
+        }
+
+        size_t len = strlen(line);
+        char *record = malloc(len + 1);
+        if (record) {
+            memcpy(record, line, len);
+            record[len] = '\n';
+            uint64_t offset = log_size;
+            if (write(log_fd, record, len + 1) == (ssize_t)(len + 1) &&
+                append_index(&offset, 1) == 0) {
+                log_size += len + 1;
+                entries++;
+            }
+            free(record);
+        }
+    }
+    flock(log_fd, LOCK_UN);
+}
+
+size_t history_count(void) {
+    return entries;
+}
+
+const char *history_get(size_t index, size_t *len) {
+    if (index >= entries || refresh(index) < 0)
+        return NULL;
+    uint64_t start = entry_offset(index);
+    uint64_t end = index + 1 < entries ? entry_offset(index + 1) : log_size;
+    if (end > start && log_map[end - 1] == '\n')
+        end--;
+    *len = end - start;
+    return log_map + start;
+}
+
+long history_search(const char *text, size_t before, int anywhere) {
+    size_t text_len = strlen(text);
+    if (before > entries)
+        before = entries;
+    for (size_t i = before; i-- > 0;) {
+        size_t len;
+        const char *entry = history_get(i, &len);
+        if (entry == NULL)
+            return -1;
+        if (!anywhere) {
+            if (len >= text_len && memcmp(entry, text, text_len) == 0)
+                return (long)i;
+        } else if (text_len == 0 || memmem(entry, len, text, text_len) != NULL) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+static void print_entry(size_t index) {
+    size_t len;
+    const char *entry = history_get(index, &len);
+    if (entry)
+        printf("%5zu  %.*s\n", index + 1, (int)len, entry);
+}
+
+/*
+ * history_builtin: Implements 'history'.
+ */
+int history_builtin(char **args) {
+    if (log_fd < 0) {
+        fprintf(stderr, "myshell: history: history file unavailable\n");
+        return 1;
+    }
+
+    if (args[1] != NULL && strcmp(args[1], "-c") == 0) {
+        flock(log_fd, LOCK_EX);
+        int err = ftruncate(log_fd, 0) < 0 || ftruncate(idx_fd, 0) < 0;
+        entries = log_size = 0;
+        map_files();
+        flock(log_fd, LOCK_UN);
+        if (err) {
+            fprintf(stderr, "myshell: history: %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (args[1] != NULL && (strcmp(args[1], "-p") == 0 || strcmp(args[1], "-s") == 0)) {
+        if (args[2] == NULL) {
+            fprintf(stderr, "myshell: history: %s: argument expected\n", args[1]);
+            return 2;
+        }
+        // Collect matches newest first, print them oldest first
+        int anywhere = args[1][1] == 's';
+        size_t capacity = 64, count = 0;
+        size_t *matches = malloc(capacity * sizeof(size_t));
+        long i = history_search(args[2], entries, anywhere);
+        while (matches && i >= 0) {
+            if (count == capacity) {
+                size_t *grown = realloc(matches, 2 * capacity * sizeof(size_t));
+                if (!grown)
+                    break;
+                matches = grown;
+                capacity *= 2;
+            }
+            matches[count++] = (size_t)i;
+            i = history_search(args[2], (size_t)i, anywhere);
+        }
+        while (matches && count > 0)
+            print_entry(matches[--count]);
+        free(matches);
+        return 0;
+    }
+
+    size_t first = 0;
+    if (args[1] != NULL) {
+        char *end;
+        long n = strtol(args[1], &end, 10);
+        if (*args[1] == '\0' || *end != '\0' || n < 0) {
+            fprintf(stderr, "myshell: history: %s: numeric argument required\n", args[1]);
+            return 2;
+        }
+        if ((size_t)n < entries)
+            first = entries - n;
+    }
+    for (size_t i = first; i < entries; i++)
+        print_entry(i);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+// Maps the history log and its offset index (~/.myshell_history and
+// ~/.myshell_history.idx, or $MYSHELL_HISTFILE); history is disabled if
+// they cannot be opened
+void history_init(void);
+
+// Appends a command line to the history
+void history_add(const char *line);
+
+// Number of entries in the history
+size_t history_count(void);
+
+// Returns entry 'index' (0 = oldest) and stores its length in *len.
+// The text is not NUL-terminated and stays valid until the next history call.
+const char *history_get(size_t index, size_t *len);
+
+// Searches backwards from entry 'before' - 1 for an entry starting with
+// (or, if 'anywhere' is set, containing) 'text'. Returns its index or -1.
+long history_search(const char *text, size_t before, int anywhere);
+
+// Implements the 'history' builtin
+int history_builtin(char **args);
+
+#endif // HISTORY_H
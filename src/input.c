@@ -0,0 +1,193 @@
+/*
+ * input.c - Command Line Input
+ *
+ * This file supplies the shell's command lines, one at a time and without
+ * a length limit, from either a script file or a file descriptor such as
+ * the terminal or a pipe.
+ *
+ * Key Components:
+ * - Script files: regular files are mapped privately with mmap() and lines
+ *   are handed out in place; the newline is overwritten with NUL, which only
+ *   touches the shell's copy-on-write view of the page
+ * - Descriptors: data is read in large blocks into a buffer that grows for
+ *   long lines; lines are split in place and only an incomplete trailing
+ *   line is moved to the front before the next read
+ *
+ * Implementation Details:
+ * - A terminal returns one line per read(), so interactive use is not delayed
+ * - An unterminated last line of a mapping is copied, since there may be
+ *   no byte after it to hold the terminator
+ * - Script fds are opened with O_CLOEXEC so commands do not inherit them
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+#define INPUT_BLOCK_SIZE 65536
+
+static void input_init(InputSource *in, int fd) {
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+}
+
+void input_open_fd(InputSource *in, int fd) {
+    input_init(in, fd);
+}
+
+/*
+ * input_open_file: Opens a script for reading.
+ *
+ * Regular, non-empty files are mapped; anything else (FIFOs, devices) is
+ * read in blocks like a descriptor.
+ */
+int input_open_file(InputSource *in, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    input_init(in, fd);
+    in->owns_fd = 1;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            in->eof = 1;
+            return 0;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            in->map = map;
+            in->map_len = st.st_size;
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+        }
+    }
+    return 0;
+}
+
+/*
+ * next_mapped_line: Returns the next line of a mapped script.
+ */
+static char *next_mapped_line(InputSource *in) {
+    if (in->start >= in->map_len) {
+        return NULL;
+    }
+
+    char *line = in->map + in->start;
+    size_t avail = in->map_len - in->start;
+    char *nl = memchr(line, '\n', avail);
+    if (nl != NULL) {
+        *nl = '\0';
+        in->start += nl - line + 1;
+        return line;
+    }
+
+    // Last line without a newline
+    in->start = in->map_len;
+    free(in->tail);
+    in->tail = malloc(avail + 1);
+    if (!in->tail) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(in->tail, line, avail);
+    in->tail[avail] = '\0';
+    return in->tail;
+}
+
+/*
+ * fill_buffer: Makes room in the block buffer and reads more data.
+ *
+ * Returns the number of bytes read, 0 at end of file or -1 on error.
+ */
+static ssize_t fill_buffer(InputSource *in) {
+    if (in->start > 0) {
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+    }
+    if (in->cap - in->end < INPUT_BLOCK_SIZE / 2) {
+        size_t cap = in->cap ? in->cap * 2 : INPUT_BLOCK_SIZE;
+        char *buf = realloc(in->buf, cap);
+        if (!buf) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        in->buf = buf;
+        in->cap = cap;
+    }
+
+    ssize_t n;
+    do {
+        // Keep one byte free for the terminator of an unterminated last line
+        n = read(in->fd, in->buf + in->end, in->cap - in->end - 1);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        in->end += n;
+    }
+    return n;
+}
+
+/*
+ * input_next_line: Returns the next command line.
+ *
+ * The returned line points into the mapping or the block buffer and is
+ * overwritten by later calls.
+ */
+char *input_next_line(InputSource *in) {
+    if (in->map) {
+        return next_mapped_line(in);
+    }
+    if (in->fd < 0) {
+        return NULL;
+    }
+
+    size_t scanned = 0;
+    while (1) {
+        char *line = in->buf + in->start;
+        size_t avail = in->end - in->start;
+        char *nl = avail > scanned ? memchr(line + scanned, '\n', avail - scanned) : NULL;
+        if (nl != NULL) {
+            *nl = '\0';
+            in->start += nl - line + 1;
+            return line;
+        }
+        if (in->eof) {
+            if (avail == 0) {
+                return NULL;
+            }
+            // Last line without a newline; fill_buffer() left room for the NUL
+            line[avail] = '\0';
+            in->start = in->end;
+            return line;
+        }
+
+        scanned = avail;
+        ssize_t n = fill_buffer(in);
+        if (n < 0) {
+            perror("myshell: read");
+            in->eof = 1;
+        } else if (n == 0) {
+            in->eof = 1;
+        }
+    }
+}
+
+void input_close(InputSource *in) {
+    if (in->map) {
+        munmap(in->map, in->map_len);
+    }
+    if (in->owns_fd) {
+        close(in->fd);
+    }
+    free(in->buf);
+    free(in->tail);
+    input_init(in, -1);
+}
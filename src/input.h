@@ -0,0 +1,34 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+// A source of command lines: an mmap'd script file or a block-read fd
+typedef struct {
+    int fd;             // Descriptor being read (-1 once closed)
+    int owns_fd;        // fd was opened by input_open_file()
+    char *map;          // Private writable mapping of a regular script file
+    size_t map_len;
+    char *buf;          // Block buffer for pipes, terminals and other fds
+    size_t cap;
+    size_t start;       // First unconsumed byte (mapping or buffer)
+    size_t end;         // End of valid data in the buffer
+    char *tail;         // Copy of an unterminated last line of a mapping
+    int eof;            // The fd has reported end of file
+} InputSource;
+
+// Opens the script at 'path', mapping it if it is a regular file.
+// Returns 0 on success or -1 with errno set.
+int input_open_file(InputSource *in, const char *path);
+
+// Reads lines from an already open fd (not closed by input_close())
+void input_open_fd(InputSource *in, int fd);
+
+// Returns the next line without its newline, NUL-terminated, or NULL at end
+// of input. The line stays valid until the next call. Lines have no length limit.
+char *input_next_line(InputSource *in);
+
+// Releases the mapping and buffers (and the fd if opened by input_open_file())
+void input_close(InputSource *in);
+
+#endif // INPUT_H
@@ -0,0 +1,634 @@
+/*
+ * jobs.c - Background Jobs
+ *
+ * This file implements the job table behind '&' and the job control
+ * builtins. A background pipeline is launched without waiting and recorded
+ * here; its children are collected whenever they change state, in whatever
+ * order they finish, while the shell keeps reading commands.
+ *
+ * Key Components:
+ *
+ * 1. Job Table:
+ *    - One slot per job, numbered from 1; the lowest free number is reused
+ *    - Each job keeps the pid and stopped flag of every stage and the
+ *      wait status of its last stage
+ *
+ * 2. Reaper:
+ *    - SIGCHLD is blocked and read from a signalfd, so no handler runs and
+ *      the shell only calls waitpid() when a child actually changed state
+ *    - Only the jobs' own pids are waited for, so a reap can never take a
+ *      foreground stage from the executor; the executor watches the same
+ *      signalfd and calls jobs_poll() when it fires
+ *
+ * 3. Job Control:
+ *    - Enabled for an interactive shell that owns its terminal; the shell
+ *      ignores SIGINT, SIGQUIT, SIGTSTP, SIGTTIN and SIGTTOU
+ *    - Every job is a process group; the foreground one gets the terminal,
+ *      so Ctrl-C and Ctrl-Z reach the job and not the shell
+ *    - A stopped foreground pipeline becomes a stopped job
+ *
+ * 4. Builtins:
+ *    - jobs            - list jobs and forget those that have finished
+ *    - wait [%N|pid]   - wait for one job or process, or for all jobs
+ *    - fg [%N]         - continue a job if stopped and wait for it
+ *    - bg [%N]         - continue a stopped job in the background
+ *
+ * An interactive shell prints '[N] pid' when it starts a job and reports
+ * finished jobs before the next prompt. Scripts and server sessions do
+ * neither: a finished job is dropped from the table as soon as it is
+ * reaped, and its final statuses go to a small ring of recent results,
+ * so 'wait %N' and 'wait pid' still return them.
+ *
+ * Implementation Details:
+ * - Children are spawned with an empty signal mask (see spawn.c), so the
+ *   blocked SIGCHLD is not inherited
+ * - Without job control (scripts, piped input) children stay in the
+ *   shell's process group; job stdin defaults to /dev/null (see
+ *   run_pipeline() in myshell.c)
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "executor.h"
+
+// One stage of a job
+typedef struct {
+    pid_t pid;      // -1 once reaped
+    pid_t started;  // Its pid, kept after the reap
+    int stopped;
+    int status;     // Wait status once reaped
+} JobProcess;
+
+typedef struct {
+    int id;                 // Job number (0 for a free slot)
+    JobProcess *procs;
+    int count;
+    int running;            // Stages not yet reaped
+    pid_t last_pid;         // Pid of the last stage, whose status is the job's
+    pid_t pgid;             // Process group (-1 without job control)
+    int status;             // Wait status of the last stage
+    char *command;
+} Job;
+
+static Job *jobs = NULL;
+static int job_slots = 0;
+static int child_fd = -1;   // signalfd receiving SIGCHLD
+static pid_t shell_pid = -1;    // Process that owns job control
+static pid_t shell_pgid = -1;   // Its process group (-1 without job control)
+static int announce = 0;        // Print '[N] pid' for new jobs (interactive shells)
+
+// Final statuses of jobs dropped without being reported
+#define FINISHED_MAX 64
+typedef struct {
+    int id;             // Job number (0: empty entry)
+    pid_t pid;          // One stage
+    int status;         // Its wait status
+    int job_status;     // The job's wait status (its last stage)
+} FinishedProc;
+
+static FinishedProc finished[FINISHED_MAX];
+static int finished_next = 0;   // Ring position of the next entry
+
+void jobs_init(int interactive) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == 0) {
+        child_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+    announce = interactive;
+
+    // Job control needs a terminal whose foreground group is the shell's
+    if (!interactive || !isatty(STDIN_FILENO) || tcgetpgrp(STDIN_FILENO) != getpgrp())
+        return;
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    shell_pid = getpid();
+    shell_pgid = getpgrp();
+}
+
+int jobs_job_control(void) {
+    return shell_pgid != -1 && getpid() == shell_pid;
+}
+
+void jobs_give_terminal(pid_t pgid) {
+    if (jobs_job_control() && pgid > 0)
+        tcsetpgrp(STDIN_FILENO, pgid);
+}
+
+void jobs_take_terminal(void) {
+    if (jobs_job_control())
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+}
+
+int jobs_signal_fd(void) {
+    // A builtin subshell runs with SIGCHLD unblocked, so it is never queued
+    sigset_t mask;
+    if (child_fd == -1 || sigprocmask(SIG_BLOCK, NULL, &mask) < 0 || !sigismember(&mask, SIGCHLD))
+        return -1;
+    return child_fd;
+}
+
+/*
+ * job_stopped: Returns 1 if every remaining stage of the job is stopped.
+ */
+static int job_stopped(const Job *job) {
+    if (job->running == 0)
+        return 0;
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].pid > 0 && !job->procs[i].stopped)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * current_job: Returns the job '%%' refers to: the most recent unfinished
+ * job, or the most recent job if all have finished (NULL if none).
+ */
+static Job *current_job(void) {
+    Job *latest = NULL;
+    for (int i = job_slots - 1; i >= 0; i--) {
+        if (jobs[i].id == 0)
+            continue;
+        if (jobs[i].running > 0)
+            return &jobs[i];
+        if (latest == NULL)
+            latest = &jobs[i];
+    }
+    return latest;
+}
+
+static void remove_job(Job *job) {
+    free(job->procs);
+    free(job->command);
+    memset(job, 0, sizeof(*job));
+}
+
+/*
+ * forget_job: Removes a finished job that is not reported, keeping the
+ * statuses of its stages for a later 'wait'.
+ */
+static void forget_job(Job *job) {
+    for (int i = 0; i < job->count; i++) {
+        FinishedProc *f = &finished[finished_next];
+        f->id = job->id;
+        f->pid = job->procs[i].started;
+        f->status = job->procs[i].status;
+        f->job_status = job->status;
+        finished_next = (finished_next + 1) % FINISHED_MAX;
+    }
+    remove_job(job);
+}
+
+/*
+ * finished_result: Exit code of a forgotten job ('%N') or process (a pid),
+ * or -1 if there is a live job of that number or nothing is recorded.
+ */
+static int finished_result(const char *spec) {
+    int is_job = spec[0] == '%';
+    const char *digits = is_job ? spec + 1 : spec;
+    char *end;
+    long n = strtol(digits, &end, 10);
+    if (*digits == '\0' || *end != '\0' || n <= 0)
+        return -1;
+    if (is_job && n <= job_slots && jobs[n - 1].id != 0)
+        return -1;
+    // Newest first: job numbers are reused
+    for (int k = 1; k <= FINISHED_MAX; k++) {
+        const FinishedProc *f = &finished[(finished_next - k + FINISHED_MAX) % FINISHED_MAX];
+        if (f->id != 0 && (is_job ? f->id == n : f->pid == n))
+            return exit_status(is_job ? f->job_status : f->status);
+    }
+    return -1;
+}
+
+/*
+ * job_state: Describes a job the way 'jobs' prints it.
+ */
+static const char *job_state(const Job *job, char *buf, size_t size) {
+    if (job->running > 0)
+        return job_stopped(job) ? "Stopped" : "Running";
+    if (WIFSIGNALED(job->status))
+        return strsignal(WTERMSIG(job->status));
+    if (WEXITSTATUS(job->status) == 0)
+        return "Done";
+    snprintf(buf, size, "Exit %d", WEXITSTATUS(job->status));
+    return buf;
+}
+
+static void print_job(const Job *job) {
+    char buf[32];
+    fprintf(stderr, "[%d]%c  %-10s %s\n", job->id, job == current_job() ? '+' : ' ',
+            job_state(job, buf, sizeof(buf)), job->command);
+}
+
+/*
+ * add_job: Records the started stages of a pipeline as a job.
+ *
+ * Returns:
+ *   The new job, or NULL if no stage could be started.
+ */
+static Job *add_job(const pid_t *pids, int count, pid_t pgid, const char *command) {
+    int live = 0;
+    pid_t last = -1;
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) {
+            live++;
+            last = pids[i];
+        }
+    }
+    if (live == 0)
+        return NULL;
+
+    int slot = 0;
+    while (slot < job_slots && jobs[slot].id != 0)
+        slot++;
+    if (slot == job_slots) {
+        int grown_slots = job_slots ? job_slots * 2 : 8;
+        Job *grown = realloc(jobs, grown_slots * sizeof(Job));
+        if (!grown) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(grown + job_slots, 0, (grown_slots - job_slots) * sizeof(Job));
+        jobs = grown;
+        job_slots = grown_slots;
+    }
+
+    Job *job = &jobs[slot];
+    job->procs = malloc(live * sizeof(JobProcess));
+    job->command = strdup(command);
+    if (!job->procs || !job->command) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    job->count = 0;
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) {
+            job->procs[job->count].pid = pids[i];
+            job->procs[job->count].started = pids[i];
+            job->procs[job->count].stopped = 0;
+            job->procs[job->count].status = 0;
+            job->count++;
+        }
+    }
+    job->id = slot + 1;
+    job->running = live;
+    job->last_pid = last;
+    job->pgid = pgid;
+    job->status = 0;
+    return job;
+}
+
+/*
+ * jobs_add: Records a launched background pipeline. An interactive shell
+ * announces it; scripts and server sessions stay quiet, as in other shells.
+ */
+void jobs_add(const pid_t *pids, int count, pid_t pgid, const char *command) {
+    Job *job = add_job(pids, count, pgid, command);
+    if (job && announce)
+        fprintf(stderr, "[%d] %ld\n", job->id, (long)job->last_pid);
+}
+
+/*
+ * jobs_add_stopped: Records a stopped foreground pipeline.
+ */
+void jobs_add_stopped(const pid_t *pids, int count, pid_t pgid, const char *command) {
+    Job *job = add_job(pids, count, pgid, command);
+    if (job == NULL)
+        return;
+    for (int i = 0; i < job->count; i++)
+        job->procs[i].stopped = 1;
+    fprintf(stderr, "\n");
+    print_job(job);
+}
+
+/*
+ * jobs_child_changed: Updates the job owning 'pid' with a wait status.
+ */
+int jobs_child_changed(pid_t pid, int status) {
+    for (int i = 0; i < job_slots; i++) {
+        Job *job = &jobs[i];
+        if (job->id == 0)
+            continue;
+        for (int j = 0; j < job->count; j++) {
+            JobProcess *proc = &job->procs[j];
+            if (proc->pid != pid)
+                continue;
+            if (WIFSTOPPED(status)) {
+                proc->stopped = 1;
+            } else if (WIFCONTINUED(status)) {
+                proc->stopped = 0;
+            } else {
+                proc->pid = -1;
+                proc->status = status;
+                job->running--;
+                if (pid == job->last_pid)
+                    job->status = status;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * drain_child_signals: Consumes pending SIGCHLDs.
+ *
+ * Returns 1 if a child may have changed state since the last call.
+ */
+static int drain_child_signals(void) {
+    if (child_fd < 0)
+        return 1;
+
+    struct signalfd_siginfo info;
+    int pending = 0;
+    while (read(child_fd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+        pending = 1;
+    return pending;
+}
+
+/*
+ * reap_jobs: Collects every change of the jobs' own processes, without
+ * blocking.
+ */
+static void reap_jobs(void) {
+    for (int i = 0; i < job_slots; i++) {
+        for (int j = 0; jobs[i].id != 0 && j < jobs[i].count; j++) {
+            pid_t pid = jobs[i].procs[j].pid;
+            int status;
+            // A process may report several changes (e.g. stop, continue)
+            while (pid > 0 && waitpid(pid, &status, WNOHANG | WUNTRACED | WCONTINUED) == pid) {
+                jobs_child_changed(pid, status);
+                pid = jobs[i].procs[j].pid;
+            }
+        }
+    }
+}
+
+/*
+ * wait_child_change: Blocks until a child may have changed state, on the
+ * SIGCHLD signalfd; without one, waits for 'pid' (a job's process) itself.
+ */
+static void wait_child_change(pid_t pid) {
+    if (child_fd < 0) {
+        int status;
+        if (waitpid(pid, &status, WUNTRACED) == pid)
+            jobs_child_changed(pid, status);
+        return;
+    }
+    struct pollfd pfd = { child_fd, POLLIN, 0 };
+    poll(&pfd, 1, -1);  // EINTR only repeats the caller's check
+}
+
+/*
+ * first_running: Returns a job's first unreaped process, or -1.
+ */
+static pid_t first_running(const Job *job) {
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].pid > 0)
+            return job->procs[i].pid;
+    }
+    return -1;
+}
+
+/*
+ * jobs_poll: Reaps job children that changed state.
+ */
+void jobs_poll(int report) {
+    if (drain_child_signals())
+        reap_jobs();
+
+    // An interactive shell reports finished jobs at the prompt; otherwise
+    // they are forgotten at once, so the table stays small
+    if (!report && announce)
+        return;
+    for (int i = 0; i < job_slots; i++) {
+        if (jobs[i].id != 0 && jobs[i].running == 0) {
+            if (report) {
+                print_job(&jobs[i]);
+                remove_job(&jobs[i]);
+            } else {
+                forget_job(&jobs[i]);
+            }
+        }
+    }
+}
+
+/*
+ * wait_for_job: Blocks until the job has finished or is stopped. Only the
+ * jobs' own processes are reaped; the signals are drained before each
+ * sweep, so a change after it still wakes the next wait.
+ */
+static void wait_for_job(Job *job) {
+    while (1) {
+        drain_child_signals();
+        reap_jobs();
+        if (job->running == 0 || job_stopped(job))
+            break;
+        wait_child_change(first_running(job));
+    }
+}
+
+/*
+ * find_job: Resolves a job specification ('%N', '%%', '%+' or 'N').
+ * With no specification the current job is used.
+ *
+ * Returns:
+ *   The job, or NULL after printing an error prefixed with 'builtin'.
+ */
+static Job *find_job(const char *builtin, const char *spec) {
+    Job *job = NULL;
+    if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        job = current_job();
+        if (job == NULL)
+            fprintf(stderr, "myshell: %s: no current job\n", builtin);
+        return job;
+    }
+
+    const char *digits = spec[0] == '%' ? spec + 1 : spec;
+    char *end;
+    long id = strtol(digits, &end, 10);
+    if (*digits != '\0' && *end == '\0' && id > 0 && id <= job_slots && jobs[id - 1].id != 0)
+        job = &jobs[id - 1];
+    if (job == NULL)
+        fprintf(stderr, "myshell: %s: %s: no such job\n", builtin, spec);
+    return job;
+}
+
+static void continue_job(Job *job) {
+    if (job->pgid > 0)
+        kill(-job->pgid, SIGCONT);
+    for (int i = 0; i < job->count; i++) {
+        if (job->procs[i].pid > 0) {
+            if (job->pgid <= 0)
+                kill(job->procs[i].pid, SIGCONT);
+            job->procs[i].stopped = 0;
+        }
+    }
+}
+
+/*
+ * job_result: Exit code of a job after waiting for it (128 + signal if stopped).
+ */
+static int job_result(const Job *job) {
+    if (job->running > 0)
+        return 128 + SIGTSTP;
+    return exit_status(job->status);
+}
+
+/*
+ * jobs_builtin: Implements 'jobs'.
+ */
+int jobs_builtin(char **args) {
+    (void)args;
+    jobs_poll(0);
+    for (int i = 0; i < job_slots; i++) {
+        if (jobs[i].id == 0)
+            continue;
+        print_job(&jobs[i]);
+        if (jobs[i].running == 0)
+            remove_job(&jobs[i]);
+    }
+    return 0;
+}
+
+/*
+ * wait_pid: Waits for the job stage with the given pid.
+ *
+ * Returns:
+ *   The exit code of the process, or 127 if it is not a job of this shell.
+ */
+static int wait_pid(const char *arg) {
+    char *end;
+    long pid = strtol(arg, &end, 10);
+    Job *owner = NULL;
+    JobProcess *proc = NULL;
+    for (int i = 0; i < job_slots && pid > 0 && *end == '\0'; i++) {
+        for (int j = 0; jobs[i].id != 0 && j < jobs[i].count; j++) {
+            if (jobs[i].procs[j].pid == pid) {
+                owner = &jobs[i];
+                proc = &jobs[i].procs[j];
+            }
+        }
+    }
+    int forgotten = proc == NULL ? finished_result(arg) : -1;
+    if (forgotten >= 0)
+        return forgotten;
+    if (proc == NULL) {
+        fprintf(stderr, "myshell: wait: pid %s is not a child of this shell\n", arg);
+        return 127;
+    }
+
+    while (1) {
+        drain_child_signals();
+        reap_jobs();
+        if (proc->pid <= 0 || proc->stopped)
+            break;
+        wait_child_change(proc->pid);
+    }
+    int result = proc->pid > 0 ? 128 + SIGTSTP : exit_status(proc->status);
+    if (owner->running == 0)
+        remove_job(owner);
+    return result;
+}
+
+/*
+ * wait_builtin: Implements 'wait'.
+ *
+ *   wait          - wait for every job (stopped jobs are not waited for)
+ *   wait %N...    - wait for the given jobs
+ *   wait pid...   - wait for the given processes
+ *
+ * Returns the exit code of the last job or process waited for.
+ */
+int wait_builtin(char **args) {
+    jobs_poll(0);
+    if (args[1] == NULL) {
+        for (int i = 0; i < job_slots; i++) {
+            if (jobs[i].id == 0)
+                continue;
+            wait_for_job(&jobs[i]);
+            if (jobs[i].running == 0)
+                remove_job(&jobs[i]);
+        }
+        return 0;
+    }
+
+    int result = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (args[i][0] != '%') {
+            result = wait_pid(args[i]);
+            continue;
+        }
+        int forgotten = finished_result(args[i]);
+        if (forgotten >= 0) {
+            result = forgotten;
+            continue;
+        }
+        Job *job = find_job("wait", args[i]);
+        if (job == NULL) {
+            result = 127;
+            continue;
+        }
+        wait_for_job(job);
+        result = job_result(job);
+        if (job->running == 0)
+            remove_job(job);
+    }
+    return result;
+}
+
+/*
+ * fg_builtin: Implements 'fg': runs a job in the foreground.
+ */
+int fg_builtin(char **args) {
+    jobs_poll(0);
+    Job *job = find_job("fg", args[1]);
+    if (job == NULL)
+        return 1;
+
+    printf("%s\n", job->command);
+    fflush(stdout);
+    jobs_give_terminal(job->pgid);
+    continue_job(job);
+    wait_for_job(job);
+    jobs_take_terminal();
+    int result = job_result(job);
+    if (job->running == 0)
+        remove_job(job);
+    else
+        print_job(job);
+    return result;
+}
+
+/*
+ * bg_builtin: Implements 'bg': continues a stopped job in the background.
+ */
+int bg_builtin(char **args) {
+    jobs_poll(0);
+    Job *job = find_job("bg", args[1]);
+    if (job == NULL)
+        return 1;
+
+    if (!job_stopped(job)) {
+        fprintf(stderr, "myshell: bg: job %d already in background\n", job->id);
+        return 1;
+    }
+    continue_job(job);
+    fprintf(stderr, "[%d]  %s\n", job->id, job->command);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+
+// Blocks SIGCHLD and opens the signalfd the reaper drains; call once at
+// startup. An interactive shell owning its terminal also enables job
+// control: it ignores the job control signals and runs every pipeline in
+// a process group of its own.
+void jobs_init(int interactive);
+
+// Returns 1 if job control is enabled in this process (not in subshells)
+int jobs_job_control(void);
+
+// Makes 'pgid' the terminal's foreground process group (job control only)
+void jobs_give_terminal(pid_t pgid);
+
+// Makes the shell the terminal's foreground process group again
+void jobs_take_terminal(void);
+
+// The signalfd that becomes readable when a child changes state (-1 if
+// SIGCHLD is not routed to it in this process)
+int jobs_signal_fd(void);
+
+// Registers a background pipeline as a job; an interactive shell prints
+// "[id] pid".
+// 'pids' holds one entry per stage (-1 for stages that did not start);
+// 'pgid' is the job's process group (-1 if it has none).
+void jobs_add(const pid_t *pids, int count, pid_t pgid, const char *command);
+
+// Registers a foreground pipeline that was stopped (e.g. by Ctrl-Z) as a
+// stopped job and reports it
+void jobs_add_stopped(const pid_t *pids, int count, pid_t pgid, const char *command);
+
+// Applies a wait status collected elsewhere (e.g. by a foreground wait).
+// Returns 1 if 'pid' belongs to a job, 0 otherwise.
+int jobs_child_changed(pid_t pid, int status);
+
+// Collects state changes of the jobs' children without blocking (other
+// children are left alone); if 'report' is set, finished jobs are printed
+// and removed from the table. A shell that is not interactive removes them
+// quietly instead, keeping their statuses for 'wait'.
+void jobs_poll(int report);
+
+// Job control builtins; each returns its exit status
+int jobs_builtin(char **args);
+int wait_builtin(char **args);
+int fg_builtin(char **args);
+int bg_builtin(char **args);
+
+#endif // JOBS_H
@@ -0,0 +1,725 @@
+/*
+ * lineedit.c - Interactive Line Editor
+ *
+ * This file implements the raw-mode editor used to read command lines from
+ * a terminal. It keeps a copy of what is currently on the screen and, after
+ * each batch of input, redraws only the part of the line that changed.
+ *
+ * Key Components:
+ *
+ * 1. Redisplay:
+ *    - The new line is compared with the displayed one; the cursor moves to
+ *      the first difference, the rest of the line is rewritten and any
+ *      leftover text is cleared
+ *    - Output is collected in a buffer and sent with a single write() per
+ *      input event (one read() of keystrokes, e.g. a key or a paste)
+ *    - Positions are computed from the terminal width, so lines wrapping
+ *      over several rows are handled
+ *
+ * 2. Editing Keys:
+ *    - Left/Right, Home/End, Ctrl-A/E/B/F: move the cursor
+ *    - Backspace, Delete, Ctrl-D: delete a character (Ctrl-D on an empty
+ *      line ends input); Ctrl-K, Ctrl-U, Ctrl-W: delete to end, to start,
+ *      or the previous word
+ *    - Up/Down, Ctrl-P/N: recall history entries starting with the text
+ *      typed before recall began
+ *    - Ctrl-L clears the screen, Ctrl-C cancels the line
+ *
+ * 3. Completion:
+ *    - Tab in command position completes builtins and $PATH commands
+ *      (path_cache_complete()); elsewhere it completes file names
+ *    - Directory listings come from the directory cache, refreshed only
+ *      when a directory's mtime changes
+ *    - A unique match is inserted with a trailing '/' or space; otherwise
+ *      the common prefix is inserted, or the candidates are listed
+ *
+ * Implementation Details:
+ * - The terminal is in raw mode only while a line is being read
+ * - UTF-8 continuation bytes take no column and are skipped by the cursor
+ * - Keystrokes typed past Enter are kept for the next line
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "lineedit.h"
+#include "history.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "dircache.h"
+
+#define ESCAPE_TIMEOUT_MS 50
+
+// Keys decoded from escape sequences, above the byte range
+enum {
+    KEY_LEFT = 256,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_NONE        // Ignored sequence
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+typedef struct {
+    char *name;
+    int is_dir;
+} Candidate;
+
+typedef struct {
+    Candidate *items;
+    size_t count;
+    size_t cap;
+} CandidateList;
+
+static Buffer line;             // Line being edited
+static size_t cursor;           // Byte offset of the cursor in 'line'
+static Buffer shown;            // Line as currently displayed
+static size_t shown_cursor;
+static Buffer out;              // Pending terminal output
+static const char *prompt;
+static size_t prompt_cols;
+static size_t cols;             // Terminal width
+
+static unsigned char in_buf[512];
+static size_t in_start, in_end;
+
+static size_t recall_index;     // History entry shown (history_count() if none)
+static char *recall_prefix;     // Text typed before recall began
+
+static void reserve(Buffer *buf, size_t extra) {
+    if (buf->len + extra + 1 <= buf->cap)
+        return;
+    size_t cap = buf->cap ? buf->cap : 128;
+    while (buf->len + extra + 1 > cap)
+        cap *= 2;
+    char *data = realloc(buf->data, cap);
+    if (!data) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    buf->data = data;
+    buf->cap = cap;
+}
+
+static void append(Buffer *buf, const char *s, size_t len) {
+    reserve(buf, len);
+    memcpy(buf->data + buf->len, s, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static void append_str(Buffer *buf, const char *s) {
+    append(buf, s, strlen(s));
+}
+
+static void append_csi(int n, char final) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\x1b[%d%c", n, final);
+    append(&out, seq, len);
+}
+
+static void flush_output(void) {
+    size_t done = 0;
+    while (done < out.len) {
+        ssize_t n = write(STDOUT_FILENO, out.data + done, out.len - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        done += n;
+    }
+    out.len = 0;
+}
+
+static int is_continuation(char c) {
+    return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+/*
+ * columns: Screen column (counted from the start of the prompt) of byte
+ * offset 'pos' of 'buf'.
+ */
+static size_t columns(const Buffer *buf, size_t pos) {
+    size_t n = prompt_cols;
+    for (size_t i = 0; i < pos; i++) {
+        if (!is_continuation(buf->data[i]))
+            n++;
+    }
+    return n;
+}
+
+static void update_width(void) {
+    struct winsize ws;
+    cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+}
+
+/*
+ * move_cursor: Moves the terminal cursor between two line columns.
+ */
+static void move_cursor(size_t from, size_t to) {
+    size_t from_row = from / cols, to_row = to / cols;
+    size_t from_col = from % cols, to_col = to % cols;
+    if (from_row > to_row)
+        append_csi(from_row - to_row, 'A');
+    else if (to_row > from_row)
+        append_csi(to_row - from_row, 'B');
+    if (from_col > to_col)
+        append_csi(from_col - to_col, 'D');
+    else if (to_col > from_col)
+        append_csi(to_col - from_col, 'C');
+}
+
+/*
+ * write_text: Appends line bytes [start, line.len) to the output, leaving
+ * the cursor on the next row if the text ends exactly at the right margin.
+ */
+static void write_text(size_t start) {
+    if (start == line.len)
+        return;
+    append(&out, line.data + start, line.len - start);
+    if (columns(&line, line.len) % cols == 0)
+        append_str(&out, "\r\n");
+}
+
+/*
+ * refresh: Brings the screen in line with the edited line.
+ *
+ * Only the text from the first changed character onwards is rewritten.
+ */
+static void refresh(void) {
+    update_width();
+
+    size_t same = 0;
+    while (same < line.len && same < shown.len && line.data[same] == shown.data[same])
+        same++;
+    while (same > 0 && same < line.len && is_continuation(line.data[same]))
+        same--;
+
+    if (same == line.len && same == shown.len) {
+        if (cursor != shown_cursor)
+            move_cursor(columns(&shown, shown_cursor), columns(&line, cursor));
+    } else {
+        size_t shown_end = columns(&shown, shown.len);
+        move_cursor(columns(&shown, shown_cursor), columns(&line, same));
+        write_text(same);
+        size_t end = columns(&line, line.len);
+        if (shown_end > end)
+            append_str(&out, "\x1b[J");
+        move_cursor(end, columns(&line, cursor));
+    }
+
+    shown.len = 0;
+    append(&shown, line.data ? line.data : "", line.len);
+    shown_cursor = cursor;
+}
+
+/*
+ * redraw: Draws the prompt and the whole line from column 0 of the
+ * current row.
+ */
+static void redraw(void) {
+    update_width();
+    append_str(&out, "\r");
+    append_str(&out, prompt);
+    write_text(0);
+    append_str(&out, "\x1b[J");
+    move_cursor(columns(&line, line.len), columns(&line, cursor));
+    shown.len = 0;
+    append(&shown, line.data ? line.data : "", line.len);
+    shown_cursor = cursor;
+}
+
+/*
+ * read_byte: Returns the next input byte, -1 at end of input, or -2 if
+ * 'timeout_ms' (>= 0) passed without input.
+ *
+ * The screen is refreshed and pending output written before blocking, so a
+ * batch of keystrokes produces one write().
+ */
+static int read_byte(int timeout_ms) {
+    while (in_start == in_end) {
+        if (timeout_ms < 0) {
+            refresh();
+            flush_output();
+        } else {
+            struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+            int ready = poll(&pfd, 1, timeout_ms);
+            if (ready == 0)
+                return -2;
+            if (ready < 0 && errno != EINTR)
+                return -1;
+        }
+        ssize_t n = read(STDIN_FILENO, in_buf, sizeof(in_buf));
+        if (n == 0)
+            return -1;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        in_start = 0;
+        in_end = n;
+    }
+    return in_buf[in_start++];
+}
+
+/*
+ * read_key: Decodes the next key, turning escape sequences into KEY_*.
+ */
+static int read_key(void) {
+    int c = read_byte(-1);
+    if (c != 0x1b)
+        return c;
+
+    int c1 = read_byte(ESCAPE_TIMEOUT_MS);
+    if (c1 == 'O') {
+        int c2 = read_byte(ESCAPE_TIMEOUT_MS);
+        return c2 == 'H' ? KEY_HOME : c2 == 'F' ? KEY_END : KEY_NONE;
+    }
+    if (c1 != '[')
+        return KEY_NONE;
+
+    int param = 0, c2;
+    while ((c2 = read_byte(ESCAPE_TIMEOUT_MS)) >= '0' && c2 <= '9')
+        param = param * 10 + (c2 - '0');
+    // Skip modifier parameters and any other unrecognized sequence
+    while (c2 == ';' || (c2 >= '0' && c2 <= '9'))
+        c2 = read_byte(ESCAPE_TIMEOUT_MS);
+
+    switch (c2) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    case '~':
+        if (param == 1 || param == 7)
+            return KEY_HOME;
+        if (param == 4 || param == 8)
+            return KEY_END;
+        if (param == 3)
+            return KEY_DELETE;
+        return KEY_NONE;
+    default:
+        return KEY_NONE;
+    }
+}
+
+static void insert(const char *s, size_t len) {
+    reserve(&line, len);
+    memmove(line.data + cursor + len, line.data + cursor, line.len - cursor);
+    memcpy(line.data + cursor, s, len);
+    line.len += len;
+    line.data[line.len] = '\0';
+    cursor += len;
+}
+
+static void erase(size_t start, size_t end) {
+    memmove(line.data + start, line.data + end, line.len - end);
+    line.len -= end - start;
+    line.data[line.len] = '\0';
+    if (cursor >= end)
+        cursor -= end - start;
+    else if (cursor > start)
+        cursor = start;
+}
+
+static size_t prev_char(size_t pos) {
+    if (pos == 0)
+        return 0;
+    pos--;
+    while (pos > 0 && is_continuation(line.data[pos]))
+        pos--;
+    return pos;
+}
+
+static size_t next_char(size_t pos) {
+    if (pos >= line.len)
+        return line.len;
+    pos++;
+    while (pos < line.len && is_continuation(line.data[pos]))
+        pos++;
+    return pos;
+}
+
+static void set_line(const char *s, size_t len) {
+    line.len = 0;
+    append(&line, s, len);
+    cursor = line.len;
+}
+
+static void end_recall(void) {
+    free(recall_prefix);
+    recall_prefix = NULL;
+    recall_index = history_count();
+}
+
+/*
+ * recall: Shows the previous (direction < 0) or next history entry that
+ * starts with the text typed before recall began.
+ */
+static void recall(int direction) {
+    size_t count = history_count();
+    if (recall_prefix == NULL) {
+        if (direction > 0)
+            return;
+        recall_prefix = strndup(line.data ? line.data : "", line.len);
+        if (!recall_prefix) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        recall_index = count;
+    }
+
+    size_t prefix_len = strlen(recall_prefix);
+    if (direction < 0) {
+        long found = history_search(recall_prefix, recall_index, 0);
+        if (found < 0)
+            return;
+        recall_index = (size_t)found;
+    } else {
+        size_t i = recall_index + 1;
+        size_t len = 0;
+        const char *entry = NULL;
+        for (; i < count; i++) {
+            entry = history_get(i, &len);
+            if (entry && len >= prefix_len && memcmp(entry, recall_prefix, prefix_len) == 0)
+                break;
+        }
+        if (i >= count) {
+            // Back to what was typed
+            set_line(recall_prefix, prefix_len);
+            end_recall();
+            return;
+        }
+        recall_index = i;
+    }
+
+    size_t len;
+    const char *entry = history_get(recall_index, &len);
+    if (entry)
+        set_line(entry, len);
+}
+
+static void add_candidate(const char *name, int is_dir, CandidateList *list) {
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 32;
+        Candidate *items = realloc(list->items, list->cap * sizeof(Candidate));
+        if (!items) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        list->items = items;
+    }
+    char *copy = strdup(name);
+    if (!copy) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    list->items[list->count].name = copy;
+    list->items[list->count].is_dir = is_dir;
+    list->count++;
+}
+
+static void add_command(const char *name, void *ctx) {
+    add_candidate(name, 0, ctx);
+}
+
+static int compare_candidates(const void *a, const void *b) {
+    return strcmp(((const Candidate *)a)->name, ((const Candidate *)b)->name);
+}
+
+/*
+ * collect_files: Adds the entries of 'dir' starting with 'prefix'.
+ * Hidden entries are only offered when the prefix starts with '.'.
+ */
+static void collect_files(const char *dir, const char *prefix, CandidateList *list) {
+    DirListing listing;
+    if (dir_cache_get(dir, &listing) < 0)
+        return;
+    size_t prefix_len = strlen(prefix);
+    for (size_t i = 0; i < listing.count; i++) {
+        const DirEntry *entry = &listing.entries[i];
+        if (entry->name[0] == '.' && prefix[0] != '.')
+            continue;
+        if (strncmp(entry->name, prefix, prefix_len) == 0)
+            add_candidate(entry->name, dir_entry_is_dir(dir, entry), list);
+    }
+}
+
+/*
+ * show_candidates: Lists candidates in columns below the line, then
+ * redraws the prompt and line.
+ */
+static void show_candidates(const CandidateList *list) {
+    size_t width = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        size_t len = strlen(list->items[i].name) + list->items[i].is_dir;
+        if (len > width)
+            width = len;
+    }
+    width += 2;
+    size_t per_row = cols / width ? cols / width : 1;
+    size_t rows = (list->count + per_row - 1) / per_row;
+
+    move_cursor(columns(&shown, shown_cursor), columns(&shown, shown.len));
+    if (columns(&shown, shown.len) % cols != 0 || shown.len == 0)
+        append_str(&out, "\r\n");
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < per_row; c++) {
+            size_t i = c * rows + r;
+            if (i >= list->count)
+                break;
+            size_t len = strlen(list->items[i].name);
+            append(&out, list->items[i].name, len);
+            if (list->items[i].is_dir) {
+                append_str(&out, "/");
+                len++;
+            }
+            if (c + 1 < per_row && i + rows < list->count) {
+                for (; len < width; len++)
+                    append_str(&out, " ");
+            }
+        }
+        append_str(&out, "\r\n");
+    }
+    redraw();
+}
+
+/*
+ * complete: Completes the word before the cursor.
+ */
+static void complete(void) {
+    size_t start = cursor;
+    while (start > 0 && !strchr(" \t|<>;&", line.data[start - 1]))
+        start--;
+    size_t before = start;
+    while (before > 0 && (line.data[before - 1] == ' ' || line.data[before - 1] == '\t'))
+        before--;
+    int command = before == 0 || strchr("|;&", line.data[before - 1]) != NULL;
+
+    char *word = strndup(line.data + start, cursor - start);
+    if (!word) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // 'base' is the part of the word being completed
+    CandidateList list = { NULL, 0, 0 };
+    char *slash = strrchr(word, '/');
+    const char *base = slash ? slash + 1 : word;
+    if (command && slash == NULL) {
+        builtin_complete(word, add_command, &list);
+        path_cache_complete(word, add_command, &list);
+    } else if (slash == NULL) {
+        collect_files(".", word, &list);
+    } else {
+        char *dir = slash == word ? strdup("/") : strndup(word, slash - word);
+        if (!dir) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        collect_files(dir, base, &list);
+        free(dir);
+    }
+
+    if (list.count > 0) {
+        qsort(list.items, list.count, sizeof(Candidate), compare_candidates);
+        size_t unique = 1;
+        for (size_t i = 1; i < list.count; i++) {
+            if (strcmp(list.items[i].name, list.items[unique - 1].name) == 0)
+                free(list.items[i].name);
+            else
+                list.items[unique++] = list.items[i];
+        }
+        list.count = unique;
+
+        size_t base_len = strlen(base);
+        if (list.count == 1) {
+            const Candidate *only = &list.items[0];
+            insert(only->name + base_len, strlen(only->name) - base_len);
+            insert(only->is_dir ? "/" : " ", 1);
+        } else {
+            // Longest common prefix of the sorted list is that of its ends
+            const char *first = list.items[0].name, *last = list.items[list.count - 1].name;
+            size_t common = 0;
+            while (first[common] && first[common] == last[common])
+                common++;
+            if (common > base_len) {
+                insert(first + base_len, common - base_len);
+            } else {
+                refresh();
+                show_candidates(&list);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < list.count; i++)
+        free(list.items[i].name);
+    free(list.items);
+    free(word);
+}
+
+int lineedit_supported(int fd) {
+    struct termios term;
+    const char *name = getenv("TERM");
+    if (!isatty(fd) || !isatty(STDOUT_FILENO) || tcgetattr(fd, &term) < 0)
+        return 0;
+    return name == NULL || (strcmp(name, "dumb") != 0 && strcmp(name, "unknown") != 0);
+}
+
+/*
+ * lineedit_read: Reads one edited line from the terminal.
+ *
+ * Parameters:
+ *   text - The prompt to display.
+ *
+ * Returns:
+ *   The line (owned by the editor), "" after Ctrl-C, or NULL at end of input.
+ */
+char *lineedit_read(const char *text) {
+    struct termios saved, raw;
+    if (tcgetattr(STDIN_FILENO, &saved) < 0)
+        return NULL;
+    raw = saved;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~OPOST;
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+    prompt = text;
+    prompt_cols = strlen(text);
+    line.len = 0;
+    append(&line, "", 0);
+    cursor = 0;
+    shown.len = 0;
+    shown_cursor = 0;
+    end_recall();
+    append_str(&out, prompt);
+
+    char *result = NULL;
+    int done = 0;
+    while (!done) {
+        int key = read_key();
+        if (key != KEY_UP && key != KEY_DOWN && key != 16 && key != 14)
+            end_recall();
+
+        switch (key) {
+        case -1:                    // End of input
+            done = 1;
+            break;
+        case '\r':
+        case '\n':
+            result = line.data;
+            done = 1;
+            break;
+        case 3:                     // Ctrl-C
+            cursor = line.len;
+            refresh();
+            append_str(&out, "^C");
+            line.len = 0;
+            line.data[0] = '\0';
+            result = line.data;
+            done = 1;
+            break;
+        case 4:                     // Ctrl-D
+            if (line.len == 0) {
+                done = 1;
+                break;
+            }
+            /* fall through */
+        case KEY_DELETE:
+            erase(cursor, next_char(cursor));
+            break;
+        case 127:
+        case 8:                     // Backspace, Ctrl-H
+            erase(prev_char(cursor), cursor);
+            break;
+        case 1:
+        case KEY_HOME:
+            cursor = 0;
+            break;
+        case 5:
+        case KEY_END:
+            cursor = line.len;
+            break;
+        case 2:
+        case KEY_LEFT:
+            cursor = prev_char(cursor);
+            break;
+        case 6:
+        case KEY_RIGHT:
+            cursor = next_char(cursor);
+            break;
+        case 16:
+        case KEY_UP:
+            recall(-1);
+            break;
+        case 14:
+        case KEY_DOWN:
+            recall(1);
+            break;
+        case 11:                    // Ctrl-K
+            erase(cursor, line.len);
+            break;
+        case 21:                    // Ctrl-U
+            erase(0, cursor);
+            break;
+        case 23: {                  // Ctrl-W
+            size_t start = cursor;
+            while (start > 0 && line.data[start - 1] == ' ')
+                start--;
+            while (start > 0 && line.data[start - 1] != ' ')
+                start--;
+            erase(start, cursor);
+            break;
+        }
+        case 12:                    // Ctrl-L
+            append_str(&out, "\x1b[H\x1b[2J");
+            redraw();
+            break;
+        case '\t':
+            complete();
+            break;
+        default:
+            if (key >= 32 && key < 256) {
+                char c = (char)key;
+                insert(&c, 1);
+            }
+            break;
+        }
+    }
+
+    // Leave the cursor at the start of the row below the line
+    if (result != NULL && line.len > 0) {
+        cursor = line.len;
+        refresh();
+        if (columns(&line, line.len) % cols != 0)
+            append_str(&out, "\r\n");
+    } else if (result != NULL) {
+        append_str(&out, "\r\n");
+    }
+    flush_output();
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+    return result;
+}
@@ -0,0 +1,13 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+// Returns 1 if 'fd' is a terminal the line editor can drive, 0 otherwise
+int lineedit_supported(int fd);
+
+// Shows 'prompt' and reads a line from the terminal on stdin with editing,
+// history recall and tab completion. Returns the line without its newline
+// (valid until the next call), an empty line if it was cancelled with
+// Ctrl-C, or NULL at end of input.
+char *lineedit_read(const char *prompt);
+
+#endif // LINEEDIT_H
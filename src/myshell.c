@@ -4,20 +4,47 @@
  * This file implements a UNIX-like shell that provides command-line interface functionality.
  * The shell supports:
  * - Basic command execution (with and without arguments)
- * - Input/Output/Error redirection (<, >, 2>)
+ * - Input/Output/Error redirection (<, >, 2>), here-documents and here-strings
  * - Command pipelines of arbitrary length
- * - Built-in commands (cd, exit)
+ * - Command lists with ';', '&&' and '||', '$?' and 'set -o pipefail'
+ * - Background jobs with '&' (job table and reaper in jobs.c)
+ * - Process substitution with <(...) and >(...), and coprocesses (procsub.c)
+ * - Command substitution with $(...), split into words (cmdsub.c, expand.c)
+ * - Shell variables: NAME=value, $NAME, export, unset and prefix
+ *   assignments for one command (vars.c)
+ * - Pathname expansion of *, ? and [...] over cached listings (wildcard.c)
+ * - for, while, until and if blocks, parsed once and run from their
+ *   command tree, with break and continue (control.c)
+ * - Built-in commands from a dispatch table (builtins.c): cd, exit, hash, set,
+ *   jobs, wait, fg, bg, parallel, parsecache, history, timeout, coproc, export,
+ *   unset, break, continue, ulimit, place, and in-process echo,
+ *   true, false, pwd and test/[
+ * - Persistent, memory-mapped command history for interactive sessions
+ * - A raw-mode line editor with history recall and tab completion
+ * - Per-stage timing with the 'time' prefix and an optional JSON timing log
+ * - Tracing of each line's phases to a Chrome trace file (trace.c)
+ * - A server mode (--server PATH) running the lines of many clients, each
+ *   in its own session (server.c)
+ * - A startup file (~/.myshellrc) whose resulting state is restored from
+ *   a mapped snapshot while the file is unchanged (rcfile.c)
+ * - Resource limits, and per-command CPU, priority and cgroup placement
+ *   applied at spawn time (resources.c, spawn.c)
  * - Error handling and reporting
  * 
  * Program Flow:
- * 1. Display prompt and read user input
- * 2. Parse input into tokens (handling quotes and special characters)
- * 3. Check for built-in commands
- * 4. For external commands:
- *    a. Check for pipelines and split if necessary
- *    b. Set up any requested redirections
- *    c. Fork and execute commands
- *    d. Wait for completion and handle errors
+ * 1. Read a line from the script given as argument or from stdin,
+ *    displaying a prompt only when stdin is a terminal (where the line
+ *    editor reads it)
+ * 2. Parse input into typed tokens (handling quotes and operators),
+ *    unless the parse cache already holds the same line, then read the
+ *    bodies of its here-documents from the following lines; a line that
+ *    opens a block is read on to the end of the block
+ * 3. Split the line into pipelines (joined by ;, &&, ||, &) and the
+ *    pipelines into commands with their redirections
+ * 4. Run built-in commands in the shell; for external commands:
+ *    a. Turn redirections and pipes into spawn plans
+ *    b. Spawn and execute commands
+ *    c. Wait for completion and handle errors
  * 5. Clean up resources and repeat
  * 
  * Error Handling:
@@ -34,152 +61,509 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "parser.h"
 #include "executor.h"
+#include "arena.h"
+#include "timing.h"
+#include "input.h"
+#include "jobs.h"
+#include "builtins.h"
+#include "options.h"
+#include "parsecache.h"
+#include "history.h"
+#include "lineedit.h"
+#include "expand.h"
+#include "procsub.h"
+#include "vars.h"
+#include "server.h"
+#include "trace.h"
+#include "control.h"
+#include "rcfile.h"
 
-#define MAX_INPUT_SIZE 1024
+static InputSource *shell_input;    // Where command lines come from
+static int interactive;             // stdin is a terminal: prompts, history, jobs
+static int editing;                 // Lines are read through the line editor
 
 /*
- * handle_builtin: Handles built-in shell commands
- * Returns 1 if the command was handled, 0 otherwise
+ * read_line:
+ *
+ * Reads the next line of input, showing 'prompt' on a terminal. Returns
+ * the line without its newline (valid until the next call), or NULL at
+ * end of input.
  */
-int handle_builtin(char **args) {
-    if (args == NULL || args[0] == NULL) {
-        return 0;
-    }
-
-    // Handle 'cd' command
-    if (strcmp(args[0], "cd") == 0) {
-        char *dir = args[1];
-        if (dir == NULL) {
-            fprintf(stderr, "myshell: expected argument to \"cd\"\n");
-        } else if (chdir(dir) != 0) {
-            if (errno == ENOENT)
-                fprintf(stderr, "cd: no such file or directory: %s\n", dir);
-            else
-                fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+static char *read_line(const char *prompt) {
+    if (editing)
+        return lineedit_read(prompt);
+    if (interactive) {
+        printf("%s", prompt);
+        fflush(stdout);
+    }
+    return input_next_line(shell_input);
+}
+
+/*
+ * pipeline_text: Rebuilds the source text of tokens [start, end), used to
+ * name a background job started from a line with several pipelines.
+ */
+static char *pipeline_text(Arena *arena, const TokenList *tokens, int start, int end) {
+    size_t len = 1;
+    for (int i = start; i < end; i++)
+        len += (tokens->tokens[i].type == TOK_WORD ? 0 : 3) + (size_t)tokens->tokens[i].length + 1;
+    char *text = arena_alloc(arena, len);
+    char *out = text;
+    for (int i = start; i < end; i++) {
+        TokenType type = tokens->tokens[i].type;
+        if (out != text)
+            *out++ = ' ';
+        if (type != TOK_WORD)
+            out = stpcpy(out, token_name(type));
+        if (token_is_word(type))
+            out = stpcpy(out, token_text(tokens, i));
+        if (type == TOK_PROCSUB_IN || type == TOK_PROCSUB_OUT)
+            *out++ = ')';
+    }
+    *out = '\0';
+    return text;
+}
+
+/*
+ * finish_commands: Releases the fds of a pipeline's commands and ends
+ * their process substitutions.
+ */
+static void finish_commands(Command *commands, int count) {
+    for (int i = 0; i < count; i++) {
+        close_command_fds(&commands[i]);
+        procsub_finish(&commands[i]);
+    }
+}
+
+/*
+ * run_pipeline: Executes one pipeline of a parsed line.
+ *
+ * Returns:
+ *   Its exit status (0 for a background job), or -1 for a syntax error.
+ */
+static int run_pipeline(Arena *arena, const ParsedLine *line, const Pipeline *pipeline,
+                        const char *job_text) {
+    const TokenList *tokens = &line->tokens;
+    const StageRange *stages = line->stages + pipeline->first_stage;
+    int cmd_count = pipeline->cmd_count;
+    int background = pipeline->background;
+    int timed = pipeline->timed;
+    int status = 0;
+
+    // Parse each command in the pipeline
+    Command *cmd_structs = arena_alloc(arena, cmd_count * sizeof(Command));
+    for (int i = 0; i < cmd_count; i++) {
+        uint64_t traced = trace_begin();
+        Command *cmd = parse_command(arena, tokens, stages[i].start, stages[i].end);
+        if (!cmd) {
+            finish_commands(cmd_structs, i);
+            return -1;
+        }
+        cmd_structs[i] = *cmd;
+        // Process substitutions run before their command starts
+        if (procsub_start(arena, &cmd_structs[i]) < 0) {
+            finish_commands(cmd_structs, i + 1);
+            return -1;
         }
-        return 1;
+        trace_end("command", traced, "stage", i, cmd->args[0]);
     }
 
-    // Handle 'exit' command
-    if (strcmp(args[0], "exit") == 0) {
-        exit(0);
+    // Per-stage statistics are needed for 'time' and the timing log
+    StageStats *stats = NULL;
+    if ((timed || shell_options.time_log) && !background)
+        stats = arena_alloc(arena, cmd_count * sizeof(StageStats));
+
+    int empty = cmd_count == 1 && cmd_structs[0].args[0] == NULL;
+    const Builtin *builtin = cmd_count == 1 && !empty ? builtin_lookup(cmd_structs[0].args[0]) : NULL;
+    if (empty) {
+        // Only assignments and expansions: set the variables, and the
+        // status of a command substitution stands
+        for (int i = 0; !background && i < cmd_structs[0].assign_count; i++)
+            vars_assign(cmd_structs[0].assigns[i], 0);
+        status = background ? 0 : last_status;
+        stats = NULL;
+    } else if (builtin && !background) {
+        // Built-in commands run in the shell and are not timed
+        status = builtin_run(builtin, &cmd_structs[0]);
+        stats = NULL;
+    } else if (background) {
+        // Jobs do not compete with the shell for its input
+        if (cmd_structs[0].input_fd == -1)
+            cmd_structs[0].input_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        // The job includes its process substitutions, ahead of its stages
+        int subs = 0;
+        for (int i = 0; i < cmd_count; i++)
+            subs += procsub_pids(&cmd_structs[i], NULL);
+        pid_t *pids = arena_alloc(arena, (subs + cmd_count) * sizeof(pid_t));
+        subs = 0;
+        for (int i = 0; i < cmd_count; i++)
+            subs += procsub_pids(&cmd_structs[i], pids + subs);
+        pid_t pgid;
+        int launched = execute_background(cmd_structs, cmd_count, pids + subs, &pgid);
+        jobs_add(pids, subs + launched, pgid, job_text);
+        for (int i = 0; i < cmd_count; i++) {
+            for (int j = 0; j < cmd_structs[i].sub_count; j++)
+                cmd_structs[i].subs[j].pid_count = 0;   // Reaped by the job table
+        }
+    } else if (cmd_count == 1) {
+        // Simple command without pipes
+        status = execute_command(&cmd_structs[0], stats);
+    } else {
+        // Pipeline of commands
+        status = execute_pipeline(cmd_structs, cmd_count, stats);
     }
 
+    if (stats && timed)
+        timing_print(cmd_structs, stats, cmd_count);
+    if (stats && shell_options.time_log)
+        timing_log(shell_options.time_log, cmd_structs, stats, cmd_count);
+
+    finish_commands(cmd_structs, cmd_count);
+    return status;
+}
+
+/*
+ * has_here_docs: Returns 1 if a token list contains a '<<' operator.
+ */
+static int has_here_docs(const TokenList *tokens) {
+    for (int i = 0; i < tokens->count; i++) {
+        if (tokens->tokens[i].type == TOK_HEREDOC)
+            return 1;
+    }
     return 0;
 }
 
+/*
+ * read_here_doc:
+ *
+ * Reads the lines after the command line up to 'delimiter' (with leading
+ * tabs removed under '<<-') and returns them as one arena string with a
+ * newline after each line. End of input also ends the body.
+ */
+static char *read_here_doc(Arena *arena, const char *delimiter, int strip_tabs) {
+    size_t len = 0, capacity = 256;
+    char *body = malloc(capacity);
+    if (!body) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *line;
+    while ((line = read_line("> ")) != NULL) {
+        while (strip_tabs && *line == '\t')
+            line++;
+        if (strcmp(line, delimiter) == 0)
+            break;
+        size_t n = strlen(line);
+        if (len + n + 2 > capacity) {
+            while (len + n + 2 > capacity)
+                capacity *= 2;
+            char *grown = realloc(body, capacity);
+            if (!grown) {
+                fprintf(stderr, "myshell: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+            body = grown;
+        }
+        memcpy(body + len, line, n);
+        body[len + n] = '\n';
+        len += n + 1;
+    }
+    if (line == NULL)
+        fprintf(stderr, "myshell: warning: here-document delimited by end-of-file (wanted '%s')\n",
+                delimiter);
+
+    char *text = arena_strndup(arena, body, len);
+    free(body);
+    return text;
+}
+
+/*
+ * read_here_docs:
+ *
+ * Reads the bodies of a line's here-documents, in order, from the lines
+ * that follow it. They are not part of the (cached) parse of the line, so
+ * they are attached to this run's token list for parse_command().
+ */
+static void read_here_docs(Arena *arena, TokenList *tokens) {
+    int count = 0;
+    for (int i = 0; i < tokens->count; i++)
+        count += tokens->tokens[i].type == TOK_HEREDOC;
+    tokens->here_docs = arena_alloc(arena, count * sizeof(char *));
+
+    for (int i = 0; i < tokens->count; i++) {
+        const Token *token = &tokens->tokens[i];
+        if (token->type != TOK_HEREDOC)
+            continue;
+        // Without a delimiter word parse_command() reports a syntax error
+        if (i + 1 < tokens->count && tokens->tokens[i + 1].type == TOK_WORD)
+            tokens->here_docs[token->offset] = read_here_doc(arena, token_text(tokens, i + 1),
+                                                             token->length);
+        else
+            tokens->here_docs[token->offset] = "";
+    }
+}
+
+/*
+ * run_block_pipeline: Runs one pipeline of a block (see control.h).
+ */
+static int run_block_pipeline(Arena *arena, const ParsedLine *line, const Pipeline *pipeline) {
+    const char *job_text = NULL;
+    if (pipeline->background) {
+        const StageRange *stages = line->stages + pipeline->first_stage;
+        job_text = pipeline_text(arena, &line->tokens, stages[0].start,
+                                 stages[pipeline->cmd_count - 1].end);
+    }
+    return run_pipeline(arena, line, pipeline, job_text);
+}
+
+/*
+ * run_block:
+ *
+ * Runs a line that uses for/while/until/if. The lines after it are read
+ * ("> " prompt) until every block it opens is closed, each lexed once and
+ * followed by the bodies of its here-documents; the whole block is then
+ * parsed into its command tree and run. 'first' is the parse of the first
+ * line, which leaves 'depth' blocks open.
+ */
+static void run_block(Arena *arena, const ParsedLine *first, int depth) {
+    int count = 1, capacity = 16;
+    TokenList **lines = arena_alloc(arena, capacity * sizeof(TokenList *));
+    lines[0] = arena_alloc(arena, sizeof(TokenList));
+    *lines[0] = first->tokens;
+    if (has_here_docs(lines[0]))
+        read_here_docs(arena, lines[0]);
+
+    while (depth > 0) {
+        char *text = read_line("> ");
+        if (text == NULL) {
+            fprintf(stderr, "myshell: syntax error: unexpected end of file in block\n");
+            last_status = 2;
+            return;
+        }
+        TokenList *tokens = parse_input(arena, text);
+        control_scan(tokens, &depth);
+        if (has_here_docs(tokens))
+            read_here_docs(arena, tokens);
+        if (count == capacity) {
+            capacity *= 2;
+            TokenList **grown = arena_alloc(arena, capacity * sizeof(TokenList *));
+            memcpy(grown, lines, count * sizeof(TokenList *));
+            lines = grown;
+        }
+        lines[count++] = tokens;
+    }
+
+    ControlBlock *block = control_parse(arena, control_join(arena, lines, count));
+    if (!block) {
+        last_status = 2;
+        return;
+    }
+    control_run(block, arena, run_block_pipeline);
+}
+
+/*
+ * run_line: Parses and executes one non-empty command line.
+ *
+ * The line's pipelines run in order; one after '&&' only runs if the
+ * status so far is 0, one after '||' only if it is not. A skipped pipeline
+ * leaves the status unchanged. The final status is kept in last_status ($?).
+ * The bodies of its here-documents are read first, from the following lines.
+ * A line with reserved words is run as a block (see run_block()).
+ * All parse state is allocated from 'arena'; only open fds are released here.
+ */
+static void run_line(Arena *arena, char *input) {
+    // Lex and split the line (or reuse the parse of an identical line)
+    ParsedLine *line = parse_cache_parse(arena, input);
+    if (!line) {
+        last_status = 2;
+        return;
+    }
+    int depth = 0;
+    if (control_scan(&line->tokens, &depth)) {
+        run_block(arena, line, depth);
+        return;
+    }
+    if (has_here_docs(&line->tokens)) {
+        // Reading the bodies replaces the input buffer holding the line
+        input = arena_strdup(arena, input);
+        read_here_docs(arena, &line->tokens);
+    }
+
+    for (int i = 0; i < line->pipeline_count; i++) {
+        const Pipeline *pipeline = &line->pipelines[i];
+        if ((pipeline->op == LIST_AND && last_status != 0) ||
+            (pipeline->op == LIST_OR && last_status == 0))
+            continue;
+
+        const char *job_text = input;
+        if (pipeline->background && line->pipeline_count > 1) {
+            const StageRange *stages = line->stages + pipeline->first_stage;
+            job_text = pipeline_text(arena, &line->tokens, stages[0].start,
+                                     stages[pipeline->cmd_count - 1].end);
+        }
+        int status = run_pipeline(arena, line, pipeline, job_text);
+        if (status < 0) {
+            // A syntax error ends the whole line, as a parse error would
+            last_status = 2;
+            break;
+        }
+        last_status = status;
+    }
+}
+
 /*
  * execute_line: Parses and executes a command line
+ *
+ * Tokens, argv arrays and Command structures live in the per-line arena,
+ * which is reset once the line has finished.
  */
 void execute_line(char *input) {
-    // Remove any trailing newline
-    input[strcspn(input, "\n")] = '\0';
-    
+    static Arena line_arena;
+
     // Skip empty lines
     if (input[0] == '\0') {
         return;
     }
     
-    // Parse input into tokens
-    char **tokens = parse_input(input);
-    if (!tokens || !tokens[0]) {
-        free_args(tokens);
-        return;
+    uint64_t traced = trace_begin();
+    if (traced)
+        input = arena_strdup(&line_arena, input);    // Here-documents reuse the buffer
+    run_line(&line_arena, input);
+    trace_end("line", traced, "status", last_status, input);
+    arena_reset(&line_arena);
+}
+
+/*
+ * serve_session: Runs the lines of a server connection, starting with
+ * 'first', and reports the status of each (see server.c).
+ */
+static int serve_session(int conn, char *first) {
+    InputSource input;
+    input_open_fd(&input, conn);
+    shell_input = &input;
+
+    for (char *line = first; line != NULL; line = read_line("")) {
+        jobs_poll(0);
+        execute_line(line);
+        fflush(stdout);
+        server_report(last_status);
     }
+    input_close(&input);
+    return last_status;
+}
 
-    // Check for built-in commands
-    if (handle_builtin(tokens)) {
-        free_args(tokens);
+/*
+ * load_rc:
+ *
+ * Sets the shell up from its rc file (see rcfile.c): restores the
+ * snapshot of an unchanged rc file, or runs the file's lines, never read
+ * from the terminal, and snapshots the result if they were all pure and
+ * succeeded. A missing rc file is not an error.
+ */
+static void load_rc(void) {
+    const char *path = rc_file();
+    if (!path)
+        return;
+    uint64_t traced = trace_begin();
+    if (rc_restore(path)) {
+        trace_end("rc", traced, "snapshot", 1, path);
         return;
     }
 
-    // Check for pipes
-    int cmd_count = 0;
-    char ***commands = split_pipeline(tokens, &cmd_count);
-    
-    if (!commands) {
-        free_args(tokens);
+    InputSource input;
+    if (input_open_file(&input, path) < 0) {
+        if (errno != ENOENT)
+            fprintf(stderr, "myshell: %s: %s\n", path, strerror(errno));
         return;
     }
+    InputSource *saved_input = shell_input;
+    int saved_interactive = interactive, saved_editing = editing;
+    shell_input = &input;
+    interactive = editing = 0;
 
-    if (cmd_count == 1) {
-        // Simple command without pipes
-        execute_command(tokens);
-    } else {
-        // Pipeline of commands
-        Command *cmd_structs = malloc(cmd_count * sizeof(Command));
-        if (!cmd_structs) {
-            perror("myshell: allocation error");
-            // Cleanup
-            for (int i = 0; i < cmd_count; i++) {
-                free_args(commands[i]);
-            }
-            free(commands);
-            free_args(tokens);
-            return;
-        }
+    int pure = 1;
+    char *line;
+    while ((line = read_line("")) != NULL) {
+        pure = pure && rc_line_pure(line);
+        execute_line(line);
+        pure = pure && last_status == 0;
+    }
+    input_close(&input);
+    shell_input = saved_input;
+    interactive = saved_interactive;
+    editing = saved_editing;
 
-        // Parse each command in the pipeline
-        int valid = 1;
-        for (int i = 0; i < cmd_count && valid; i++) {
-            int end = 0;
-            while (commands[i][end] != NULL) end++;
-            
-            Command *cmd = parse_command(commands[i], 0, end);
-            if (!cmd) {
-                valid = 0;
-                // Cleanup previously allocated commands
-                for (int j = 0; j < i; j++) {
-                    if (cmd_structs[j].args) free_args(cmd_structs[j].args);
-                    if (cmd_structs[j].input_fd != -1) close(cmd_structs[j].input_fd);
-                    if (cmd_structs[j].output_fd != -1) close(cmd_structs[j].output_fd);
-                    if (cmd_structs[j].error_fd != -1) close(cmd_structs[j].error_fd);
-                }
-            } else {
-                cmd_structs[i] = *cmd;
-                free(cmd);
-            }
-        }
+    if (pure)
+        rc_save(path);
+    trace_end("rc", traced, "snapshot", 0, path);
+}
 
-        if (valid) {
-            execute_pipeline(cmd_structs, cmd_count);
-        }
+/*
+ * main: Runs the shell
+ *
+ * With a script argument the shell executes the script's lines; otherwise
+ * it reads stdin. The prompt is only shown when reading from a terminal,
+ * so generated command streams are executed without prompt writes; on a
+ * capable terminal lines are read through the line editor. With
+ * '--server PATH' it serves clients on a Unix socket instead. The rc file
+ * is loaded first in every mode.
+ */
+int main(int argc, char **argv) {
+    InputSource input;
 
-        // Cleanup
-        for (int i = 0; i < cmd_count; i++) {
-            if (cmd_structs[i].args) free_args(cmd_structs[i].args);
-            if (cmd_structs[i].input_fd != -1) close(cmd_structs[i].input_fd);
-            if (cmd_structs[i].output_fd != -1) close(cmd_structs[i].output_fd);
-            if (cmd_structs[i].error_fd != -1) close(cmd_structs[i].error_fd);
-        }
-        free(cmd_structs);
+    if (argc > 3 || (argc == 3 && strcmp(argv[1], "--server") != 0) ||
+        (argc == 2 && strcmp(argv[1], "--server") == 0)) {
+        fprintf(stderr, "usage: myshell [script | --server socket]\n");
+        return 2;
     }
-
-    // Cleanup
-    for (int i = 0; i < cmd_count; i++) {
-        free_args(commands[i]);
+    if (argc == 3) {
+        vars_init();
+        trace_init();
+        jobs_init(0);
+        load_rc();
+        return server_run(argv[2], serve_session);
     }
-    free(commands);
-    free_args(tokens);
-}
+    if (argc == 2) {
+        if (input_open_file(&input, argv[1]) < 0) {
+            fprintf(stderr, "myshell: %s: %s\n", argv[1], strerror(errno));
+            return 127;
+        }
+    } else {
+        input_open_fd(&input, STDIN_FILENO);
+        interactive = isatty(STDIN_FILENO);
+        editing = lineedit_supported(STDIN_FILENO);
+    }
+    shell_input = &input;
 
-int main() {
-    char input[MAX_INPUT_SIZE];
+    vars_init();
+    trace_init();
+    jobs_init(interactive);
+    load_rc();
+    if (interactive)
+        history_init();
 
     // Main shell loop
     while (1) {
-        printf("$ ");
-        fflush(stdout);
+        // Collect finished background jobs; announce them before the prompt
+        jobs_poll(interactive);
 
-        if (fgets(input, sizeof(input), stdin) == NULL) {
-            printf("\n");
+        char *line = read_line("$ ");
+        if (line == NULL) {
+            if (interactive)
+                printf("\n");
             break;
         }
 
-        execute_line(input);
+        // Saved first: reading a here-document reuses the line's buffer
+        if (interactive)
+            history_add(line);
+        execute_line(line);
     }
 
-    return 0;
+    input_close(&input);
+    return last_status;
 }
@@ -0,0 +1,244 @@
+/*
+ * options.c - Shell Options
+ *
+ * This file holds the settings that tune how the shell executes commands
+ * and implements the 'set' builtin that inspects and changes them.
+ *
+ * Supported Options:
+ * - pipebuf=SIZE     Size every pipeline pipe with F_SETPIPE_SZ (K/M/G suffixes)
+ * - pipebuf=auto     Start at the kernel default and grow pipes seen full
+ * - pipebuf=default  Leave pipes at the kernel default (64 KiB on Linux)
+ * - timelog=FILE     Append a JSON timing record per pipeline stage to FILE
+ * - timelog=off      Stop logging timing records
+ * - -o/+o pipefail   A pipeline's status is that of its last failing stage
+ * - -o/+o trace      Record a trace of each line's phases (trace.c)
+ * - tracefile=FILE   Where the trace is written
+ * - cgroup=DIR       Start every command in cgroup v2 directory DIR
+ * - cgroup=off       Start commands in the shell's own cgroup
+ * - -o/+o spread     Pin background and parallel jobs to the CPUs in turn
+ *
+ * Setting a size reports the capacity the kernel actually grants, which
+ * is rounded up to a power-of-two number of pages and capped by
+ * /proc/sys/fs/pipe-max-size for unprivileged users.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include "options.h"
+#include "executor.h"
+#include "trace.h"
+#include "resources.h"
+
+ShellOptions shell_options = { 0, 0, NULL, NULL, 0, 0, -1, NULL };
+
+/*
+ * parse_size: Parses a byte count with an optional K, M or G suffix.
+ *
+ * Returns:
+ *   The size in bytes, or -1 if the value is not a positive size or does
+ *   not fit in a long.
+ */
+static long parse_size(const char *value) {
+    char *end;
+    errno = 0;
+    long size = strtol(value, &end, 10);
+    if (end == value || size <= 0 || errno != 0) {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || size > (LONG_MAX >> shift)) {
+        return -1;
+    }
+    return size << shift;
+}
+
+/*
+ * set_pipebuf: Applies 'pipebuf=<value>' and reports the granted size.
+ */
+static int set_pipebuf(const char *value) {
+    if (strcmp(value, "default") == 0) {
+        shell_options.pipe_buffer_size = 0;
+        shell_options.pipe_buffer_adaptive = 0;
+        return 0;
+    }
+    if (strcmp(value, "auto") == 0) {
+        shell_options.pipe_buffer_size = 0;
+        shell_options.pipe_buffer_adaptive = 1;
+        return 0;
+    }
+
+    long size = parse_size(value);
+    if (size < 0) {
+        fprintf(stderr, "myshell: set: pipebuf: invalid size: %s\n", value);
+        return 1;
+    }
+
+    // Probe what the kernel grants for this request
+    int probe[2];
+    if (pipe2(probe, O_CLOEXEC) < 0) {
+        perror("myshell: set: pipe");
+        return 1;
+    }
+    long granted = set_pipe_size(probe[1], size);
+    close(probe[0]);
+    close(probe[1]);
+    if (granted < 0) {
+        perror("myshell: set: pipebuf");
+        return 1;
+    }
+
+    shell_options.pipe_buffer_size = size;
+    shell_options.pipe_buffer_adaptive = 0;
+    printf("pipebuf: requested %ld bytes, granted %ld bytes\n", size, granted);
+    return 0;
+}
+
+/*
+ * set_timelog: Applies 'timelog=<file|off>'.
+ */
+static int set_timelog(const char *value) {
+    FILE *log = NULL;
+    char *path = NULL;
+
+    if (strcmp(value, "off") != 0) {
+        log = fopen(value, "ae");
+        path = strdup(value);
+        if (!log || !path) {
+            fprintf(stderr, "myshell: set: timelog: %s: %s\n", value, strerror(errno));
+            if (log)
+                fclose(log);
+            free(path);
+            return 1;
+        }
+    }
+
+    if (shell_options.time_log)
+        fclose(shell_options.time_log);
+    free(shell_options.time_log_path);
+    shell_options.time_log = log;
+    shell_options.time_log_path = path;
+    return 0;
+}
+
+/*
+ * set_cgroup: Applies 'cgroup=<dir|off>'.
+ */
+static int set_cgroup(const char *value) {
+    int fd = -1;
+    char *path = NULL;
+
+    if (strcmp(value, "off") != 0) {
+        fd = cgroup_open("set: cgroup", value);
+        if (fd < 0)
+            return 1;
+        path = strdup(value);
+        if (!path) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (shell_options.cgroup_fd >= 0)
+        close(shell_options.cgroup_fd);
+    free(shell_options.cgroup_path);
+    shell_options.cgroup_fd = fd;
+    shell_options.cgroup_path = path;
+    return 0;
+}
+
+/*
+ * option_value: Returns the value of 'arg' if it has the form 'name=value'.
+ */
+static const char *option_value(const char *arg, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) == 0 && arg[len] == '=')
+        return arg + len + 1;
+    return NULL;
+}
+
+/*
+ * flag_option: Returns the flag set with 'set -o name', or NULL.
+ */
+static int *flag_option(const char *name) {
+    if (strcmp(name, "pipefail") == 0)
+        return &shell_options.pipefail;
+    if (strcmp(name, "spread") == 0)
+        return &shell_options.spread;
+    return NULL;
+}
+
+/*
+ * set_builtin: Implements the 'set' builtin.
+ *
+ *   set              - list the current option values
+ *   set name=value   - change an option
+ *   set -o           - list the flag options
+ *   set -o name      - turn a flag option on ('+o' turns it off)
+ */
+int set_builtin(char **args) {
+    if (args[1] == NULL) {
+        if (shell_options.pipe_buffer_adaptive)
+            printf("pipebuf=auto\n");
+        else if (shell_options.pipe_buffer_size > 0)
+            printf("pipebuf=%ld\n", shell_options.pipe_buffer_size);
+        else
+            printf("pipebuf=default\n");
+        printf("timelog=%s\n", shell_options.time_log_path ? shell_options.time_log_path : "off");
+        printf("pipefail=%s\n", shell_options.pipefail ? "on" : "off");
+        printf("trace=%s\n", trace_enabled ? "on" : "off");
+        printf("tracefile=%s\n", trace_file());
+        printf("cgroup=%s\n", shell_options.cgroup_path ? shell_options.cgroup_path : "off");
+        printf("spread=%s\n", shell_options.spread ? "on" : "off");
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        const char *value;
+        if (strcmp(args[i], "-o") == 0 || strcmp(args[i], "+o") == 0) {
+            if (args[i + 1] == NULL) {
+                printf("pipefail\t%s\n", shell_options.pipefail ? "on" : "off");
+                printf("trace\t%s\n", trace_enabled ? "on" : "off");
+                printf("spread\t%s\n", shell_options.spread ? "on" : "off");
+                continue;
+            }
+            if (strcmp(args[i + 1], "trace") == 0) {
+                // Turning it on opens the file, off flushes it
+                status |= trace_set(args[i][0] == '-');
+                i++;
+                continue;
+            }
+            int *flag = flag_option(args[++i]);
+            if (flag == NULL) {
+                fprintf(stderr, "myshell: set: %s: invalid option name\n", args[i]);
+                status = 1;
+                continue;
+            }
+            *flag = args[i - 1][0] == '-';
+        } else if ((value = option_value(args[i], "pipebuf")) != NULL) {
+            status |= set_pipebuf(value);
+        } else if ((value = option_value(args[i], "timelog")) != NULL) {
+            status |= set_timelog(value);
+        } else if ((value = option_value(args[i], "tracefile")) != NULL) {
+            status |= trace_set_file(value);
+        } else if ((value = option_value(args[i], "cgroup")) != NULL) {
+            status |= set_cgroup(value);
+        } else {
+            fprintf(stderr, "myshell: set: %s: invalid option\n", args[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
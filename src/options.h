@@ -0,0 +1,24 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+
+// Shell-wide settings changed with the 'set' builtin
+typedef struct {
+    long pipe_buffer_size;      // Requested pipe capacity in bytes (0 = kernel default)
+    int pipe_buffer_adaptive;   // Grow pipes that are observed full
+    char *time_log_path;        // File receiving JSON timing records (NULL = off)
+    FILE *time_log;             // Open stream for time_log_path
+    int pipefail;               // A pipeline fails if any of its stages fails
+    int spread;                 // Pin background stages to the shell's CPUs in turn
+    int cgroup_fd;              // cgroup v2 directory children start in (-1 = the shell's)
+    char *cgroup_path;          // Its path, as given to 'set cgroup='
+} ShellOptions;
+
+extern ShellOptions shell_options;
+
+// Implements the 'set' builtin: 'set' lists options, 'set name=value' changes
+// one, 'set -o name' / 'set +o name' turns a flag option on / off
+int set_builtin(char **args);
+
+#endif // OPTIONS_H
@@ -0,0 +1,515 @@
+/*
+ * parallel.c - Parallel Command Execution
+ *
+ * This file implements the 'parallel' builtin, which runs one command per
+ * input argument with a bounded number of jobs in flight:
+ *
+ *   parallel [-j N] command... ::: arg...     arguments from the command line
+ *   parallel [-j N] command...                one argument per line of stdin
+ *
+ * Every '{}' in the command is replaced by the argument; without '{}' the
+ * argument is appended as a last word. The command words are joined and
+ * lexed again, so a quoted command may contain pipes and redirections:
+ *
+ *   parallel -j 8 'gzip -c {} > {}.gz' ::: *.log
+ *
+ * Key Components:
+ *
+ * 1. Templates:
+ *    - The command is lexed once; each job copies the token list, replaces
+ *      placeholders inside words and process substitutions (the argument
+ *      is never lexed itself) and goes through split_pipeline() and
+ *      parse_command() like a typed line
+ *
+ * 2. Scheduler:
+ *    - Up to N jobs (default: the number of online CPUs) run at once
+ *    - Only the slots' own processes are reaped, by pid, in exit order; each
+ *      finished job frees a slot that is refilled with the next argument
+ *    - Between sweeps the scheduler sleeps on the job table's SIGCHLD
+ *      signalfd (in a subshell, which has none, on a pidfd per process);
+ *      background jobs that change meanwhile are left to jobs_poll()
+ *
+ * 3. Output:
+ *    - Each job's stdout goes to its own memfd and is copied to the shell's
+ *      stdout when the job finishes, so outputs never interleave
+ *    - stderr is not buffered
+ *
+ * Implementation Details:
+ * - Jobs are spawned as processes through execute_background()
+ * - Parse state of a job lives in a scratch arena reset after its launch
+ * - A summary is printed to stderr when some jobs fail
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "parallel.h"
+#include "parser.h"
+#include "executor.h"
+#include "arena.h"
+#include "input.h"
+#include "jobs.h"
+#include "fastpath.h"
+#include "redirect.h"
+#include "procsub.h"
+
+#define PLACEHOLDER "{}"
+
+// A running job
+typedef struct {
+    pid_t *pids;    // Stages, then substitution processes; -1 once reaped
+                    // or never started
+    int count;      // Entries of 'pids' in use
+    int capacity;
+    int running;    // Processes not yet reaped (0 = free slot)
+    int out_fd;     // memfd holding the job's stdout (-1 if unbuffered)
+    int status;     // Wait status of the last stage
+} ParallelSlot;
+
+// Where arguments come from
+typedef struct {
+    char **argv;        // Arguments after ':::' (NULL to read stdin)
+    InputSource input;  // stdin reader
+} ArgumentSource;
+
+static Arena job_arena;
+
+/*
+ * next_argument: Returns the next argument, or NULL when exhausted.
+ * A line read from stdin stays valid until the next call.
+ */
+static const char *next_argument(ArgumentSource *src) {
+    if (src->argv)
+        return *src->argv ? *src->argv++ : NULL;
+    return input_next_line(&src->input);
+}
+
+/*
+ * count_placeholders: Counts occurrences of '{}' in a word.
+ */
+static int count_placeholders(const char *word) {
+    int n = 0;
+    for (const char *p = strstr(word, PLACEHOLDER); p; p = strstr(p + 2, PLACEHOLDER))
+        n++;
+    return n;
+}
+
+/*
+ * substitute: Builds the token list of one job from the template.
+ *
+ * Words keep their offsets' order in a new buffer; placeholders are
+ * replaced by 'arg'. If the template has no placeholder, 'arg' is added
+ * as the last word.
+ */
+static TokenList *substitute(Arena *arena, const TokenList *tmpl, const char *arg, int append) {
+    size_t arg_len = strlen(arg);
+    size_t size = 0;
+    for (int i = 0; i < tmpl->count; i++) {
+        if (token_is_word(tmpl->tokens[i].type)) {
+            const char *word = token_text(tmpl, i);
+            size += tmpl->tokens[i].length + 1 + count_placeholders(word) * arg_len;
+        }
+    }
+    if (append)
+        size += arg_len + 1;
+
+    TokenList *list = arena_alloc(arena, sizeof(TokenList));
+    list->capacity = tmpl->count + 1;
+    list->count = 0;
+    list->tokens = arena_alloc(arena, list->capacity * sizeof(Token));
+    list->buf = arena_alloc(arena, size + 1);
+
+    char *out = list->buf;
+    for (int i = 0; i < tmpl->count; i++) {
+        Token *token = &list->tokens[list->count++];
+        *token = tmpl->tokens[i];
+        if (!token_is_word(token->type))
+            continue;
+
+        char *word = out;
+        const char *p = token_text(tmpl, i);
+        const char *hole;
+        while ((hole = strstr(p, PLACEHOLDER)) != NULL) {
+            memcpy(out, p, hole - p);
+            out += hole - p;
+            memcpy(out, arg, arg_len);
+            out += arg_len;
+            p = hole + 2;
+        }
+        size_t rest = strlen(p);
+        memcpy(out, p, rest + 1);
+        out += rest + 1;
+        token->offset = (int)(word - list->buf);
+        token->length = (int)(out - word - 1);
+    }
+
+    if (append) {
+        Token *token = &list->tokens[list->count++];
+        token->type = TOK_WORD;
+        token->offset = (int)(out - list->buf);
+        token->length = (int)arg_len;
+        memcpy(out, arg, arg_len + 1);
+    }
+    return list;
+}
+
+/*
+ * slot_reserve: Makes room for 'count' pids in a slot.
+ */
+static void slot_reserve(ParallelSlot *slot, int count) {
+    if (count <= slot->capacity)
+        return;
+    pid_t *pids = realloc(slot->pids, count * sizeof(pid_t));
+    if (!pids) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    slot->pids = pids;
+    slot->capacity = count;
+}
+
+/*
+ * start_job: Parses and launches the job for 'arg' in 'slot'.
+ *
+ * The job's substitution processes follow its stages in the slot, so the
+ * job is only done once they have exited too.
+ *
+ * Returns:
+ *   0 if at least one stage is running, -1 if the job failed to start.
+ */
+static int start_job(ParallelSlot *slot, const TokenList *tmpl, int append, const char *arg) {
+    TokenList *tokens = substitute(&job_arena, tmpl, arg, append);
+    int cmd_count = 0;
+    int launched = 0;
+    StageRange *stages = split_pipeline(&job_arena, tokens, &cmd_count);
+    Command *cmds = stages ? arena_alloc(&job_arena, cmd_count * sizeof(Command)) : NULL;
+    int parsed = 0;
+    int ready = cmds != NULL;
+
+    while (ready && parsed < cmd_count) {
+        Command *cmd = parse_command(&job_arena, tokens, stages[parsed].start, stages[parsed].end);
+        if (!cmd)
+            break;
+        cmds[parsed++] = *cmd;
+        ready = procsub_start(&job_arena, &cmds[parsed - 1]) == 0;
+    }
+
+    slot->out_fd = -1;
+    int subs = 0;
+    for (int i = 0; i < parsed; i++)
+        subs += procsub_pids(&cmds[i], NULL);
+    slot_reserve(slot, cmd_count + subs);
+    if (ready && parsed == cmd_count) {
+        // Capture stdout unless the template redirects it
+        Command *last = &cmds[cmd_count - 1];
+        if (!redirects_fd(last, STDOUT_FILENO)) {
+            slot->out_fd = memfd_create("parallel", MFD_CLOEXEC);
+            last->output_fd = slot->out_fd;
+        }
+        launched = execute_background(cmds, cmd_count, slot->pids, NULL);
+        if (last->output_fd == slot->out_fd)
+            last->output_fd = -1;
+    }
+
+    for (int i = launched; i < cmd_count; i++)
+        slot->pids[i] = -1;
+
+    // Substitution processes of a running job are reaped like its stages
+    slot->count = cmd_count;
+    for (int i = 0; i < parsed; i++) {
+        close_command_fds(&cmds[i]);
+        if (launched == 0)
+            procsub_finish(&cmds[i]);
+        else
+            slot->count += procsub_pids(&cmds[i], slot->pids + slot->count);
+    }
+    arena_reset(&job_arena);
+
+    slot->running = 0;
+    slot->status = 127 << 8;
+    for (int i = 0; i < slot->count; i++) {
+        if (slot->pids[i] > 0)
+            slot->running++;
+    }
+
+    if (slot->running == 0) {
+        if (slot->out_fd != -1)
+            close(slot->out_fd);
+        slot->out_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * finish_job: Writes a finished job's buffered output to stdout.
+ */
+static void finish_job(ParallelSlot *slot) {
+    if (slot->out_fd == -1)
+        return;
+    if (lseek(slot->out_fd, 0, SEEK_SET) == 0) {
+        int err = fastpath_copy(slot->out_fd, STDOUT_FILENO);
+        if (err != 0 && err != EPIPE)
+            fprintf(stderr, "myshell: parallel: %s\n", strerror(err));
+    }
+    close(slot->out_fd);
+    slot->out_fd = -1;
+}
+
+/*
+ * sweep_slots: Reaps the slots' processes that have exited, without
+ * blocking, until one finishes its job. *live receives the number of
+ * processes still running.
+ *
+ * Returns:
+ *   The slot whose job just finished, or NULL if none did.
+ */
+static ParallelSlot *sweep_slots(ParallelSlot *slots, int jobs, int stages, int *live) {
+    *live = 0;
+    for (int i = 0; i < jobs; i++) {
+        for (int j = 0; slots[i].running > 0 && j < slots[i].count; j++) {
+            pid_t pid = slots[i].pids[j];
+            if (pid <= 0)
+                continue;
+            int status;
+            pid_t reaped = waitpid(pid, &status, WNOHANG);
+            if (reaped == 0 || (reaped < 0 && errno != ECHILD)) {
+                (*live)++;
+                continue;
+            }
+            // ECHILD: gone without a status, which the job cannot report
+            slots[i].pids[j] = -1;
+            if (reaped == pid && j == stages - 1)
+                slots[i].status = status;
+            if (--slots[i].running == 0)
+                return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * open_pidfd: Returns a close-on-exec pidfd for a child, or -1.
+ */
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * wait_slots: Sleeps until one of the 'live' slot processes may have
+ * exited: on the SIGCHLD signalfd, else on a pidfd per process, else
+ * (without pidfds) until the first one exits, which is left unreaped.
+ */
+static void wait_slots(ParallelSlot *slots, int jobs, int live) {
+    int signal_fd = jobs_signal_fd();
+    if (signal_fd >= 0) {
+        struct pollfd pfd = { signal_fd, POLLIN, 0 };
+        poll(&pfd, 1, -1);
+        return;
+    }
+
+    struct pollfd *pfds = malloc(live * sizeof(struct pollfd));
+    if (!pfds) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    int opened = 0, failed = 0;
+    pid_t first = -1;
+    for (int i = 0; i < jobs && !failed; i++) {
+        for (int j = 0; slots[i].running > 0 && j < slots[i].count && !failed; j++) {
+            pid_t pid = slots[i].pids[j];
+            if (pid <= 0 || opened == live)
+                continue;
+            if (first < 0)
+                first = pid;
+            pfds[opened].fd = open_pidfd(pid);
+            pfds[opened].events = POLLIN;
+            failed = pfds[opened].fd < 0;
+            if (!failed)
+                opened++;
+        }
+    }
+    if (!failed)
+        poll(pfds, opened, -1);
+    for (int k = 0; k < opened; k++)
+        close(pfds[k].fd);
+    free(pfds);
+    if (failed && first > 0) {
+        siginfo_t info;
+        waitid(P_PID, first, &info, WEXITED | WNOWAIT);
+    }
+}
+
+/*
+ * reap_one: Waits until a job finishes. Job table children that change
+ * state meanwhile are collected by jobs_poll(), which also drains the
+ * signalfd before each sweep, so an exit after the sweep still wakes the
+ * wait.
+ *
+ * Returns:
+ *   The slot whose job just finished, or NULL (with *no_children set) if
+ *   no slot process is left.
+ */
+static ParallelSlot *reap_one(ParallelSlot *slots, int jobs, int stages, int *no_children) {
+    while (1) {
+        jobs_poll(0);
+        int live;
+        ParallelSlot *done = sweep_slots(slots, jobs, stages, &live);
+        if (done)
+            return done;
+        if (live == 0) {
+            *no_children = 1;
+            return NULL;
+        }
+        wait_slots(slots, jobs, live);
+    }
+}
+
+/*
+ * parse_jobs: Parses the value of '-j'; 0 if invalid.
+ */
+static int parse_jobs(const char *value) {
+    char *end;
+    long n = value ? strtol(value, &end, 10) : 0;
+    if (value == NULL || *value == '\0' || *end != '\0' || n < 1 || n > 4096)
+        return 0;
+    return (int)n;
+}
+
+/*
+ * template_line: Joins the command words into one line for the lexer.
+ */
+static char *template_line(char **words, int count) {
+    size_t size = 1;
+    for (int i = 0; i < count; i++)
+        size += strlen(words[i]) + 1;
+    char *line = malloc(size);
+    if (!line) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    char *out = line;
+    for (int i = 0; i < count; i++) {
+        out += sprintf(out, i == 0 ? "%s" : " %s", words[i]);
+    }
+    *out = '\0';
+    return line;
+}
+
+/*
+ * parallel_builtin: Implements 'parallel'.
+ *
+ * Returns 0 if every job succeeded, 1 if some failed, 2 on usage errors.
+ */
+int parallel_builtin(char **args) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_jobs = cpus > 0 ? (int)cpus : 1;
+    int i = 1;
+
+    // '-j N' or '-jN'
+    if (args[i] != NULL && strncmp(args[i], "-j", 2) == 0) {
+        const char *value = args[i][2] != '\0' ? args[i] + 2 : args[i + 1];
+        max_jobs = parse_jobs(value);
+        if (max_jobs == 0) {
+            fprintf(stderr, "myshell: parallel: -j: invalid job count\n");
+            return 2;
+        }
+        i += args[i][2] != '\0' ? 1 : 2;
+    }
+
+    int first = i;
+    while (args[i] != NULL && strcmp(args[i], ":::") != 0)
+        i++;
+    if (i == first) {
+        fprintf(stderr, "usage: parallel [-j N] command... [::: arg...]\n");
+        return 2;
+    }
+
+    // Lex the template once; the scratch arena belongs to this builtin
+    Arena tmpl_arena;
+    arena_init(&tmpl_arena);
+    char *line = template_line(&args[first], i - first);
+    TokenList *tmpl = parse_input(&tmpl_arena, line);
+    int stages = 0;
+    int append = 1;
+    for (int t = 0; t < tmpl->count; t++) {
+        if (token_is_word(tmpl->tokens[t].type) && strstr(token_text(tmpl, t), PLACEHOLDER))
+            append = 0;
+    }
+    if (split_pipeline(&tmpl_arena, tmpl, &stages) == NULL) {
+        free(line);
+        arena_free(&tmpl_arena);
+        return 2;
+    }
+
+    ArgumentSource src;
+    src.argv = args[i] != NULL ? &args[i + 1] : NULL;
+    if (src.argv == NULL)
+        input_open_fd(&src.input, STDIN_FILENO);
+
+    ParallelSlot *slots = calloc(max_jobs, sizeof(ParallelSlot));
+    if (!slots) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Buffered job output is written to fd 1 directly
+    fflush(stdout);
+
+    int in_flight = 0, total = 0, failed = 0, exhausted = 0;
+    while (1) {
+        // Fill free slots
+        for (int s = 0; s < max_jobs && !exhausted; s++) {
+            if (slots[s].running > 0)
+                continue;
+            const char *arg = next_argument(&src);
+            if (arg == NULL) {
+                exhausted = 1;
+                break;
+            }
+            total++;
+            if (start_job(&slots[s], tmpl, append, arg) == 0)
+                in_flight++;
+            else
+                failed++;
+        }
+        if (in_flight == 0)
+            break;
+
+        int no_children = 0;
+        ParallelSlot *done = reap_one(slots, max_jobs, stages, &no_children);
+        if (no_children)
+            break;
+        if (done == NULL)
+            continue;
+        in_flight--;
+        finish_job(done);
+        if (!WIFEXITED(done->status) || WEXITSTATUS(done->status) != 0)
+            failed++;
+    }
+
+    if (failed > 0)
+        fprintf(stderr, "myshell: parallel: %d of %d jobs failed\n", failed, total);
+
+    if (src.argv == NULL)
+        input_close(&src.input);
+    for (int s = 0; s < max_jobs; s++)
+        free(slots[s].pids);
+    free(slots);
+    free(line);
+    arena_free(&tmpl_arena);
+    return failed > 0 ? 1 : 0;
+}
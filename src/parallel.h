@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Implements the 'parallel' builtin:
+//   parallel [-j N] command... [::: arg...]
+// runs the command once per argument (or per line of stdin), with up to N
+// jobs at a time, replacing '{}' in the command with the argument.
+// Returns 0 if every job succeeded.
+int parallel_builtin(char **args);
+
+#endif // PARALLEL_H
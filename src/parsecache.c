@@ -0,0 +1,301 @@
+/*
+ * parsecache.c - Parse Cache
+ *
+ * This file memoizes the lexing and pipeline splitting of command lines.
+ * Scripts and loops run the same line text over and over; once a line has
+ * been parsed, its immutable parsed form (token types, unquoted words and
+ * stage ranges) is kept, and a repeated line skips parse_input() and
+ * split_pipeline() entirely. Only parse_command(), which builds argv and
+ * expands words, still runs for every execution.
+ *
+ * Key Components:
+ *
+ * 1. Entries:
+ *    - A copy of the line text and one block holding the tokens, stage
+ *      ranges, pipelines and word buffer of its ParsedLine
+ *    - A hit copies the block into the per-line arena with one memcpy(), so
+ *      the caller owns its copy and eviction never invalidates a running line
+ *
+ * 2. Index:
+ *    - Open addressing with linear probing over a 64-bit FNV-1a hash of the
+ *      line, with backward-shift deletion (as in pathcache.c)
+ *    - Equal hashes are confirmed by comparing the line text
+ *
+ * 3. Eviction:
+ *    - Entries form a doubly linked LRU list; a full cache drops its least
+ *      recently used line
+ *
+ * Implementation Details:
+ * - Lines with syntax errors are never cached, so their diagnostics repeat
+ * - Very long lines are parsed without caching them
+ * - 'parsecache' prints entries, hits, misses and evictions; '-r' clears
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "parsecache.h"
+#include "trace.h"
+
+#define PARSE_CACHE_ENTRIES 256
+#define PARSE_CACHE_SLOTS (2 * PARSE_CACHE_ENTRIES)   // Power of two
+#define PARSE_CACHE_MAX_LINE 4096
+
+typedef struct {
+    uint64_t hash;
+    char *line;             // NULL for an unused entry
+    char *block;            // Tokens, stage ranges, pipelines, then the word buffer
+    size_t block_size;
+    int token_count;
+    int pipeline_count;
+    size_t stages_offset;
+    size_t pipelines_offset;
+    size_t buf_offset;
+    int prev, next;         // LRU list (most recent first), -1 terminated
+} CacheEntry;
+
+static CacheEntry entries[PARSE_CACHE_ENTRIES];
+static int slots[PARSE_CACHE_SLOTS];  // Entry index, or -1
+static int initialized = 0;
+static int used = 0;
+static int lru_head = -1, lru_tail = -1;
+static unsigned long hits = 0, misses = 0, evictions = 0;
+
+/*
+ * hash_line: 64-bit FNV-1a hash of a command line.
+ */
+static uint64_t hash_line(const char *line) {
+    uint64_t h = 14695981039346656037ull;
+    for (const unsigned char *p = (const unsigned char *)line; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void init_cache(void) {
+    for (int i = 0; i < PARSE_CACHE_SLOTS; i++)
+        slots[i] = -1;
+    initialized = 1;
+}
+
+/*
+ * find_slot: Returns the slot holding 'line', or the empty slot where it
+ * would be inserted.
+ */
+static size_t find_slot(const char *line, uint64_t hash) {
+    size_t mask = PARSE_CACHE_SLOTS - 1;
+    size_t i = hash & mask;
+    while (slots[i] != -1) {
+        CacheEntry *e = &entries[slots[i]];
+        if (e->hash == hash && strcmp(e->line, line) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void lru_unlink(int index) {
+    CacheEntry *e = &entries[index];
+    if (e->prev != -1)
+        entries[e->prev].next = e->next;
+    else
+        lru_head = e->next;
+    if (e->next != -1)
+        entries[e->next].prev = e->prev;
+    else
+        lru_tail = e->prev;
+}
+
+static void lru_push_front(int index) {
+    CacheEntry *e = &entries[index];
+    e->prev = -1;
+    e->next = lru_head;
+    if (lru_head != -1)
+        entries[lru_head].prev = index;
+    lru_head = index;
+    if (lru_tail == -1)
+        lru_tail = index;
+}
+
+/*
+ * remove_slot: Empties slot 'i' and shifts later entries of the same probe
+ * run back so lookups never stop at a hole. Returns the freed entry index.
+ */
+static int remove_slot(size_t i) {
+    size_t mask = PARSE_CACHE_SLOTS - 1;
+    int index = slots[i];
+    slots[i] = -1;
+
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (slots[j] == -1)
+            break;
+        size_t home = entries[slots[j]].hash & mask;
+        // Move the entry back if its home slot is not in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            slots[i] = slots[j];
+            slots[j] = -1;
+            i = j;
+        }
+    }
+
+    CacheEntry *e = &entries[index];
+    lru_unlink(index);
+    free(e->line);
+    free(e->block);
+    e->line = NULL;
+    e->block = NULL;
+    used--;
+    return index;
+}
+
+/*
+ * restore: Rebuilds a ParsedLine in 'arena' from a cache entry.
+ */
+static ParsedLine *restore(Arena *arena, const CacheEntry *e) {
+    char *block = arena_alloc(arena, e->block_size);
+    memcpy(block, e->block, e->block_size);
+
+    ParsedLine *line = arena_alloc(arena, sizeof(ParsedLine));
+    line->tokens.tokens = (Token *)block;
+    line->tokens.count = e->token_count;
+    line->tokens.capacity = e->token_count;
+    line->tokens.buf = block + e->buf_offset;
+    line->tokens.here_docs = NULL;
+    line->stages = (StageRange *)(block + e->stages_offset);
+    line->pipelines = (Pipeline *)(block + e->pipelines_offset);
+    line->pipeline_count = e->pipeline_count;
+    return line;
+}
+
+/*
+ * store: Copies a freshly parsed line into entry 'index'.
+ */
+static void store(int index, const char *input, uint64_t hash, const ParsedLine *line) {
+    CacheEntry *e = &entries[index];
+    const TokenList *tokens = &line->tokens;
+
+    // Only the used part of the word buffer is kept
+    size_t buf_size = 0;
+    for (int i = 0; i < tokens->count; i++) {
+        if (token_is_word(tokens->tokens[i].type)) {
+            size_t end = tokens->tokens[i].offset + tokens->tokens[i].length + 1;
+            if (end > buf_size)
+                buf_size = end;
+        }
+    }
+
+    const Pipeline *last = &line->pipelines[line->pipeline_count - 1];
+    size_t tokens_size = tokens->count * sizeof(Token);
+    size_t stages_size = (last->first_stage + last->cmd_count) * sizeof(StageRange);
+    size_t pipelines_size = line->pipeline_count * sizeof(Pipeline);
+    e->stages_offset = tokens_size;
+    e->pipelines_offset = e->stages_offset + stages_size;
+    e->buf_offset = e->pipelines_offset + pipelines_size;
+    e->block_size = e->buf_offset + buf_size;
+    e->block = malloc(e->block_size ? e->block_size : 1);
+    e->line = strdup(input);
+    if (!e->block || !e->line) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(e->block, tokens->tokens, tokens_size);
+    memcpy(e->block + e->stages_offset, line->stages, stages_size);
+    memcpy(e->block + e->pipelines_offset, line->pipelines, pipelines_size);
+    memcpy(e->block + e->buf_offset, tokens->buf, buf_size);
+    e->hash = hash;
+    e->token_count = tokens->count;
+    e->pipeline_count = line->pipeline_count;
+}
+
+/*
+ * parse_cache_parse: Parses a command line through the cache.
+ *
+ * Parameters:
+ *   arena - The per-line arena that receives the ParsedLine.
+ *   input - The command line.
+ *
+ * Returns:
+ *   The parsed line, or NULL if it has syntax errors.
+ */
+ParsedLine *parse_cache_parse(Arena *arena, const char *input) {
+    if (strlen(input) > PARSE_CACHE_MAX_LINE)
+        return parse_line(arena, input);
+    if (!initialized)
+        init_cache();
+
+    uint64_t hash = hash_line(input);
+    size_t slot = find_slot(input, hash);
+    if (slots[slot] != -1) {
+        int index = slots[slot];
+        hits++;
+        lru_unlink(index);
+        lru_push_front(index);
+        uint64_t traced = trace_begin();
+        ParsedLine *line = restore(arena, &entries[index]);
+        trace_end("restore", traced, "pipelines", line->pipeline_count, NULL);
+        return line;
+    }
+
+    misses++;
+    ParsedLine *line = parse_line(arena, input);
+    if (line == NULL || line->pipeline_count == 0)
+        return line;
+
+    int index;
+    if (used == PARSE_CACHE_ENTRIES) {
+        const CacheEntry *victim = &entries[lru_tail];
+        index = remove_slot(find_slot(victim->line, victim->hash));
+        evictions++;
+        // Deletion may have shifted the probe run of the new line
+        slot = find_slot(input, hash);
+    } else {
+        index = 0;
+        while (entries[index].line != NULL)
+            index++;
+    }
+
+    store(index, input, hash, line);
+    slots[slot] = index;
+    lru_push_front(index);
+    used++;
+    return line;
+}
+
+void parse_cache_clear(void) {
+    if (!initialized)
+        return;
+    while (lru_head != -1) {
+        const CacheEntry *e = &entries[lru_head];
+        remove_slot(find_slot(e->line, e->hash));
+    }
+}
+
+/*
+ * parse_cache_builtin: Implements the 'parsecache' builtin.
+ *
+ *   parsecache     - print the cache size and hit/miss/eviction counters
+ *   parsecache -r  - forget every cached line
+ */
+int parse_cache_builtin(char **args) {
+    if (args[1] != NULL && strcmp(args[1], "-r") == 0) {
+        parse_cache_clear();
+        return 0;
+    }
+    if (args[1] != NULL) {
+        fprintf(stderr, "myshell: parsecache: %s: invalid option\n", args[1]);
+        return 1;
+    }
+
+    unsigned long lookups = hits + misses;
+    printf("entries\t%d/%d\n", used, PARSE_CACHE_ENTRIES);
+    printf("hits\t%lu\n", hits);
+    printf("misses\t%lu\n", misses);
+    printf("evictions\t%lu\n", evictions);
+    printf("hit rate\t%.1f%%\n", lookups ? 100.0 * hits / lookups : 0.0);
+    return 0;
+}
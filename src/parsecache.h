@@ -0,0 +1,17 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include "parser.h"
+#include "arena.h"
+
+// Returns the parsed form of 'input' in 'arena', from the cache when the
+// same line was parsed before. Returns NULL on syntax errors (not cached).
+ParsedLine *parse_cache_parse(Arena *arena, const char *input);
+
+// Drops every cached line (the counters are kept)
+void parse_cache_clear(void);
+
+// Implements the 'parsecache' builtin: statistics, or '-r' to clear
+int parse_cache_builtin(char **args);
+
+#endif // PARSECACHE_H
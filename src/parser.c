@@ -7,19 +7,25 @@
  * Key Components:
  * 
  * 1. Input Tokenization:
- *    - Splits input into tokens while preserving quoted strings
- *    - Handles whitespace and special characters
- *    - Manages dynamic memory for tokens
+ *    - Scans the line once, classifying bytes through a lookup table
+ *    - Copies unquoted word bytes into a single token buffer
+ *    - Emits typed tokens (words, |, <, >, >>, 2>, <<, <<<, &, ;, &&, ||)
+ *      with buffer offsets
+ *    - Keeps the text of process substitutions (<(...), >(...)) raw, to be
+ *      parsed again when they are started (procsub.c)
  * 
  * 2. Command Structure:
- *    - Parses redirection operators (<, >, 2>, >>)
+ *    - Records redirection operators (<, >, 2>, >>, <<, <<<) as a plan
+ *      that is opened when the command starts
  *    - Handles pipeline operators (|)
+ *    - Splits lines into lists of pipelines joined by ;, &&, || and &
+ *      (and the pipelines of a for/while/if block for control.c)
  *    - Creates command structures for execution
  * 
  * 3. Memory Management:
- *    - Allocates memory for tokens and commands
- *    - Provides cleanup functions for all allocated resources
- *    - Handles allocation failures gracefully
+ *    - Allocates tokens, argv arrays and commands from the per-line arena
+ *    - Shares token strings by pointer between pipeline stages and argv
+ *    - Everything is released at once when the arena is reset
  * 
  * Special Handling:
  * - Quoted strings (both single and double quotes)
@@ -39,315 +45,639 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
-#include <ctype.h>
 #include "parser.h"
 #include "executor.h"
+#include "arena.h"
+#include "expand.h"
+#include "vars.h"
+#include "trace.h"
 
-#define TOKEN_DELIM " \t\r\n\a"
 #define INITIAL_TOKENS_SIZE 64
 
+// Lexical classes of input bytes
+enum {
+    CH_WORD = 0,    // Ordinary word byte
+    CH_SPACE,       // Token separator
+    CH_QUOTE,       // ' or "
+    CH_OPERATOR,    // |, <, >, & or ;
+    CH_EXPAND,      // $ or the escape byte (see expand.h)
+    CH_WILDCARD     // *, ? or [
+};
+
+static const unsigned char char_class[256] = {
+    [' '] = CH_SPACE, ['\t'] = CH_SPACE, ['\n'] = CH_SPACE, ['\r'] = CH_SPACE,
+    ['\a'] = CH_SPACE, ['\v'] = CH_SPACE, ['\f'] = CH_SPACE,
+    ['"'] = CH_QUOTE, ['\''] = CH_QUOTE,
+    ['|'] = CH_OPERATOR, ['<'] = CH_OPERATOR, ['>'] = CH_OPERATOR,
+    ['&'] = CH_OPERATOR, [';'] = CH_OPERATOR,
+    ['$'] = CH_EXPAND, [EXPAND_ESCAPE] = CH_EXPAND, [EXPAND_SPLIT] = CH_EXPAND,
+    ['*'] = CH_WILDCARD, ['?'] = CH_WILDCARD, ['['] = CH_WILDCARD
+};
+
+/*
+ * add_token: Appends a token to the list, doubling its capacity as needed.
+ */
+static void add_token(Arena *arena, TokenList *list, TokenType type, int offset, int length, int expand) {
+    if (list->count >= list->capacity) {
+        Token *grown = arena_alloc(arena, 2 * list->capacity * sizeof(Token));
+        memcpy(grown, list->tokens, list->count * sizeof(Token));
+        list->tokens = grown;
+        list->capacity *= 2;
+    }
+    list->tokens[list->count].type = type;
+    list->tokens[list->count].offset = offset;
+    list->tokens[list->count].length = length;
+    list->tokens[list->count].expand = expand;
+    list->count++;
+}
+
 /*
- * parse_input: Splits the input string into tokens based on whitespace.
+ * substitution_end:
  *
- * Parameters:
- *   input - a string containing the user's input.
+ * Finds the ')' closing a process or command substitution whose text
+ * starts at 'p', skipping nested parentheses and quoted runs. An
+ * unterminated substitution extends to the end of the line, like a quote.
+ */
+const char *substitution_end(const char *p, const char *end) {
+    int depth = 0;
+    for (; p < end; p++) {
+        if (*p == '\'' || *p == '"') {
+            const char *close = memchr(p + 1, *p, end - p - 1);
+            if (!close)
+                return end;
+            p = close;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && depth-- == 0) {
+            return p;
+        }
+    }
+    return end;
+}
+
+/*
+ * copy_command_sub:
+ *
+ * Copies the command substitution starting at 'p' (at its '$(') to *out
+ * unchanged, behind 'marker' unless it is 0, and advances *out. Its text
+ * is lexed again when it runs (see expand.c).
  *
  * Returns:
- *   A dynamically allocated array of strings (tokens), terminated by NULL.
- *   It is the caller's responsibility to free the memory using free_args.
- *   Returns NULL if memory allocation fails.
+ *   The position after its closing ')'.
+ */
+static const char *copy_command_sub(char **out, const char *p, const char *end, char marker) {
+    const char *close = substitution_end(p + 2, end);
+    const char *stop = close < end ? close + 1 : end;
+    if (marker)
+        *(*out)++ = marker;
+    memcpy(*out, p, stop - p);
+    *out += stop - p;
+    return stop;
+}
+
+/*
+ * quoted_plain: Returns 1 if the quoted run [p, p + n) can be copied as is:
+ * it holds no '$', wildcard or marker byte.
  */
-char **parse_input(const char *input) {
-    int tokens_size = INITIAL_TOKENS_SIZE;
-    int position = 0;
-    char **tokens = malloc(tokens_size * sizeof(char*));
-    if (!tokens) {
-        fprintf(stderr, "myshell: allocation error\n");
-        exit(EXIT_FAILURE);
+static int quoted_plain(const char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int cls = char_class[(unsigned char)p[i]];
+        if (cls == CH_EXPAND || cls == CH_WILDCARD)
+            return 0;
     }
-    
-    char *input_copy = strdup(input);
-    if (!input_copy) {
-        fprintf(stderr, "myshell: allocation error\n");
-        exit(EXIT_FAILURE);
+    return 1;
+}
+
+/*
+ * quote_end: Returns the quote closing the run opened at 'p', or NULL if
+ * there is none. A command substitution inside double quotes may contain
+ * quotes of its own.
+ */
+static const char *quote_end(const char *p, const char *end) {
+    if (*p == '\'')
+        return memchr(p + 1, '\'', end - p - 1);
+    for (const char *q = p + 1; q < end; q++) {
+        if (*q == '"')
+            return q;
+        if (*q == '$' && q + 1 < end && q[1] == '(') {
+            q = substitution_end(q + 2, end);
+            if (q == end)
+                return NULL;
+        }
     }
-    
-    // Handle quotes properly
-    int len = strlen(input_copy);
-    int i = 0;
-    while (i < len) {
-        // Skip leading whitespace
-        while (i < len && isspace(input_copy[i])) {
-            i++;
+    return NULL;
+}
+
+/*
+ * delimiter_quoted: Returns 1 if the word starting at 'p' (after blanks)
+ * contains quotes, which makes a here-document's body literal.
+ */
+static int delimiter_quoted(const char *p, const char *end) {
+    while (p < end && char_class[(unsigned char)*p] == CH_SPACE)
+        p++;
+    for (; p < end; p++) {
+        int cls = char_class[(unsigned char)*p];
+        if (cls == CH_QUOTE)
+            return 1;
+        if (cls == CH_SPACE || cls == CH_OPERATOR)
+            break;
+    }
+    return 0;
+}
+
+/*
+ * parse_input: Splits the input string into typed tokens.
+ *
+ * The line is scanned exactly once. Word bytes are copied (without their
+ * quotes) into one buffer, where each word is NUL-terminated; operators
+ * outside quotes become PIPE/REDIR/list tokens even without surrounding
+ * spaces. A quoted empty string produces an empty word. '<(' and '>(' start
+ * a process substitution token holding the text up to the matching ')'.
+ * '<<' and '<<-' number the line's here-documents, whose bodies are read
+ * later (see TokenList.here_docs); '<<<' starts a here-string.
+ *
+ * Words containing '$' are flagged for expansion. Inside single quotes a
+ * '$' must stay literal, so it is written behind EXPAND_ESCAPE (as are the
+ * marker bytes themselves wherever they occur) and removed by expand_word().
+ * Quoted wildcards ('*', '?', '[') are escaped the same way, so only
+ * unquoted ones match file names.
+ * A command substitution '$(...)' is kept raw; outside double quotes it is
+ * marked with EXPAND_SPLIT, as its output is split into words, and so is
+ * an unquoted variable ('$NAME', '${NAME}').
+ *
+ * Parameters:
+ *   arena - The per-line arena that owns the token list.
+ *   input - a string containing the user's input.
+ *
+ * Returns:
+ *   An arena-allocated token list. The memory is released when the arena
+ *   is reset.
+ */
+TokenList *parse_input(Arena *arena, const char *input) {
+    size_t len = strlen(input);
+    TokenList *list = arena_alloc(arena, sizeof(TokenList));
+    list->capacity = INITIAL_TOKENS_SIZE;
+    list->count = 0;
+    list->tokens = arena_alloc(arena, list->capacity * sizeof(Token));
+    // Every NUL replaces a separator, an operator or a quote (or the end of
+    // the input); escaping or marking a '$(' at most doubles a byte
+    list->buf = arena_alloc(arena, 2 * len + 1);
+    list->here_docs = NULL;
+    int here_docs = 0;
+
+    const char *p = input;
+    const char *end = input + len;
+    char *out = list->buf;
+
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        int cls = char_class[c];
+
+        if (cls == CH_SPACE) {
+            p++;
+            continue;
         }
-        if (i >= len) break;
-
-        // Start of a new token
-        int start = i;
-        int in_quotes = 0;
-        char quote_char = 0;
-
-        // Find end of token
-        while (i < len) {
-            if (input_copy[i] == '"' || input_copy[i] == '\'') {
-                if (!in_quotes) {
-                    in_quotes = 1;
-                    quote_char = input_copy[i];
-                    // Remove the opening quote
-                    memmove(&input_copy[i], &input_copy[i + 1], len - i);
-                    len--;
-                    continue;
-                } else if (input_copy[i] == quote_char) {
-                    // Remove the closing quote
-                    memmove(&input_copy[i], &input_copy[i + 1], len - i);
-                    len--;
-                    in_quotes = 0;
-                    continue;
-                }
-            }
-            if (!in_quotes && isspace(input_copy[i])) {
-                break;
-            }
-            i++;
+
+        if (c == '<' && p + 2 < end && p[1] == '<' && p[2] == '<') {
+            add_token(arena, list, TOK_HERESTRING, 0, 0, 0);
+            p += 3;
+            continue;
+        }
+        if (c == '<' && p + 1 < end && p[1] == '<') {
+            // '<<-' strips leading tabs; a quoted delimiter keeps the body literal
+            int strip = p + 2 < end && p[2] == '-';
+            p += 2 + strip;
+            add_token(arena, list, TOK_HEREDOC, here_docs++, strip, !delimiter_quoted(p, end));
+            continue;
         }
 
-        // Add token to array
-        int token_len = i - start;
-        if (token_len > 0) {
-            tokens[position] = malloc(token_len + 1);
-            if (!tokens[position]) {
-                fprintf(stderr, "myshell: allocation error\n");
-                exit(EXIT_FAILURE);
-            }
-            strncpy(tokens[position], &input_copy[start], token_len);
-            tokens[position][token_len] = '\0';
-            position++;
-
-            if (position >= tokens_size) {
-                tokens_size += INITIAL_TOKENS_SIZE;
-                tokens = realloc(tokens, tokens_size * sizeof(char*));
-                if (!tokens) {
-                    fprintf(stderr, "myshell: allocation error\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
+        if ((c == '<' || c == '>') && p + 1 < end && p[1] == '(') {
+            const char *text = p + 2;
+            const char *close = substitution_end(text, end);
+            memcpy(out, text, close - text);
+            add_token(arena, list, c == '<' ? TOK_PROCSUB_IN : TOK_PROCSUB_OUT,
+                      (int)(out - list->buf), (int)(close - text), 0);
+            out += close - text;
+            *out++ = '\0';
+            p = close < end ? close + 1 : end;
+            continue;
         }
 
-        // Skip trailing whitespace
-        while (i < len && isspace(input_copy[i])) {
-            i++;
+        if (cls == CH_OPERATOR) {
+            if (c == '|' && p + 1 < end && p[1] == '|') {
+                add_token(arena, list, TOK_OR, 0, 0, 0);
+                p += 2;
+            } else if (c == '|') {
+                add_token(arena, list, TOK_PIPE, 0, 0, 0);
+                p++;
+            } else if (c == '&' && p + 1 < end && p[1] == '&') {
+                add_token(arena, list, TOK_AND, 0, 0, 0);
+                p += 2;
+            } else if (c == '&') {
+                add_token(arena, list, TOK_BACKGROUND, 0, 0, 0);
+                p++;
+            } else if (c == ';') {
+                add_token(arena, list, TOK_SEMI, 0, 0, 0);
+                p++;
+            } else if (c == '<') {
+                add_token(arena, list, TOK_REDIR_IN, 0, 0, 0);
+                p++;
+            } else if (p + 1 < end && p[1] == '>') {
+                add_token(arena, list, TOK_APPEND, 0, 0, 0);
+                p += 2;
+            } else {
+                add_token(arena, list, TOK_REDIR_OUT, 0, 0, 0);
+                p++;
+            }
+            continue;
         }
 
-        if (input_copy[i] == '>' && input_copy[i+1] == '>') {
-            // Handle ">>" as a single token
-            tokens[position] = strdup(">>");
-            position++;
-            i += 2;  // Skip both '>' characters
+        if (c == '2' && p + 1 < end && p[1] == '>') {
+            add_token(arena, list, TOK_REDIR_ERR, 0, 0, 0);
+            p += 2;
             continue;
         }
+
+        // Word: copy bytes up to the next unquoted separator or operator
+        char *word = out;
+        int expand = 0;
+        while (p < end) {
+            c = (unsigned char)*p;
+            cls = char_class[c];
+            if (cls == CH_WORD) {
+                *out++ = (char)c;
+                p++;
+            } else if (cls == CH_WILDCARD) {
+                // Expanded to matching paths (see wildcard.c)
+                *out++ = (char)c;
+                expand = 1;
+                p++;
+            } else if (c == '$' && p + 1 < end && p[1] == '(') {
+                p = copy_command_sub(&out, p, end, EXPAND_SPLIT);
+                expand = 1;
+            } else if (c == '$' && p + 1 < end && (p[1] == '{' || vars_name_length(p + 1) > 0)) {
+                // An unquoted variable is split into words too
+                *out++ = EXPAND_SPLIT;
+                *out++ = '$';
+                expand = 1;
+                p++;
+            } else if (cls == CH_EXPAND) {
+                if (c == EXPAND_ESCAPE || c == EXPAND_SPLIT)
+                    *out++ = EXPAND_ESCAPE;
+                *out++ = (char)c;
+                expand = 1;
+                p++;
+            } else if (cls == CH_QUOTE) {
+                // Copy the quoted run in one block; an unterminated quote
+                // extends to the end of the line
+                const char *close = quote_end(p, end);
+                const char *stop = close ? close : end;
+                size_t n = stop - (p + 1);
+                if (quoted_plain(p + 1, n)) {
+                    memcpy(out, p + 1, n);
+                    out += n;
+                } else {
+                    // '$' expands inside double quotes only, where the
+                    // output of a command substitution stays one word
+                    for (const char *q = p + 1; q < stop; q++) {
+                        if (c == '"' && *q == '$' && q + 1 < stop && q[1] == '(') {
+                            q = copy_command_sub(&out, q, stop, 0) - 1;
+                            continue;
+                        }
+                        if (*q == EXPAND_ESCAPE || *q == EXPAND_SPLIT || (*q == '$' && c == '\'') ||
+                            char_class[(unsigned char)*q] == CH_WILDCARD)
+                            *out++ = EXPAND_ESCAPE;
+                        *out++ = *q;
+                    }
+                    expand = 1;
+                }
+                p = close ? close + 1 : end;
+            } else {
+                break;
+            }
+        }
+        *out++ = '\0';
+        add_token(arena, list, TOK_WORD, (int)(word - list->buf), (int)(out - word - 1), expand);
     }
-    
-    tokens[position] = NULL;
-    free(input_copy);
-    return tokens;
+
+    return list;
+}
+
+/*
+ * add_redirection: Records a redirection in the command's plan.
+ * The array was sized by parse_command().
+ */
+static void add_redirection(Command *cmd, int target_fd, int flags, const char *path) {
+    Redirection *r = &cmd->redirs[cmd->redir_count++];
+    r->target_fd = target_fd;
+    r->flags = flags;
+    r->path = path;
+    r->data = NULL;
 }
 
 /*
- * free_args: Frees the memory allocated for an array of tokens.
+ * word_text: Returns the final text of word token 'index': the token string
+ * itself, or its expansion if it contains '$' or escaped bytes (NULL if a
+ * command substitution in it failed).
+ */
+static char *word_text(Arena *arena, const TokenList *tokens, int index) {
+    char *text = token_text(tokens, index);
+    return tokens->tokens[index].expand ? expand_word(arena, text) : text;
+}
+
+/*
+ * here_data:
  *
- * This function properly deallocates all memory associated with a token array,
- * including both the individual token strings and the array itself.
+ * Returns the text a here-document or here-string operator (token 'op')
+ * feeds to stdin: the body of the here-document, expanded unless its
+ * delimiter was quoted, or the expanded word 'word' plus a newline.
  *
- * Parameters:
- *   args - A NULL-terminated array of strings to be freed.
+ * Returns:
+ *   The text, or NULL after printing an error.
  */
-void free_args(char **args) {
-    if (args == NULL) {
-        return;
+static const char *here_data(Arena *arena, const TokenList *tokens, int op, int word) {
+    const Token *token = &tokens->tokens[op];
+    if (tokens->tokens[word].type != TOK_WORD) {
+        fprintf(stderr, "myshell: syntax error near unexpected token '%s'\n",
+                token_name(tokens->tokens[word].type));
+        return NULL;
+    }
+    if (token->type == TOK_HERESTRING) {
+        const char *text = word_text(arena, tokens, word);
+        if (!text)
+            return NULL;
+        size_t len = strlen(text);
+        char *data = arena_alloc(arena, len + 2);
+        memcpy(data, text, len);
+        data[len] = '\n';
+        data[len + 1] = '\0';
+        return data;
     }
-    for (int i = 0; args[i] != NULL; i++) {
-        free(args[i]);
+    if (tokens->here_docs == NULL) {
+        fprintf(stderr, "myshell: here-document is not supported here\n");
+        return NULL;
     }
-    free(args);
+    const char *body = tokens->here_docs[token->offset];
+    return token->expand && strchr(body, '$') ? expand_word(arena, body) : body;
 }
 
 /*
  * parse_command: Parses a single command with its redirections.
  * Parameters:
- *   tokens - The full array of tokens.
+ *   arena - The per-line arena that owns the Command and its argv.
+ *   tokens - The token list of the whole line.
  *   start - The starting index of this command's tokens.
  *   end - The ending index (exclusive) of this command's tokens.
  *
  * Returns:
- *   A dynamically allocated Command structure with the command arguments
- *   and any redirection file descriptors. Returns NULL if there are syntax
- *   errors or memory allocation failures.
+ *   An arena-allocated Command structure whose arguments and redirection
+ *   paths point at the token strings (or at their expansions, made now
+ *   so that a cached parse sees the current value of '$?'). Redirections are only recorded; the
+ *   files are opened when the command is started (see redirect.c).
+ *   Process substitutions are recorded in cmd->subs with an empty
+ *   argument or path until procsub_start() runs them. Here-documents and
+ *   here-strings become stdin redirections carrying their text. Command
+ *   substitutions run now; unquoted, their output (and the value of a
+ *   variable) may make several arguments or none (args[0] is NULL if no
+ *   argument is left). Leading NAME=value words are collected in
+ *   cmd->assigns, and cmd->env is the environment they give the command.
+ *   Returns NULL if there are syntax errors.
  */
-Command *parse_command(char **tokens, int start, int end) {
-    Command *cmd = malloc(sizeof(Command));
-    if (!cmd) {
-        perror("myshell: allocation error");
-        return NULL;
-    }
+Command *parse_command(Arena *arena, const TokenList *tokens, int start, int end) {
+    Command *cmd = arena_alloc(arena, sizeof(Command));
     
     cmd->input_fd = -1;
     cmd->output_fd = -1;
     cmd->error_fd = -1;
     
-    // Count non-redirection tokens first
+    // Count words that are not redirection targets
     int arg_count = 0;
-    int has_command = 0;
-
+    int redir_count = 0;
+    int sub_count = 0;
     for (int i = start; i < end; i++) {
-        if (i + 1 >= end && (strcmp(tokens[i], "<") == 0 || 
-                            strcmp(tokens[i], ">") == 0 || 
-                            strcmp(tokens[i], "2>") == 0)) {
-            fprintf(stderr, "myshell: syntax error: missing file for redirection\n");
-            free(cmd);
-            return NULL;
-        }
-        
-        // Check if this is a redirection operator
-        if (strcmp(tokens[i], "<") == 0 || 
-            strcmp(tokens[i], ">") == 0 || 
-            strcmp(tokens[i], "2>") == 0) {
-            i++; // Skip the filename
+        TokenType type = tokens->tokens[i].type;
+        if (type == TOK_PROCSUB_IN || type == TOK_PROCSUB_OUT)
+            sub_count++;
+        if (!token_is_word(type)) {
+            if (i + 1 >= end || !token_is_word(tokens->tokens[i + 1].type)) {
+                fprintf(stderr, "myshell: syntax error: missing file for redirection\n");
+                return NULL;
+            }
             continue;
         }
-        
-        has_command = 1;
-        arg_count++;
+        if (i > start && !token_is_word(tokens->tokens[i - 1].type))
+            redir_count++;  // The filename of the operator before it
+        else
+            arg_count++;
     }
 
-    if (!has_command) {
+    if (arg_count == 0) {
         fprintf(stderr, "myshell: syntax error: missing command\n");
-        free(cmd);
         return NULL;
     }
     
-    cmd->args = malloc((arg_count + 1) * sizeof(char *));
-    if (!cmd->args) {
-        perror("myshell: allocation error");
-        free(cmd);
-        return NULL;
-    }
+    int arg_slots = arg_count + 1;
+    cmd->args = arena_alloc(arena, arg_slots * sizeof(char *));
+    cmd->redirs = redir_count ? arena_alloc(arena, redir_count * sizeof(Redirection)) : NULL;
+    cmd->redir_count = 0;
+    cmd->subs = sub_count ? arena_alloc(arena, sub_count * sizeof(ProcessSub)) : NULL;
+    cmd->sub_count = 0;
+    cmd->assigns = NULL;
+    cmd->assign_count = 0;
+    cmd->env = NULL;
     
     int arg_pos = 0;
+    int assigning = 1;      // No argument seen yet: NAME=value words are assignments
     for (int i = start; i < end; i++) {
-        if (strcmp(tokens[i], "<") == 0) {
+        TokenType type = tokens->tokens[i].type;
+        int redir = -1;     // Index of the redirection whose path token 'i' is
+        if (!token_is_word(type)) {
+            int input = type == TOK_REDIR_IN || type == TOK_HEREDOC || type == TOK_HERESTRING;
+            int target = input ? STDIN_FILENO :
+                         type == TOK_REDIR_ERR ? STDERR_FILENO : STDOUT_FILENO;
+            int flags = input ? O_RDONLY :
+                        type == TOK_APPEND ? O_WRONLY | O_CREAT | O_APPEND :
+                        O_WRONLY | O_CREAT | O_TRUNC;
+            redir = cmd->redir_count;
             i++;
-            cmd->input_fd = open(tokens[i], O_RDONLY);
-            if (cmd->input_fd < 0) {
-                fprintf(stderr, "myshell: %s: No such file or directory\n", tokens[i]);
-                free(cmd->args);
-                free(cmd);
-                return NULL;
+            add_redirection(cmd, target, flags, "");
+            if (type == TOK_HEREDOC || type == TOK_HERESTRING) {
+                // The delimiter or string is not a path
+                cmd->redirs[redir].path = token_name(type);
+                cmd->redirs[redir].data = here_data(arena, tokens, i - 1, i);
+                if (cmd->redirs[redir].data == NULL)
+                    return NULL;
+                continue;
             }
-        } else if (strcmp(tokens[i], ">") == 0) {
-            i++;
-            cmd->output_fd = open(tokens[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (cmd->output_fd < 0) {
-                perror("myshell");
-                free(cmd->args);
-                free(cmd);
-                return NULL;
+        }
+
+        if (redir < 0 && assigning && tokens->tokens[i].type == TOK_WORD) {
+            const char *word = token_text(tokens, i);
+            size_t name_len = vars_name_length(word);
+            if (name_len > 0 && word[name_len] == '=') {
+                // The value is expanded but not split
+                char *text = word_text(arena, tokens, i);
+                if (!text)
+                    return NULL;
+                if (!cmd->assigns)
+                    cmd->assigns = arena_alloc(arena, arg_count * sizeof(char *));
+                cmd->assigns[cmd->assign_count++] = text;
+                continue;
             }
-        } else if (strcmp(tokens[i], "2>") == 0) {
-            i++;
-            cmd->error_fd = open(tokens[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (cmd->error_fd < 0) {
-                perror("myshell");
-                free(cmd->args);
-                free(cmd);
+        }
+        if (redir < 0)
+            assigning = 0;
+
+        if (redir < 0 && tokens->tokens[i].type == TOK_WORD && tokens->tokens[i].expand) {
+            // Unquoted $(...) and $NAME become as many arguments as they have words
+            int n;
+            char **fields = expand_fields(arena, token_text(tokens, i), &n);
+            if (!fields)
                 return NULL;
+            arg_count += n - 1;
+            if (arg_count + 1 > arg_slots) {
+                arg_slots = 2 * (arg_count + 1);
+                char **grown = arena_alloc(arena, arg_slots * sizeof(char *));
+                memcpy(grown, cmd->args, arg_pos * sizeof(char *));
+                cmd->args = grown;
             }
+            memcpy(cmd->args + arg_pos, fields, n * sizeof(char *));
+            arg_pos += n;
+            continue;
+        }
+
+        // A process substitution gets its /dev/fd path when it is started
+        const char *text = "";
+        if (tokens->tokens[i].type == TOK_WORD) {
+            text = word_text(arena, tokens, i);
+            if (!text)
+                return NULL;
         } else {
-            cmd->args[arg_pos++] = strdup(tokens[i]);
+            ProcessSub *sub = &cmd->subs[cmd->sub_count++];
+            sub->text = token_text(tokens, i);
+            sub->writable = tokens->tokens[i].type == TOK_PROCSUB_OUT;
+            sub->arg = redir < 0 ? arg_pos : -1;
+            sub->redir = redir;
+            sub->fd = -1;
+            sub->pids = NULL;
+            sub->pid_count = 0;
         }
+        if (redir >= 0)
+            cmd->redirs[redir].path = text;
+        else
+            cmd->args[arg_pos++] = (char *)text;
     }
     cmd->args[arg_pos] = NULL;
+
+    // Assignments before a command only apply to it
+    if (cmd->assign_count > 0 && arg_pos > 0)
+        cmd->env = vars_overlay(arena, cmd->assigns, cmd->assign_count);
     
     return cmd;
 }
 
+/*
+ * expand_words: Expands word tokens [start, end) into the words they stand
+ * for as arguments: unquoted expansions are split and globbed.
+ *
+ * Returns:
+ *   An arena array of *count words, or NULL after printing an error.
+ */
+char **expand_words(Arena *arena, const TokenList *tokens, int start, int end, int *count) {
+    int slots = end - start + 1;
+    char **words = arena_alloc(arena, slots * sizeof(char *));
+    *count = 0;
+    for (int i = start; i < end; i++) {
+        int n = 1;
+        char *text = NULL;
+        char **fields = &text;
+        if (tokens->tokens[i].expand)
+            fields = expand_fields(arena, token_text(tokens, i), &n);
+        else
+            text = token_text(tokens, i);
+        if (!fields)
+            return NULL;
+        if (*count + n + end - i > slots) {
+            slots = 2 * (*count + n + end - i);
+            char **grown = arena_alloc(arena, slots * sizeof(char *));
+            memcpy(grown, words, *count * sizeof(char *));
+            words = grown;
+        }
+        memcpy(words + *count, fields, n * sizeof(char *));
+        *count += n;
+    }
+    return words;
+}
+
+/*
+ * close_command_fds: Closes any fds the shell attached to a Command.
+ *
+ * The Command itself lives in the arena; only its open files need to be
+ * released explicitly.
+ */
+void close_command_fds(Command *cmd) {
+    if (cmd->input_fd != -1) close(cmd->input_fd);
+    if (cmd->output_fd != -1) close(cmd->output_fd);
+    if (cmd->error_fd != -1) close(cmd->error_fd);
+    cmd->input_fd = cmd->output_fd = cmd->error_fd = -1;
+    for (int i = 0; i < cmd->sub_count; i++) {
+        if (cmd->subs[i].fd != -1) {
+            close(cmd->subs[i].fd);
+            cmd->subs[i].fd = -1;
+        }
+    }
+}
+
 /*
  * split_pipeline: Splits a command line into separate commands based on pipes.
  *
  * Parameters:
- *   tokens - A NULL-terminated array of tokens representing the command line.
+ *   arena - The per-line arena that owns the stage array.
+ *   tokens - The token list of the whole line.
  *   cmd_count - A pointer to an integer where the number of commands will be stored.
  *
  * Returns:
- *   A dynamically allocated array of token arrays, where each inner array
- *   represents one command in the pipeline. Returns NULL if there are syntax
- *   errors or memory allocation failures.
+ *   An arena-allocated array of token ranges, one per command in the
+ *   pipeline (of any length). Returns NULL if there are syntax errors.
  */
-char ***split_pipeline(char **tokens, int *cmd_count) {
-    int max_cmds = 10;  // Maximum 10 pipes (11 commands)
-    char ***commands = malloc(sizeof(char**) * (max_cmds + 1));
-    if (!commands) {
-        perror("myshell: allocation error");
-        return NULL;
+StageRange *split_pipeline(Arena *arena, const TokenList *tokens, int *cmd_count) {
+    // Size the stage array from the number of pipes
+    int max_cmds = 1;
+    for (int i = 0; i < tokens->count; i++) {
+        if (tokens->tokens[i].type == TOK_PIPE)
+            max_cmds++;
     }
+    StageRange *commands = arena_alloc(arena, sizeof(StageRange) * max_cmds);
     
     *cmd_count = 0;
     int start = 0;
     int i;
     
-    for (i = 0; tokens[i] != NULL; i++) {
-        if (strcmp(tokens[i], "|") == 0) {
+    for (i = 0; i < tokens->count; i++) {
+        // List operators are handled by parse_line()
+        TokenType type = tokens->tokens[i].type;
+        if (type == TOK_BACKGROUND || type == TOK_SEMI || type == TOK_AND || type == TOK_OR) {
+            fprintf(stderr, "myshell: syntax error near unexpected token '%s'\n", token_name(type));
+            return NULL;
+        }
+        if (tokens->tokens[i].type == TOK_PIPE) {
             // Check for empty command before pipe
-            if (i == start || start >= i) {
+            if (i == start) {
                 fprintf(stderr, "myshell: syntax error: missing command\n");
-                // Cleanup
-                for (int j = 0; j < *cmd_count; j++) {
-                    free_args(commands[j]);
-                }
-                free(commands);
                 return NULL;
             }
             
             // Check for empty command after pipe
-            if (tokens[i+1] == NULL) {
+            if (i + 1 >= tokens->count) {
                 fprintf(stderr, "myshell: syntax error: missing command after pipe\n");
-                // Cleanup
-                for (int j = 0; j < *cmd_count; j++) {
-                    free_args(commands[j]);
-                }
-                free(commands);
-                return NULL;
-            }
-            
-            // Allocate and copy command tokens
-            int cmd_len = i - start;
-            commands[*cmd_count] = malloc(sizeof(char*) * (cmd_len + 1));
-            if (!commands[*cmd_count]) {
-                perror("myshell: allocation error");
-                // Cleanup
-                for (int j = 0; j < *cmd_count; j++) {
-                    free(commands[j]);
-                }
-                free(commands);
                 return NULL;
             }
             
-            for (int j = 0; j < cmd_len; j++) {
-                commands[*cmd_count][j] = strdup(tokens[start + j]);
-            }
-            commands[*cmd_count][cmd_len] = NULL;
-            
+            commands[*cmd_count].start = start;
+            commands[*cmd_count].end = i;
             (*cmd_count)++;
-            if (*cmd_count >= max_cmds) {
-                fprintf(stderr, "myshell: too many pipes\n");
-                // Cleanup
-                for (int j = 0; j < *cmd_count; j++) {
-                    free_args(commands[j]);
-                }
-                free(commands);
-                return NULL;
-            }
-            
             start = i + 1;
         }
     }
@@ -355,22 +685,159 @@ char ***split_pipeline(char **tokens, int *cmd_count) {
     // Handle the last command
     if (start >= i) {
         fprintf(stderr, "myshell: syntax error: missing command\n");
-        // Cleanup
-        for (int j = 0; j < *cmd_count; j++) {
-            free_args(commands[j]);
-        }
-        free(commands);
         return NULL;
     }
     
-    // Allocate and copy last command
-    int cmd_len = i - start;
-    commands[*cmd_count] = malloc(sizeof(char*) * (cmd_len + 1));
-    for (int j = 0; j < cmd_len; j++) {
-        commands[*cmd_count][j] = strdup(tokens[start + j]);
-    }
-    commands[*cmd_count][cmd_len] = NULL;
+    commands[*cmd_count].start = start;
+    commands[*cmd_count].end = i;
     (*cmd_count)++;
     
     return commands;
 }
+
+/*
+ * token_name: Returns the source text of an operator token.
+ */
+const char *token_name(TokenType type) {
+    switch (type) {
+    case TOK_PIPE: return "|";
+    case TOK_REDIR_IN: return "<";
+    case TOK_REDIR_OUT: return ">";
+    case TOK_APPEND: return ">>";
+    case TOK_REDIR_ERR: return "2>";
+    case TOK_HEREDOC: return "<<";
+    case TOK_HERESTRING: return "<<<";
+    case TOK_BACKGROUND: return "&";
+    case TOK_SEMI: return ";";
+    case TOK_AND: return "&&";
+    case TOK_OR: return "||";
+    case TOK_PROCSUB_IN: return "<(";
+    case TOK_PROCSUB_OUT: return ">(";
+    default: return "word";
+    }
+}
+
+static int is_list_operator(TokenType type) {
+    return type == TOK_SEMI || type == TOK_AND || type == TOK_OR || type == TOK_BACKGROUND;
+}
+
+/*
+ * add_pipeline: Splits tokens [start, end) into stages and appends them as
+ * one pipeline of 'line'. A leading 'time' word marks it timed.
+ *
+ * Returns:
+ *   0 on success, -1 on syntax errors.
+ */
+int add_pipeline(Arena *arena, ParsedLine *line, int start, int end,
+                 ListOp op, int background) {
+    const TokenList *tokens = &line->tokens;
+    Pipeline *pipeline = &line->pipelines[line->pipeline_count];
+    pipeline->op = op;
+    pipeline->background = background;
+    pipeline->timed = 0;
+
+    // 'time' prefix: run the rest of the pipeline and report per-stage usage
+    if (start < end && tokens->tokens[start].type == TOK_WORD &&
+        strcmp(token_text(tokens, start), "time") == 0) {
+        start++;
+        pipeline->timed = 1;
+    }
+    if (start == end) {
+        fprintf(stderr, "myshell: syntax error: missing command\n");
+        return -1;
+    }
+
+    TokenList view = *tokens;
+    view.tokens += start;
+    view.count = end - start;
+    int cmd_count = 0;
+    StageRange *stages = split_pipeline(arena, &view, &cmd_count);
+    if (!stages)
+        return -1;
+
+    pipeline->first_stage = 0;
+    if (line->pipeline_count > 0) {
+        const Pipeline *prev = &line->pipelines[line->pipeline_count - 1];
+        pipeline->first_stage = prev->first_stage + prev->cmd_count;
+    }
+    pipeline->cmd_count = cmd_count;
+    for (int i = 0; i < cmd_count; i++) {
+        line->stages[pipeline->first_stage + i].start = stages[i].start + start;
+        line->stages[pipeline->first_stage + i].end = stages[i].end + start;
+    }
+    line->pipeline_count++;
+    return 0;
+}
+
+/*
+ * parse_line: Lexes a command line and splits it into a command list.
+ *
+ * Pipelines are separated by ';', '&&', '||' and '&'; a pipeline ended by
+ * '&' runs in the background. A trailing ';' or '&' is allowed; any other
+ * empty pipeline is a syntax error. A leading 'time' word of a pipeline is
+ * recognized here and excluded from its stages.
+ *
+ * Parameters:
+ *   arena - The per-line arena that owns the result.
+ *   input - The command line.
+ *
+ * Returns:
+ *   An arena-allocated ParsedLine (pipeline_count is 0 if there is nothing
+ *   to run), or NULL if there are syntax errors.
+ */
+ParsedLine *parse_line(Arena *arena, const char *input) {
+    ParsedLine *line = arena_alloc(arena, sizeof(ParsedLine));
+    TokenList *tokens = &line->tokens;
+    uint64_t traced = trace_begin();
+    *tokens = *parse_input(arena, input);
+    trace_end("tokenize", traced, "tokens", tokens->count, NULL);
+    line->stages = NULL;
+    line->pipelines = NULL;
+    line->pipeline_count = 0;
+    if (tokens->count == 0) {
+        return line;
+    }
+    traced = trace_begin();
+
+    // Every operator may end a pipeline or a stage
+    int max_pipelines = 1, max_stages = 1;
+    for (int i = 0; i < tokens->count; i++) {
+        if (is_list_operator(tokens->tokens[i].type)) {
+            max_pipelines++;
+            max_stages++;
+        } else if (tokens->tokens[i].type == TOK_PIPE) {
+            max_stages++;
+        }
+    }
+    line->pipelines = arena_alloc(arena, max_pipelines * sizeof(Pipeline));
+    line->stages = arena_alloc(arena, max_stages * sizeof(StageRange));
+
+    ListOp op = LIST_SEQ;
+    int start = 0;
+    for (int i = 0; i <= tokens->count; i++) {
+        TokenType type = i < tokens->count ? tokens->tokens[i].type : TOK_SEMI;
+        if (i < tokens->count && !is_list_operator(type))
+            continue;
+
+        if (i == start) {
+            // Nothing before this operator: only a final ';' may follow a
+            // separator, and the end of the line may not follow '&&'/'||'
+            if (i == tokens->count && line->pipeline_count > 0 && op == LIST_SEQ)
+                break;
+            if (i == tokens->count)
+                fprintf(stderr, "myshell: syntax error: missing command after '%s'\n",
+                        op == LIST_AND ? "&&" : op == LIST_OR ? "||" : ";");
+            else
+                fprintf(stderr, "myshell: syntax error near unexpected token '%s'\n",
+                        token_name(type));
+            return NULL;
+        }
+
+        if (add_pipeline(arena, line, start, i, op, type == TOK_BACKGROUND) < 0)
+            return NULL;
+        op = type == TOK_AND ? LIST_AND : type == TOK_OR ? LIST_OR : LIST_SEQ;
+        start = i + 1;
+    }
+    trace_end("split", traced, "pipelines", line->pipeline_count, NULL);
+    return line;
+}
@@ -2,17 +2,121 @@
 #define PARSER_H
 
 #include "executor.h"
+#include "arena.h"
 
-// Splits the input string into tokens
-char **parse_input(const char *input);
+// Token types produced by the lexer
+typedef enum {
+    TOK_WORD,       // Command name, argument or filename
+    TOK_PIPE,       // |
+    TOK_REDIR_IN,   // <
+    TOK_REDIR_OUT,  // >
+    TOK_APPEND,     // >>
+    TOK_REDIR_ERR,  // 2>
+    TOK_HEREDOC,    // << or <<- (offset: the here-document's index in the line)
+    TOK_HERESTRING, // <<<
+    TOK_BACKGROUND, // &
+    TOK_SEMI,       // ;
+    TOK_AND,        // &&
+    TOK_OR,         // ||
+    TOK_PROCSUB_IN, // <(command): a path to read the command's output from
+    TOK_PROCSUB_OUT // >(command): a path to write the command's input to
+} TokenType;
 
-// Splits a command line into separate commands based on pipes
-char ***split_pipeline(char **tokens, int *cmd_count);
+// A typed token; words refer to their unquoted text in the token buffer,
+// process substitutions to the raw command text inside the parentheses
+typedef struct {
+    TokenType type;
+    int offset;     // Offset of the text in TokenList.buf (words and substitutions)
+    int length;     // Length of the word, excluding the NUL terminator
+    int expand;     // The word contains '$' expansions or escaped bytes (see expand.h);
+                    // for TOK_HEREDOC, the body is expanded (unquoted delimiter)
+} Token;
 
-// Parses a single command with its redirections
-Command *parse_command(char **tokens, int start, int end);
+// Result of lexing one command line
+typedef struct {
+    Token *tokens;
+    int count;
+    int capacity;
+    char *buf;      // Unquoted word bytes, each word NUL-terminated
+    char **here_docs;   // Bodies of the line's here-documents (NULL until read)
+} TokenList;
 
-// Frees the memory allocated for an array of tokens
-void free_args(char **args);
+// Token range [start, end) of one pipeline stage
+typedef struct {
+    int start;
+    int end;
+} StageRange;
+
+// How a pipeline of a command list depends on the one before it
+typedef enum {
+    LIST_SEQ,       // First pipeline, or after ';' or '&': always runs
+    LIST_AND,       // After '&&': runs if the previous status is 0
+    LIST_OR         // After '||': runs if the previous status is not 0
+} ListOp;
+
+// One pipeline of a command list
+typedef struct {
+    int first_stage;        // Index of its first stage in ParsedLine.stages
+    int cmd_count;          // Number of stages
+    int background;         // The pipeline ended with '&'
+    int timed;              // The pipeline started with 'time'
+    ListOp op;
+} Pipeline;
+
+// A lexed and split command line, ready for parse_command()
+typedef struct {
+    TokenList tokens;       // The line's tokens
+    StageRange *stages;     // Stages of all pipelines, in order
+    Pipeline *pipelines;
+    int pipeline_count;     // Number of pipelines (0 for an empty line)
+} ParsedLine;
+
+// Returns the text of word token 'index'
+static inline char *token_text(const TokenList *list, int index) {
+    return list->buf + list->tokens[index].offset;
+}
+
+// Returns 1 for tokens that stand for a word: words and process substitutions
+static inline int token_is_word(TokenType type) {
+    return type == TOK_WORD || type == TOK_PROCSUB_IN || type == TOK_PROCSUB_OUT;
+}
+
+// Returns the ')' closing a substitution ($(...), <(...), >(...)) whose text
+// starts at 'p', skipping nested parentheses and quoted runs; 'end' if the
+// substitution is unterminated
+const char *substitution_end(const char *p, const char *end);
+
+// Returns the text of an operator token, for messages
+const char *token_name(TokenType type);
+
+// Splits the input string into typed tokens allocated in 'arena'
+TokenList *parse_input(Arena *arena, const char *input);
+
+// Splits a token list into pipeline stages separated by '|'.
+// List operators (';', '&&', '||', '&') are syntax errors here.
+StageRange *split_pipeline(Arena *arena, const TokenList *tokens, int *cmd_count);
+
+// Splits tokens [start, end) of line->tokens into stages and appends them
+// to 'line' as one pipeline, after the last one; line->pipelines and
+// line->stages must have room. Returns 0, or -1 on syntax errors.
+int add_pipeline(Arena *arena, ParsedLine *line, int start, int end,
+                 ListOp op, int background);
+
+// Lexes a command line and splits it into a list of pipelines separated by
+// ';', '&&', '||' and '&'. Returns NULL on syntax errors.
+ParsedLine *parse_line(Arena *arena, const char *input);
+
+// Parses a single command with its redirections. Its words are expanded now,
+// running command substitutions; if they all expand to nothing, args[0] is
+// NULL and the command only opens its redirections.
+Command *parse_command(Arena *arena, const TokenList *tokens, int start, int end);
+
+// Expands word tokens [start, end) into the words they stand for as
+// arguments (see parse_command()). Returns an arena array of *count words,
+// or NULL after printing an error.
+char **expand_words(Arena *arena, const TokenList *tokens, int start, int end, int *count);
+
+// Closes the fds the shell attached to a command (input_fd, output_fd, error_fd)
+void close_command_fds(Command *cmd);
 
 #endif // PARSER_H
@@ -0,0 +1,397 @@
+/*
+ * pathcache.c - Command Path Cache
+ *
+ * This file implements the shell's command hash table, which maps command
+ * names to the absolute paths found by searching $PATH. Without it every
+ * launch walks $PATH and probes each directory; with it a repeated command
+ * costs one hash lookup and goes straight to execve().
+ *
+ * Key Components:
+ *
+ * 1. Hash Table:
+ *    - Open addressing with linear probing (FNV-1a hash)
+ *    - Grows at 50% load, deletes with backward shifting
+ *    - Counts hits per entry, like the bash 'hash' builtin
+ *
+ * 2. Invalidation:
+ *    - The whole table is dropped when $PATH differs from the value it was
+ *      built against
+ *    - Single entries are dropped when exec reports the path has vanished
+ *
+ * 3. Completion:
+ *    - Command names are offered from the table and from the listings of
+ *      the $PATH directories, which the directory cache keeps until a
+ *      directory's mtime changes
+ *
+ * 4. Snapshots:
+ *    - The entries can be listed and entered again, so the table an rc
+ *      file filled is saved with its snapshot (rcfile.c)
+ *
+ * 5. Builtin:
+ *    - 'hash' lists entries, 'hash name...' adds them,
+ *      'hash -d name...' forgets them, 'hash -r' resets the table
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "dircache.h"
+
+#define INITIAL_CACHE_SIZE 32
+
+typedef struct {
+    char *name;     // Command name (NULL for an empty slot)
+    char *path;     // Resolved absolute path
+    int hits;       // Number of lookups served from this entry
+} PathEntry;
+
+static PathEntry *entries = NULL;
+static size_t capacity = 0;
+static size_t used = 0;
+static char *cached_path_env = NULL;  // $PATH the table was built against
+
+/*
+ * hash_name: FNV-1a hash of a command name.
+ */
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * find_slot: Returns the slot holding 'name', or the empty slot where it
+ * would be inserted. The table must have been allocated.
+ */
+static size_t find_slot(const char *name) {
+    size_t mask = capacity - 1;
+    size_t i = hash_name(name) & mask;
+    while (entries[i].name != NULL && strcmp(entries[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * grow_table: Doubles the table size and rehashes all entries.
+ *
+ * Returns:
+ *   0 on success, -1 if memory allocation fails (the table is unchanged).
+ */
+static int grow_table(void) {
+    size_t new_capacity = capacity ? capacity * 2 : INITIAL_CACHE_SIZE;
+    PathEntry *new_entries = calloc(new_capacity, sizeof(PathEntry));
+    if (!new_entries) {
+        return -1;
+    }
+
+    PathEntry *old_entries = entries;
+    size_t old_capacity = capacity;
+    entries = new_entries;
+    capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].name != NULL) {
+            entries[find_slot(old_entries[i].name)] = old_entries[i];
+        }
+    }
+    free(old_entries);
+    return 0;
+}
+
+void path_cache_clear(void) {
+    for (size_t i = 0; i < capacity; i++) {
+        free(entries[i].name);
+        free(entries[i].path);
+        entries[i].name = NULL;
+        entries[i].path = NULL;
+    }
+    used = 0;
+    free(cached_path_env);
+    cached_path_env = NULL;
+}
+
+/*
+ * check_path_env: Drops the table if $PATH changed since it was filled.
+ */
+static void check_path_env(void) {
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL) {
+        path_env = "";
+    }
+    if (cached_path_env != NULL && strcmp(cached_path_env, path_env) == 0) {
+        return;
+    }
+    path_cache_clear();
+    cached_path_env = strdup(path_env);
+    if (!cached_path_env) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * search_path: Walks $PATH looking for an executable regular file.
+ *
+ * Returns:
+ *   A newly allocated path, or NULL if the command was not found.
+ */
+static char *search_path(const char *name) {
+    const char *dir = cached_path_env;
+    size_t name_len = strlen(name);
+
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty PATH element means the current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (!candidate) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        if (dir_len == 0) {
+            candidate[0] = '.';
+            dir_len = 1;
+        } else {
+            memcpy(candidate, dir, dir_len);
+        }
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (!end) {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+/*
+ * path_cache_lookup: Resolves a command name to an executable path.
+ *
+ * Parameters:
+ *   name - The command name (argv[0]).
+ *
+ * Returns:
+ *   The cached or newly resolved path, 'name' itself if it contains '/',
+ *   or NULL if the command does not exist in $PATH.
+ */
+const char *path_cache_lookup(const char *name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    check_path_env();
+    if (capacity > 0) {
+        size_t slot = find_slot(name);
+        if (entries[slot].name != NULL) {
+            entries[slot].hits++;
+            return entries[slot].path;
+        }
+    }
+
+    char *path = search_path(name);
+    if (!path) {
+        return NULL;
+    }
+
+    if ((used + 1) * 2 > capacity && grow_table() < 0) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t slot = find_slot(name);
+    entries[slot].name = strdup(name);
+    if (!entries[slot].name) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    entries[slot].path = path;
+    entries[slot].hits = 1;
+    used++;
+    return path;
+}
+
+/*
+ * path_cache_add: Enters a known path for 'name' without searching $PATH,
+ * replacing any entry it has.
+ */
+void path_cache_add(const char *name, const char *path) {
+    check_path_env();
+    if ((used + 1) * 2 > capacity && grow_table() < 0) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t slot = find_slot(name);
+    if (entries[slot].name == NULL) {
+        entries[slot].name = strdup(name);
+        used++;
+    }
+    free(entries[slot].path);
+    entries[slot].path = strdup(path);
+    if (!entries[slot].name || !entries[slot].path) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    entries[slot].hits = 0;
+}
+
+void path_cache_each(void (*fn)(const char *name, const char *path, void *ctx), void *ctx) {
+    for (size_t i = 0; i < capacity; i++) {
+        if (entries[i].name != NULL) {
+            fn(entries[i].name, entries[i].path, ctx);
+        }
+    }
+}
+
+/*
+ * path_cache_forget: Removes the entry for 'name', shifting later entries
+ * of the same probe run back so lookups never stop at a hole.
+ */
+void path_cache_forget(const char *name) {
+    if (capacity == 0) {
+        return;
+    }
+    size_t mask = capacity - 1;
+    size_t i = find_slot(name);
+    if (entries[i].name == NULL) {
+        return;
+    }
+    free(entries[i].name);
+    free(entries[i].path);
+    entries[i].name = NULL;
+    entries[i].path = NULL;
+    used--;
+
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (entries[j].name == NULL) {
+            break;
+        }
+        size_t home = hash_name(entries[j].name) & mask;
+        // Move the entry back if its home slot is not in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            entries[i] = entries[j];
+            entries[j].name = NULL;
+            entries[j].path = NULL;
+            i = j;
+        }
+    }
+}
+
+/*
+ * path_cache_complete: Offers the command names starting with 'prefix'.
+ *
+ * Parameters:
+ *   prefix - Start of the command name being completed.
+ *   add    - Called with each candidate (names may repeat across $PATH
+ *            directories); the name is only valid during the call.
+ *   ctx    - Passed through to 'add'.
+ */
+void path_cache_complete(const char *prefix, void (*add)(const char *name, void *ctx), void *ctx) {
+    size_t prefix_len = strlen(prefix);
+
+    check_path_env();
+    for (size_t i = 0; i < capacity; i++) {
+        if (entries[i].name != NULL && strncmp(entries[i].name, prefix, prefix_len) == 0)
+            add(entries[i].name, ctx);
+    }
+
+    const char *dir = cached_path_env;
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        char *dir_path = dir_len ? strndup(dir, dir_len) : strdup(".");
+        if (!dir_path) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+
+        DirListing listing;
+        if (dir_cache_get(dir_path, &listing) == 0) {
+            for (size_t i = 0; i < listing.count; i++) {
+                const DirEntry *entry = &listing.entries[i];
+                int order = strncmp(entry->name, prefix, prefix_len);
+                if (order > 0)
+                    break;      // Sorted: no later entry matches
+                if (order < 0 || dir_entry_is_dir(dir_path, entry))
+                    continue;
+                char *candidate = malloc(strlen(dir_path) + strlen(entry->name) + 2);
+                if (!candidate) {
+                    fprintf(stderr, "myshell: allocation error\n");
+                    exit(EXIT_FAILURE);
+                }
+                sprintf(candidate, "%s/%s", dir_path, entry->name);
+                if (access(candidate, X_OK) == 0)
+                    add(entry->name, ctx);
+                free(candidate);
+            }
+        }
+        free(dir_path);
+
+        if (!end)
+            break;
+        dir = end + 1;
+    }
+}
+
+/*
+ * path_cache_builtin: Implements the 'hash' builtin.
+ *
+ *   hash              - list cached commands with their hit counts
+ *   hash -r           - forget every cached command
+ *   hash -d name...   - forget the given commands
+ *   hash name...      - look up the given commands and cache them
+ */
+int path_cache_builtin(char **args) {
+    if (args[1] == NULL) {
+        check_path_env();
+        if (used == 0) {
+            printf("hash: hash table empty\n");
+            return 0;
+        }
+        printf("hits\tcommand\n");
+        for (size_t i = 0; i < capacity; i++) {
+            if (entries[i].name != NULL) {
+                printf("%4d\t%s\n", entries[i].hits, entries[i].path);
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(args[1], "-r") == 0) {
+        path_cache_clear();
+        return 0;
+    }
+
+    if (strcmp(args[1], "-d") == 0) {
+        for (int i = 2; args[i] != NULL; i++) {
+            path_cache_forget(args[i]);
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strchr(args[i], '/') == NULL && path_cache_lookup(args[i]) == NULL) {
+            fprintf(stderr, "myshell: hash: %s: not found\n", args[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
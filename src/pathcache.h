@@ -0,0 +1,32 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+// Resolves a command name to an executable path.
+// Names containing '/' are returned unchanged; other names are looked up
+// in the cache and, on a miss, searched in $PATH and remembered.
+// Returns NULL if the command cannot be found. The returned string is owned
+// by the cache and stays valid until the entry is forgotten.
+const char *path_cache_lookup(const char *name);
+
+// Enters 'path' as the resolved path of 'name' (restoring a snapshot)
+void path_cache_add(const char *name, const char *path);
+
+// Calls fn(name, path, ctx) for every cached command
+void path_cache_each(void (*fn)(const char *name, const char *path, void *ctx), void *ctx);
+
+// Drops the cached entry for 'name' (e.g. after exec reported ENOENT)
+void path_cache_forget(const char *name);
+
+// Removes every cached entry
+void path_cache_clear(void);
+
+// Calls add(name, ctx) for every cached command and every executable in
+// the $PATH directories whose name starts with 'prefix'. Directory
+// listings come from the directory cache, so unchanged directories are
+// not read again.
+void path_cache_complete(const char *prefix, void (*add)(const char *name, void *ctx), void *ctx);
+
+// Implements the 'hash' builtin: list, add names, forget (-d) or reset (-r)
+int path_cache_builtin(char **args);
+
+#endif // PATHCACHE_H
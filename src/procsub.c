@@ -0,0 +1,308 @@
+/*
+ * procsub.c - Process Substitution and Coprocesses
+ *
+ * This file runs commands whose input or output is a pipe held by the
+ * shell instead of a temporary file:
+ *
+ *   diff <(sort a) <(sort b)      the path reads a command's output
+ *   tee >(gzip > t.gz) > t         the path feeds a command's input
+ *   coproc bc                      a command the shell talks to both ways
+ *
+ * Key Components:
+ *
+ * 1. Process Substitution:
+ *    - The lexer keeps the text inside <(...) and >(...) (parser.c), and
+ *      parse_command() records where it stands: an argument or the path
+ *      of a redirection
+ *    - Before its command starts, each substitution is parsed as a
+ *      pipeline and launched in the background (execute_background()) with
+ *      one end of a pipe as its stdout or stdin; the shell's end is named
+ *      /dev/fd/N in place of the substitution
+ *    - Redirection paths are opened by the shell, so the pipe only has to
+ *      be open in the shell; for arguments the spawn plan passes fd N to
+ *      the command under its own number (see build_stage_plan())
+ *    - Once the command is done, the shell closes its ends: a >(...)
+ *      command sees end of input, and a <(...) command still running is
+ *      sent SIGPIPE, as a pipeline's producer would be; all are then waited
+ *      for, so their output is complete when the next command starts
+ *
+ * 2. Coprocesses:
+ *    - 'coproc command...' runs a pipeline as a job whose stdin and stdout
+ *      are pipes kept by the shell at /dev/fd/62 and /dev/fd/63
+ *    - Redirections to those paths (echo 1+2 > /dev/fd/62, read it back
+ *      with head -1 < /dev/fd/63) reach the coprocess; 'coproc -c' closes
+ *      its stdin so it sees end of input
+ *
+ * Implementation Details:
+ * - Data only ever goes through kernel pipe buffers
+ * - Substitutions may nest; their processes are collected with the outer
+ *   substitution's and waited for together
+ * - Only a single pipeline can be substituted (no ';', '&&', '||', '&')
+ * - The shell's pipe ends are close-on-exec, so unrelated children never
+ *   hold them open
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "procsub.h"
+#include "parser.h"
+#include "executor.h"
+#include "arena.h"
+#include "jobs.h"
+
+static int coproc_write = -1;   // The coprocess's stdin (-1 if none)
+static int coproc_read = -1;    // The coprocess's stdout (-1 if none)
+static Arena coproc_arena;
+
+/*
+ * launch_text:
+ *
+ * Parses 'text' as a single pipeline and starts it in the background with
+ * 'in_fd' as its stdin and 'out_fd' as its stdout (-1 to inherit the
+ * shell's); both are closed once it is running. Process substitutions
+ * inside it are started too, and their processes are part of the result.
+ *
+ * Parameters:
+ *   arena - The arena holding the parse and the result.
+ *   text - The pipeline's source text.
+ *   what - Name used in error messages.
+ *   in_fd, out_fd - fds handed to the first and last stage.
+ *   pgid - Passed to execute_background() (may be NULL).
+ *   count - Receives the number of pids returned.
+ *
+ * Returns:
+ *   An arena array of the processes started, or NULL after printing an error.
+ */
+static pid_t *launch_text(Arena *arena, const char *text, const char *what,
+                          int in_fd, int out_fd, pid_t *pgid, int *count) {
+    ParsedLine *line = parse_line(arena, text);
+    Command *stages = NULL;
+    int cmd_count = 0;
+    int parsed = 0;
+    int ok = 0;
+    pid_t *pids = NULL;
+
+    *count = 0;
+    if (line && (line->pipeline_count != 1 || line->pipelines[0].background)) {
+        fprintf(stderr, "myshell: %s: expected a single pipeline\n", what);
+    } else if (line) {
+        cmd_count = line->pipelines[0].cmd_count;
+        stages = arena_alloc(arena, cmd_count * sizeof(Command));
+        ok = 1;
+        while (ok && parsed < cmd_count) {
+            Command *stage = parse_command(arena, &line->tokens, line->stages[parsed].start,
+                                           line->stages[parsed].end);
+            if (!stage) {
+                ok = 0;
+                break;
+            }
+            stages[parsed] = *stage;
+            ok = procsub_start(arena, &stages[parsed++]) == 0;
+        }
+    }
+
+    if (ok) {
+        // The stages own the fds from here on
+        if (in_fd != -1)
+            stages[0].input_fd = in_fd;
+        if (out_fd != -1)
+            stages[cmd_count - 1].output_fd = out_fd;
+        in_fd = out_fd = -1;
+
+        int nested = 0;
+        for (int i = 0; i < cmd_count; i++)
+            nested += procsub_pids(&stages[i], NULL);
+        pids = arena_alloc(arena, (cmd_count + nested) * sizeof(pid_t));
+        int n = execute_background(stages, cmd_count, pids, pgid);
+        for (int i = 0; i < cmd_count; i++)
+            n += procsub_pids(&stages[i], pids + n);
+        *count = n;
+    }
+
+    for (int i = 0; i < parsed; i++) {
+        close_command_fds(&stages[i]);
+        if (!ok)
+            procsub_finish(&stages[i]);
+    }
+    if (in_fd != -1)
+        close(in_fd);
+    if (out_fd != -1)
+        close(out_fd);
+    return pids;
+}
+
+/*
+ * procsub_start: Starts the substitutions of a command (see procsub.h).
+ */
+int procsub_start(Arena *arena, Command *cmd) {
+    for (int i = 0; i < cmd->sub_count; i++) {
+        ProcessSub *sub = &cmd->subs[i];
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            perror("myshell: pipe");
+            return -1;
+        }
+
+        // <(...) writes into the pipe, >(...) reads from it
+        sub->fd = sub->writable ? fds[1] : fds[0];
+        sub->pids = launch_text(arena, sub->text, "process substitution",
+                                sub->writable ? fds[0] : -1, sub->writable ? -1 : fds[1],
+                                NULL, &sub->pid_count);
+        if (!sub->pids)
+            return -1;
+
+        char *path = arena_alloc(arena, 32);
+        snprintf(path, 32, "/dev/fd/%d", sub->fd);
+        if (sub->arg >= 0)
+            cmd->args[sub->arg] = path;
+        else
+            cmd->redirs[sub->redir].path = path;
+    }
+    return 0;
+}
+
+/*
+ * procsub_pids: Collects the processes of a command's substitutions.
+ */
+int procsub_pids(const Command *cmd, pid_t *pids) {
+    int n = 0;
+    for (int i = 0; i < cmd->sub_count; i++) {
+        if (pids)
+            memcpy(pids + n, cmd->subs[i].pids, cmd->subs[i].pid_count * sizeof(pid_t));
+        n += cmd->subs[i].pid_count;
+    }
+    return n;
+}
+
+/*
+ * procsub_finish:
+ *
+ * Ends a command's substitutions. Closing the shell's end gives a >(...)
+ * command end of input; a <(...) command has lost its reader, so if it is
+ * still running it is sent SIGPIPE instead of being waited for.
+ */
+void procsub_finish(Command *cmd) {
+    for (int i = 0; i < cmd->sub_count; i++) {
+        ProcessSub *sub = &cmd->subs[i];
+        if (sub->fd != -1) {
+            close(sub->fd);
+            sub->fd = -1;
+        }
+        for (int j = 0; j < sub->pid_count; j++) {
+            pid_t pid = sub->pids[j];
+            if (pid <= 0)
+                continue;
+            // The pid is unreaped, so it is still ours to signal
+            if (!sub->writable && waitpid(pid, NULL, WNOHANG) == 0)
+                kill(pid, SIGPIPE);
+            while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+                ;
+            sub->pids[j] = -1;
+        }
+        sub->pid_count = 0;
+    }
+}
+
+/*
+ * coproc_close: Closes the shell's ends of the coprocess's pipes.
+ */
+static void coproc_close(int *fd) {
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/*
+ * move_fd: Moves a close-on-exec fd to the lowest free number >= 'base'.
+ */
+static int move_fd(int fd, int base) {
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, base);
+    if (moved < 0)
+        return fd;
+    close(fd);
+    return moved;
+}
+
+/*
+ * coproc_builtin: Implements 'coproc'.
+ *
+ * Returns:
+ *   0 on success, 1 if there is no coprocess or it could not be started,
+ *   2 on usage errors.
+ */
+int coproc_builtin(char **args) {
+    if (args[1] == NULL) {
+        if (coproc_write == -1 && coproc_read == -1) {
+            fprintf(stderr, "myshell: coproc: no coprocess\n");
+            return 1;
+        }
+        printf("stdin: /dev/fd/%d\n", coproc_write);
+        printf("stdout: /dev/fd/%d\n", coproc_read);
+        return 0;
+    }
+    if (strcmp(args[1], "-c") == 0) {
+        if (args[2] != NULL) {
+            fprintf(stderr, "usage: coproc [-c | command...]\n");
+            return 2;
+        }
+        coproc_close(&coproc_write);
+        return 0;
+    }
+
+    // The words are lexed again, so a quoted argument may hold a pipeline
+    size_t size = 1;
+    for (int i = 1; args[i]; i++)
+        size += strlen(args[i]) + 1;
+    char *text = arena_alloc(&coproc_arena, size);
+    char *out = text;
+    for (int i = 1; args[i]; i++)
+        out += sprintf(out, i == 1 ? "%s" : " %s", args[i]);
+
+    // A new coprocess replaces the shell's link to the previous one
+    coproc_close(&coproc_write);
+    coproc_close(&coproc_read);
+
+    int to_child[2], from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) < 0) {
+        perror("myshell: pipe");
+        arena_reset(&coproc_arena);
+        return 1;
+    }
+    if (pipe2(from_child, O_CLOEXEC) < 0) {
+        perror("myshell: pipe");
+        close(to_child[0]);
+        close(to_child[1]);
+        arena_reset(&coproc_arena);
+        return 1;
+    }
+    int write_fd = move_fd(to_child[1], COPROC_WRITE_FD);
+    int read_fd = move_fd(from_child[0], COPROC_READ_FD);
+
+    pid_t pgid;
+    int count;
+    pid_t *pids = launch_text(&coproc_arena, text, "coproc", to_child[0], from_child[1],
+                              &pgid, &count);
+    int live = 0;
+    for (int i = 0; pids && i < count; i++)
+        live += pids[i] > 0;
+    int status = 1;
+    if (live > 0) {
+        jobs_add(pids, count, pgid, text);
+        coproc_write = write_fd;
+        coproc_read = read_fd;
+        status = 0;
+    } else {
+        close(write_fd);
+        close(read_fd);
+    }
+    arena_reset(&coproc_arena);
+    return status;
+}
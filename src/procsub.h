@@ -0,0 +1,33 @@
+#ifndef PROCSUB_H
+#define PROCSUB_H
+
+#include "executor.h"
+#include "arena.h"
+
+// The coprocess's stdin and stdout, as the shell sees them (the lowest free
+// fds from these numbers are used, normally exactly these)
+#define COPROC_WRITE_FD 62
+#define COPROC_READ_FD 63
+
+// Starts the process substitutions of 'cmd'. Each runs as a background
+// pipeline connected to the shell by a pipe, and its argument or
+// redirection path becomes /dev/fd/N (N being the shell's end). Returns 0,
+// or -1 after printing an error; substitutions already started stay in
+// 'cmd' and are cleaned up by procsub_finish().
+int procsub_start(Arena *arena, Command *cmd);
+
+// Copies the pids of the started substitutions of 'cmd' to 'pids' (which
+// may be NULL to count them) and returns how many there are
+int procsub_pids(const Command *cmd, pid_t *pids);
+
+// Called once 'cmd' is done: closes the shell's pipe ends, tears down
+// <(...) substitutions that are still running and waits for all of them
+void procsub_finish(Command *cmd);
+
+// Implements the 'coproc' builtin:
+//   coproc command...    runs the command as a coprocess (and a job)
+//   coproc -c            closes the coprocess's stdin
+//   coproc               shows the coprocess and its paths
+int coproc_builtin(char **args);
+
+#endif // PROCSUB_H
@@ -0,0 +1,382 @@
+/*
+ * rcfile.c - Startup File and State Snapshots
+ *
+ * This file finds the rc file the shell runs at startup and keeps a
+ * binary snapshot of the state it leaves behind, so that a shell started
+ * again with the same rc file maps the snapshot instead of running it.
+ *
+ * Key Components:
+ *
+ * 1. Rc File:
+ *    - $MYSHELLRC if it is set (an empty value turns the rc file off),
+ *      otherwise ~/.myshellrc; myshell.c runs its lines like a script's
+ *
+ * 2. Pure Lines:
+ *    - A snapshot can only stand in for lines whose whole effect is state
+ *      it holds: variable assignments, export and unset with names, hash
+ *      with arguments and set -o/+o pipefail, with no command
+ *      substitutions, pathname expansion, redirections or pipes
+ *    - A snapshot is written only if every line of the rc file is pure
+ *      and succeeds; any other rc file simply runs on every start
+ *
+ * 3. Snapshot File:
+ *    - RC.snap next to the rc file: a header identifying the rc file
+ *      (device, inode, size, mtime) and the environment it ran in (a hash
+ *      of the inherited variables), then the variables, the command hash
+ *      table and the options
+ *    - Read through one read-only mmap(); the records are checked before
+ *      any of them is applied, and a snapshot that does not match is
+ *      ignored (and replaced once the rc file has run)
+ *    - Written to a temporary file and renamed, so a concurrent start
+ *      sees the old snapshot or the new one, never half of one
+ *
+ * Implementation Details:
+ * - Variable records: a flag byte (1 exported, 2 has a value) and the
+ *   "NAME=value" string, or the name alone; hash records: name and path
+ * - The whole variable table is saved: restoring it replaces the table
+ *   vars_init() imported, which an identical environment made identical
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rcfile.h"
+#include "parser.h"
+#include "arena.h"
+#include "vars.h"
+#include "pathcache.h"
+#include "options.h"
+
+#define SNAPSHOT_MAGIC "MYSHSNP1"
+#define SNAPSHOT_SUFFIX ".snap"
+
+#define VAR_EXPORTED 1
+#define VAR_HAS_VALUE 2
+
+extern char **environ;
+
+// Start of a snapshot file
+typedef struct {
+    char magic[8];
+    uint64_t size;              // Whole file, header included
+    uint64_t rc_dev;            // Identity of the rc file it was made from
+    uint64_t rc_ino;
+    uint64_t rc_size;
+    int64_t rc_mtime_sec;
+    int64_t rc_mtime_nsec;
+    uint64_t env_hash;          // Environment the rc file ran in
+    uint32_t var_count;
+    uint32_t path_count;
+    int32_t pipefail;
+    int32_t unused;
+} SnapshotHeader;
+
+// Growing buffer a snapshot is assembled in
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    uint32_t count;             // Records of the section being written
+} Buffer;
+
+static char *rc_path = NULL;
+static struct stat rc_stat;     // The rc file when rc_restore() looked at it
+static int rc_found = 0;
+static uint64_t env_hash = 0;   // Inherited environment, before the rc file ran
+
+/*
+ * oom: Reports an allocation failure and exits.
+ */
+static void oom(void) {
+    fprintf(stderr, "myshell: allocation error\n");
+    exit(EXIT_FAILURE);
+}
+
+const char *rc_file(void) {
+    if (rc_path)
+        return rc_path;
+    const char *path = getenv("MYSHELLRC");
+    const char *home = getenv("HOME");
+    if (path) {
+        if (*path == '\0')
+            return NULL;
+        rc_path = strdup(path);
+    } else if (home && *home) {
+        rc_path = malloc(strlen(home) + sizeof("/.myshellrc"));
+        if (rc_path)
+            sprintf(rc_path, "%s/.myshellrc", home);
+    } else {
+        return NULL;
+    }
+    if (!rc_path)
+        oom();
+    return rc_path;
+}
+
+/*
+ * snapshot_path: Returns the snapshot file of rc file 'path' (malloc'd).
+ */
+static char *snapshot_path(const char *path) {
+    char *snap = malloc(strlen(path) + sizeof(SNAPSHOT_SUFFIX));
+    if (!snap)
+        oom();
+    sprintf(snap, "%s" SNAPSHOT_SUFFIX, path);
+    return snap;
+}
+
+/*
+ * hash_environment: FNV-1a hash of the environment strings, in order.
+ */
+static uint64_t hash_environment(void) {
+    uint64_t h = 14695981039346656037u;
+    for (char **e = environ; *e; e++) {
+        for (const unsigned char *p = (const unsigned char *)*e; ; p++) {
+            h ^= *p;
+            h *= 1099511628211u;
+            if (*p == '\0')
+                break;
+        }
+    }
+    return h;
+}
+
+/*
+ * matches: Returns 1 if a snapshot header was made from the rc file as
+ * rc_stat describes it and from the current environment.
+ */
+static int matches(const SnapshotHeader *header, size_t size) {
+    return memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+           header->size == size &&
+           header->rc_dev == (uint64_t)rc_stat.st_dev &&
+           header->rc_ino == (uint64_t)rc_stat.st_ino &&
+           header->rc_size == (uint64_t)rc_stat.st_size &&
+           header->rc_mtime_sec == (int64_t)rc_stat.st_mtim.tv_sec &&
+           header->rc_mtime_nsec == (int64_t)rc_stat.st_mtim.tv_nsec &&
+           header->env_hash == env_hash;
+}
+
+/*
+ * next_string: Returns the string at *p and moves *p past its NUL, or
+ * returns NULL if no NUL comes before 'end'.
+ */
+static const char *next_string(const char **p, const char *end) {
+    const char *s = *p;
+    const char *nul = memchr(s, '\0', end - s);
+    if (!nul)
+        return NULL;
+    *p = nul + 1;
+    return s;
+}
+
+/*
+ * walk: Goes through the records of a snapshot, applying them if 'apply'
+ * is set. Returns 0, or -1 if the records are malformed.
+ */
+static int walk(const SnapshotHeader *header, const char *end, int apply) {
+    const char *p = (const char *)(header + 1);
+    for (uint32_t i = 0; i < header->var_count; i++) {
+        if (p == end)
+            return -1;
+        int flags = (unsigned char)*p++;
+        const char *text = next_string(&p, end);
+        if (!text)
+            return -1;
+        if (!apply)
+            continue;
+        if (flags & VAR_HAS_VALUE) {
+            vars_assign(text, flags & VAR_EXPORTED);
+        } else if (flags & VAR_EXPORTED) {
+            char *args[] = { "export", (char *)text, NULL };
+            export_builtin(args);
+        }
+    }
+    for (uint32_t i = 0; i < header->path_count; i++) {
+        const char *name = next_string(&p, end);
+        const char *path = name ? next_string(&p, end) : NULL;
+        if (!path)
+            return -1;
+        if (apply)
+            path_cache_add(name, path);
+    }
+    return p == end ? 0 : -1;
+}
+
+int rc_restore(const char *path) {
+    env_hash = hash_environment();
+    rc_found = stat(path, &rc_stat) == 0;
+    if (!rc_found)
+        return 0;
+
+    char *snap = snapshot_path(path);
+    int fd = open(snap, O_RDONLY | O_CLOEXEC);
+    free(snap);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    const SnapshotHeader *header = map;
+    const char *end = (const char *)map + st.st_size;
+    int restored = 0;
+    if (matches(header, st.st_size) && walk(header, end, 0) == 0) {
+        // The variables first: $PATH decides which hash entries are kept
+        vars_clear();
+        walk(header, end, 1);
+        shell_options.pipefail = header->pipefail;
+        restored = 1;
+    }
+    munmap(map, st.st_size);
+    return restored;
+}
+
+/*
+ * segment_pure: Returns 1 if the command of tokens [start, end) (words
+ * only) is pure (see rcfile.h).
+ */
+static int segment_pure(const TokenList *tokens, int start, int end) {
+    for (int i = start; i < end; i++) {
+        const char *text = token_text(tokens, i);
+        if (strstr(text, "$(") || (tokens->tokens[i].expand && strpbrk(text, "*?[")))
+            return 0;
+    }
+    int i = start;
+    while (i < end) {
+        const char *text = token_text(tokens, i);
+        size_t len = vars_name_length(text);
+        if (len == 0 || text[len] != '=')
+            break;
+        i++;
+    }
+    if (i == end)
+        return 1;
+
+    const char *name = token_text(tokens, i);
+    int argc = end - i - 1;
+    if (strcmp(name, "export") == 0 || strcmp(name, "unset") == 0 ||
+        strcmp(name, "hash") == 0)
+        return argc > 0;
+    if (strcmp(name, "set") == 0 && argc == 2) {
+        const char *flag = token_text(tokens, i + 1);
+        return (strcmp(flag, "-o") == 0 || strcmp(flag, "+o") == 0) &&
+               strcmp(token_text(tokens, i + 2), "pipefail") == 0;
+    }
+    return 0;
+}
+
+int rc_line_pure(const char *line) {
+    static Arena arena;
+    const TokenList *tokens = parse_input(&arena, line);
+    int pure = 1;
+    int start = 0;
+    for (int i = 0; pure && i <= tokens->count; i++) {
+        if (i < tokens->count && tokens->tokens[i].type == TOK_WORD)
+            continue;
+        if (i < tokens->count && tokens->tokens[i].type != TOK_SEMI)
+            pure = 0;
+        else
+            pure = segment_pure(tokens, start, i);
+        start = i + 1;
+    }
+    arena_reset(&arena);
+    return pure;
+}
+
+/*
+ * put: Appends 'len' bytes to a buffer.
+ */
+static void put(Buffer *b, const void *data, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 4096;
+        while (b->len + len > capacity)
+            capacity *= 2;
+        char *grown = realloc(b->data, capacity);
+        if (!grown)
+            oom();
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void put_var(const char *name, const char *entry, int exported, void *ctx) {
+    Buffer *b = ctx;
+    unsigned char flags = (exported ? VAR_EXPORTED : 0) | (entry ? VAR_HAS_VALUE : 0);
+    const char *text = entry ? entry : name;
+    put(b, &flags, 1);
+    put(b, text, strlen(text) + 1);
+    b->count++;
+}
+
+static void put_path(const char *name, const char *path, void *ctx) {
+    Buffer *b = ctx;
+    put(b, name, strlen(name) + 1);
+    put(b, path, strlen(path) + 1);
+    b->count++;
+}
+
+void rc_save(const char *path) {
+    struct stat st;
+    // Not if the rc file changed while it ran
+    if (!rc_found || stat(path, &st) != 0 || st.st_ino != rc_stat.st_ino ||
+        st.st_size != rc_stat.st_size || st.st_mtim.tv_sec != rc_stat.st_mtim.tv_sec ||
+        st.st_mtim.tv_nsec != rc_stat.st_mtim.tv_nsec)
+        return;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.rc_dev = rc_stat.st_dev;
+    header.rc_ino = rc_stat.st_ino;
+    header.rc_size = rc_stat.st_size;
+    header.rc_mtime_sec = rc_stat.st_mtim.tv_sec;
+    header.rc_mtime_nsec = rc_stat.st_mtim.tv_nsec;
+    header.env_hash = env_hash;
+    header.pipefail = shell_options.pipefail;
+
+    Buffer b = { NULL, 0, 0, 0 };
+    put(&b, &header, sizeof(header));
+    vars_each(put_var, &b);
+    header.var_count = b.count;
+    b.count = 0;
+    path_cache_each(put_path, &b);
+    header.path_count = b.count;
+    header.size = b.len;
+    memcpy(b.data, &header, sizeof(header));
+
+    char *snap = snapshot_path(path);
+    char *tmp = malloc(strlen(snap) + 32);
+    if (!tmp)
+        oom();
+    sprintf(tmp, "%s.%ld", snap, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = fd >= 0;
+    for (size_t done = 0; ok && done < b.len; ) {
+        ssize_t n = write(fd, b.data + done, b.len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        ok = n > 0;
+        done += ok ? (size_t)n : 0;
+    }
+    if (fd >= 0 && close(fd) != 0)
+        ok = 0;
+    if (ok && rename(tmp, snap) != 0)
+        ok = 0;
+    if (!ok && fd >= 0)
+        unlink(tmp);
+    free(tmp);
+    free(snap);
+    free(b.data);
+}
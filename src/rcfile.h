@@ -0,0 +1,22 @@
+#ifndef RCFILE_H
+#define RCFILE_H
+
+// Returns the rc file to load at startup: $MYSHELLRC if it is set (empty
+// for none), else ~/.myshellrc; NULL if there is none to load
+const char *rc_file(void);
+
+// Restores the state rc file 'path' left behind from its snapshot, if the
+// snapshot was made from the same file and the same environment. Returns
+// 1 if it was restored, 0 if the rc file has to be run.
+int rc_restore(const char *path);
+
+// Returns 1 if command line 'line' only makes changes a snapshot holds:
+// assignments, 'export NAME...', 'unset NAME...', 'hash' with arguments
+// and 'set -o pipefail' / 'set +o pipefail'
+int rc_line_pure(const char *line);
+
+// Saves the shell's state as the snapshot of rc file 'path', after all of
+// its lines were pure and succeeded. Failing to write it is not an error.
+void rc_save(const char *path);
+
+#endif // RCFILE_H
@@ -0,0 +1,153 @@
+/*
+ * redirect.c - Redirection Plans
+ *
+ * This file resolves the redirections of a command. The parser only
+ * records them (target fd, open flags and file name, in command-line
+ * order) in the Command; the files are opened here when the command is
+ * actually started and closed again as soon as it is running, so a
+ * pipeline never holds the files of stages that have not started yet.
+ *
+ * Key Components:
+ * - Working directory fd: files are opened with openat() relative to a
+ *   cached O_PATH descriptor of the shell's cwd, refreshed after 'cd'
+ * - Plans: every redirection of a command is opened in order, so each
+ *   file is created or truncated even when a later one replaces it
+ * - Here-documents and here-strings: the text becomes stdin without a
+ *   file on disk; a body that fits is written into a pipe whose write end
+ *   is closed at once, a larger one into a memfd, so the shell never
+ *   blocks on a reader that has not started
+ *
+ * Implementation Details:
+ * - All descriptors are close-on-exec; the spawn plan dup2()s them into place
+ * - A failing open closes what was already opened for the command
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "redirect.h"
+
+// Largest here-document body tried in a pipe (the default pipe capacity)
+#define HERE_PIPE_MAX (64 * 1024)
+
+static int cwd_fd = -1;
+
+/*
+ * open_cwd: Opens a file relative to the cached working directory.
+ */
+int open_cwd(const char *path, int flags) {
+    if (cwd_fd < 0) {
+        cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    }
+    int dir = cwd_fd >= 0 ? cwd_fd : AT_FDCWD;
+    return openat(dir, path, flags | O_CLOEXEC, 0644);
+}
+
+void redirect_cwd_changed(void) {
+    if (cwd_fd >= 0) {
+        close(cwd_fd);
+        cwd_fd = -1;
+    }
+}
+
+void redirect_close(int fds[3]) {
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != -1)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+/*
+ * redirect_here: Returns a readable fd holding 'data' (see redirect.h).
+ */
+int redirect_here(const char *data, size_t length) {
+    if (length <= HERE_PIPE_MAX) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+            return -1;
+        // A pipe with a smaller capacity takes part of it; use a memfd then
+        ssize_t n = 0;
+        if (length > 0 && fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0)
+            n = write(fds[1], data, length);
+        close(fds[1]);
+        if (n == (ssize_t)length)
+            return fds[0];
+        close(fds[0]);
+    }
+
+    int fd = memfd_create("here-document", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        done += n;
+    }
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * redirect_open: Opens a command's redirection plan.
+ */
+int redirect_open(const Command *cmd, int fds[3]) {
+    fds[0] = fds[1] = fds[2] = -1;
+    for (int i = 0; i < cmd->redir_count; i++) {
+        const Redirection *r = &cmd->redirs[i];
+        int fd = r->data ? redirect_here(r->data, strlen(r->data)) : open_cwd(r->path, r->flags);
+        if (fd < 0 && r->data) {
+            fprintf(stderr, "myshell: here-document: %s\n", strerror(errno));
+            redirect_close(fds);
+            return -1;
+        }
+        if (fd < 0) {
+            fprintf(stderr, "myshell: %s: %s\n", r->path, strerror(errno));
+            redirect_close(fds);
+            return -1;
+        }
+        if (fds[r->target_fd] != -1)
+            close(fds[r->target_fd]);
+        fds[r->target_fd] = fd;
+    }
+    return 0;
+}
+
+/*
+ * redirect_resolve: Opens a command's redirection plan and merges the
+ * files with the fds supplied by the shell (Command.input_fd etc.); file
+ * redirections take precedence.
+ */
+int redirect_resolve(const Command *cmd, int fds[3], int opened[3]) {
+    if (redirect_open(cmd, opened) < 0)
+        return -1;
+    fds[STDIN_FILENO] = opened[STDIN_FILENO] != -1 ? opened[STDIN_FILENO] : cmd->input_fd;
+    fds[STDOUT_FILENO] = opened[STDOUT_FILENO] != -1 ? opened[STDOUT_FILENO] : cmd->output_fd;
+    fds[STDERR_FILENO] = opened[STDERR_FILENO] != -1 ? opened[STDERR_FILENO] : cmd->error_fd;
+    return 0;
+}
+
+int redirects_fd(const Command *cmd, int target_fd) {
+    for (int i = 0; i < cmd->redir_count; i++) {
+        if (cmd->redirs[i].target_fd == target_fd)
+            return 1;
+    }
+    return 0;
+}
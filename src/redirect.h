@@ -0,0 +1,36 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <stddef.h>
+#include "executor.h"
+
+// Opens 'path' (with O_CLOEXEC added) relative to the shell's working
+// directory through a cached directory fd. Returns the fd or -1 with errno set.
+int open_cwd(const char *path, int flags);
+
+// Returns a close-on-exec fd from which 'length' bytes of 'data' can be
+// read (a pipe for small texts, a memfd otherwise), or -1 with errno set
+int redirect_here(const char *data, size_t length);
+
+// Drops the cached working directory fd; call after a successful chdir()
+void redirect_cwd_changed(void);
+
+// Opens the redirections of 'cmd' in command-line order. fds[n] receives the
+// file for fd n, or -1 if fd n is not redirected; a later redirection of the
+// same fd replaces (and closes) an earlier one. Returns 0, or -1 after
+// printing an error, in which case nothing is left open.
+int redirect_open(const Command *cmd, int fds[3]);
+
+// Opens the redirections of 'cmd' like redirect_open() and merges them with
+// the fds the shell attached to it: fds[n] is the fd to use as fd n (-1 to
+// inherit the shell's). 'opened' receives the files to close afterwards
+// with redirect_close(). Returns 0, or -1 after printing an error.
+int redirect_resolve(const Command *cmd, int fds[3], int opened[3]);
+
+// Closes the fds returned by redirect_open()
+void redirect_close(int fds[3]);
+
+// Returns 1 if 'cmd' redirects 'target_fd', 0 otherwise
+int redirects_fd(const Command *cmd, int target_fd);
+
+#endif // REDIRECT_H
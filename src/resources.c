@@ -0,0 +1,367 @@
+/*
+ * resources.c - Resource Limits and Placement
+ *
+ * This file implements the builtins that bound what commands may use and
+ * decide where they run:
+ *
+ *   ulimit [-H|-S] [-a|-c|-d|-f|-l|-m|-n|-s|-t|-u|-v] [limit|unlimited]
+ *   place [-c cpus] [-n nice] [-i class[:level]] [-g cgroup] command [args...]
+ *
+ * Key Components:
+ *
+ * 1. Resource Limits:
+ *    - ulimit reads and sets the shell's own rlimits; every child inherits
+ *      them through fork and exec, so nothing is applied per launch
+ *    - Sizes are shown and given in 512-byte blocks (-c, -f) or KiB (-d,
+ *      -l, -m, -s, -v), like other shells; -S / -H pick the soft or the
+ *      hard limit, and setting without either sets both
+ *
+ * 2. Placement:
+ *    - place builds a SpawnPlacement (spawn.h) and runs its command through
+ *      execute_placed(); the child sets its CPU affinity, nice value and
+ *      I/O priority between fork and exec, so no taskset(1), nice(1),
+ *      ionice(1) or cgexec process sits between the shell and the command
+ *    - A cgroup is a cgroup v2 directory; the child is created inside it
+ *      (clone3 with CLONE_INTO_CGROUP) where the kernel supports it
+ *
+ * Implementation Details:
+ * - CPU lists use the kernel's format: "0-3,8,10-11"
+ * - I/O classes are realtime (rt), best-effort (be) and idle, or 1-3 as
+ *   for ionice(1); a level (0-7, default 4) follows a colon
+ * - The same cgroup check serves 'set cgroup=DIR' (options.c)
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include "resources.h"
+#include "executor.h"
+#include "spawn.h"
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_DEFAULT_LEVEL 4
+
+// A limit 'ulimit' knows
+typedef struct {
+    char option;        // Its ulimit option letter
+    int resource;       // RLIMIT_*
+    rlim_t unit;        // Bytes (or seconds, or items) per unit shown
+    const char *name;
+    const char *units;  // Shown by 'ulimit -a' (NULL: a plain count)
+} Limit;
+
+// Sorted by option letter, which is the order 'ulimit -a' lists them in
+static const Limit limits[] = {
+    { 'c', RLIMIT_CORE, 512, "core file size", "blocks" },
+    { 'd', RLIMIT_DATA, 1024, "data seg size", "kbytes" },
+    { 'f', RLIMIT_FSIZE, 512, "file size", "blocks" },
+    { 'l', RLIMIT_MEMLOCK, 1024, "max locked memory", "kbytes" },
+    { 'm', RLIMIT_RSS, 1024, "max memory size", "kbytes" },
+    { 'n', RLIMIT_NOFILE, 1, "open files", NULL },
+    { 's', RLIMIT_STACK, 1024, "stack size", "kbytes" },
+    { 't', RLIMIT_CPU, 1, "cpu time", "seconds" },
+    { 'u', RLIMIT_NPROC, 1, "max user processes", NULL },
+    { 'v', RLIMIT_AS, 1024, "virtual memory", "kbytes" },
+};
+#define LIMIT_COUNT (int)(sizeof(limits) / sizeof(limits[0]))
+
+/*
+ * find_limit: Returns the limit with ulimit option 'option', or NULL.
+ */
+static const Limit *find_limit(char option) {
+    for (int i = 0; i < LIMIT_COUNT; i++) {
+        if (limits[i].option == option)
+            return &limits[i];
+    }
+    return NULL;
+}
+
+/*
+ * show_limit: Prints a limit's soft (or with 'hard' its hard) value; with
+ * 'label', as a line of 'ulimit -a'.
+ *
+ * Returns:
+ *   0, or 1 if the limit could not be read.
+ */
+static int show_limit(const Limit *limit, int hard, int label) {
+    struct rlimit rl;
+    if (getrlimit(limit->resource, &rl) < 0) {
+        fprintf(stderr, "myshell: ulimit: %s: %s\n", limit->name, strerror(errno));
+        return 1;
+    }
+    if (label) {
+        char text[64];
+        if (limit->units)
+            snprintf(text, sizeof(text), "%s (%s, -%c)", limit->name, limit->units, limit->option);
+        else
+            snprintf(text, sizeof(text), "%s (-%c)", limit->name, limit->option);
+        printf("%-32s", text);
+    }
+    rlim_t value = hard ? rl.rlim_max : rl.rlim_cur;
+    if (value == RLIM_INFINITY)
+        printf("unlimited\n");
+    else
+        printf("%llu\n", (unsigned long long)(value / limit->unit));
+    return 0;
+}
+
+/*
+ * parse_limit: Parses a limit value in the limit's units, or "unlimited".
+ *
+ * Returns:
+ *   0 on success, -1 if 'text' is not a value the limit can hold.
+ */
+static int parse_limit(const Limit *limit, const char *text, rlim_t *value) {
+    if (strcmp(text, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || text[0] == '-' ||
+        number > (unsigned long long)(RLIM_INFINITY - 1) / limit->unit)
+        return -1;
+    *value = (rlim_t)number * limit->unit;
+    return 0;
+}
+
+/*
+ * ulimit_builtin: Implements the 'ulimit' builtin.
+ *
+ *   ulimit [-H|-S] -X         - show limit X (default: -f)
+ *   ulimit [-H|-S] -a         - show all limits
+ *   ulimit [-H|-S] -X VALUE   - set limit X for the shell and its children
+ *
+ * Returns:
+ *   0 on success, 1 if a limit could not be read or changed, 2 on usage
+ *   errors.
+ */
+int ulimit_builtin(char **args) {
+    int hard = 0, soft = 0, all = 0;
+    const Limit *limit = NULL;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *p = args[i] + 1; *p; p++) {
+            if (*p == 'H') {
+                hard = 1;
+            } else if (*p == 'S') {
+                soft = 1;
+            } else if (*p == 'a') {
+                all = 1;
+            } else if ((limit = find_limit(*p)) == NULL) {
+                fprintf(stderr, "myshell: ulimit: -%c: invalid option\n", *p);
+                fprintf(stderr, "usage: ulimit [-H|-S] [-a|-c|-d|-f|-l|-m|-n|-s|-t|-u|-v] [limit|unlimited]\n");
+                return 2;
+            }
+        }
+    }
+
+    if (all) {
+        if (args[i] != NULL) {
+            fprintf(stderr, "myshell: ulimit: %s: too many arguments\n", args[i]);
+            return 2;
+        }
+        int status = 0;
+        for (int k = 0; k < LIMIT_COUNT; k++)
+            status |= show_limit(&limits[k], hard && !soft, 1);
+        return status;
+    }
+    if (limit == NULL)
+        limit = find_limit('f');
+    if (args[i] == NULL)
+        return show_limit(limit, hard && !soft, 0);
+    if (args[i + 1] != NULL) {
+        fprintf(stderr, "myshell: ulimit: %s: too many arguments\n", args[i + 1]);
+        return 2;
+    }
+
+    rlim_t value;
+    if (parse_limit(limit, args[i], &value) < 0) {
+        fprintf(stderr, "myshell: ulimit: %s: invalid limit\n", args[i]);
+        return 1;
+    }
+    struct rlimit rl;
+    if (getrlimit(limit->resource, &rl) < 0) {
+        fprintf(stderr, "myshell: ulimit: %s: %s\n", limit->name, strerror(errno));
+        return 1;
+    }
+    if (!hard && !soft)
+        hard = soft = 1;
+    if (soft)
+        rl.rlim_cur = value;
+    if (hard)
+        rl.rlim_max = value;
+    if (setrlimit(limit->resource, &rl) < 0) {
+        fprintf(stderr, "myshell: ulimit: %s: cannot modify limit: %s\n", limit->name, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * parse_cpus: Adds the CPUs of list 'text' ("0-3,8") to a placement.
+ *
+ * Returns:
+ *   0 on success, -1 if 'text' is not a CPU list.
+ */
+static int parse_cpus(const char *text, SpawnPlacement *placement) {
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+        if (last >= SPAWN_MAX_CPUS)
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++)
+            spawn_placement_add_cpu(placement, (int)cpu);
+        if (*end == ',' && end[1] != '\0')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return placement->set_cpus ? 0 : -1;
+}
+
+/*
+ * parse_ioprio: Parses an I/O priority, CLASS[:LEVEL], into the value
+ * ioprio_set() takes.
+ *
+ * Returns:
+ *   The priority, or -1 if 'text' is not one.
+ */
+static int parse_ioprio(const char *text) {
+    static const struct { const char *name; int class; } classes[] = {
+        { "realtime", 1 }, { "rt", 1 }, { "1", 1 },
+        { "best-effort", 2 }, { "be", 2 }, { "2", 2 },
+        { "idle", 3 }, { "3", 3 },
+    };
+    const char *colon = strchr(text, ':');
+    size_t len = colon ? (size_t)(colon - text) : strlen(text);
+    int class = 0;
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) == len && strncmp(text, classes[i].name, len) == 0)
+            class = classes[i].class;
+    }
+    if (class == 0)
+        return -1;
+
+    int level = class == 3 ? 0 : IOPRIO_DEFAULT_LEVEL;
+    if (colon) {
+        if (colon[1] < '0' || colon[1] > '7' || colon[2] != '\0' || class == 3)
+            return -1;
+        level = colon[1] - '0';
+    }
+    return class << IOPRIO_CLASS_SHIFT | level;
+}
+
+int cgroup_open(const char *who, const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "myshell: %s: %s: %s\n", who, path, strerror(errno));
+        return -1;
+    }
+    struct statfs fs;
+    if (fstatfs(fd, &fs) < 0 || fs.f_type != CGROUP2_SUPER_MAGIC ||
+        faccessat(fd, "cgroup.procs", W_OK, 0) < 0) {
+        fprintf(stderr, "myshell: %s: %s: not a writable cgroup v2 directory\n", who, path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * place_builtin: Implements 'place [-c CPUS] [-n NICE] [-i CLASS[:LEVEL]]
+ * [-g CGROUP] command...'.
+ *
+ * The command runs as a pipeline stage of the shell itself (see
+ * execute_placed()) and only its process is moved, so the shell keeps
+ * its own CPUs, priorities and cgroup.
+ *
+ * Returns:
+ *   The command's status, or 125 on usage errors.
+ */
+int place_builtin(char **args) {
+    SpawnPlacement placement;
+    spawn_placement_init(&placement);
+    int i = 1;
+    int status = 0;
+    for (; status == 0 && args[i] && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        const char *value = args[i + 1];
+        if (value == NULL || args[i][2] != '\0')
+            break;
+        char *end;
+        switch (args[i][1]) {
+        case 'c':
+            if (parse_cpus(value, &placement) < 0) {
+                fprintf(stderr, "myshell: place: %s: invalid CPU list\n", value);
+                status = 125;
+            }
+            break;
+        case 'n':
+            placement.nice = (int)strtol(value, &end, 10);
+            if (end == value || *end != '\0' || placement.nice < -40 || placement.nice > 40) {
+                fprintf(stderr, "myshell: place: %s: invalid nice increment\n", value);
+                status = 125;
+            }
+            break;
+        case 'i':
+            placement.ioprio = parse_ioprio(value);
+            if (placement.ioprio < 0) {
+                fprintf(stderr, "myshell: place: %s: invalid I/O priority\n", value);
+                status = 125;
+            }
+            break;
+        case 'g':
+            if (placement.cgroup_fd >= 0)
+                close(placement.cgroup_fd);
+            placement.cgroup_fd = cgroup_open("place", value);
+            if (placement.cgroup_fd < 0)
+                status = 125;
+            break;
+        default:
+            fprintf(stderr, "myshell: place: %s: invalid option\n", args[i]);
+            status = 125;
+            break;
+        }
+        i++;
+    }
+    if (status == 0 && args[i] == NULL) {
+        fprintf(stderr, "usage: place [-c cpus] [-n nice] [-i class[:level]] [-g cgroup] command [args...]\n");
+        status = 125;
+    }
+
+    if (status == 0) {
+        Command cmd = { .args = &args[i], .input_fd = -1, .output_fd = -1, .error_fd = -1 };
+        fflush(stdout);
+        status = execute_placed(&cmd, 1, &placement);
+    }
+    if (placement.cgroup_fd >= 0)
+        close(placement.cgroup_fd);
+    return status;
+}
@@ -0,0 +1,20 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+// Implements the 'ulimit' builtin:
+//   ulimit [-H|-S] [-a|-c|-d|-f|-l|-m|-n|-s|-t|-u|-v] [limit|unlimited]
+// shows or sets a resource limit of the shell, which every command it
+// starts inherits
+int ulimit_builtin(char **args);
+
+// Implements the 'place' builtin:
+//   place [-c cpus] [-n nice] [-i class[:level]] [-g cgroup] command [args...]
+// runs the command on the given CPUs, nice increment, I/O priority and
+// cgroup v2 directory, set up between its fork and its exec
+int place_builtin(char **args);
+
+// Opens cgroup v2 directory 'path' for placing children in it. Returns the
+// fd (close-on-exec), or -1 after printing an error prefixed by 'who'.
+int cgroup_open(const char *who, const char *path);
+
+#endif // RESOURCES_H
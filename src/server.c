@@ -0,0 +1,580 @@
+/*
+ * server.c - Shell Server Mode
+ *
+ * 'myshell --server PATH' listens on a Unix socket and runs the command
+ * lines sent over each connection, so an orchestrator starts the shell
+ * once instead of once per job:
+ *
+ *   $ myshell --server /tmp/sh.sock &
+ *   $ printf 'cd /tmp; echo hi\n' | socat - UNIX-CONNECT:/tmp/sh.sock
+ *   out 3
+ *   hi
+ *   status 0
+ *
+ * Key Components:
+ *
+ * 1. Sessions:
+ *    - Each connection gets a session: a child forked from the server that
+ *      reads lines from the connection and runs them with execute_line()
+ *    - Sessions start with the caches the server has warmed (paths, parses,
+ *      directories) and have their own working directory, variables, jobs
+ *      and $?, so a client's 'cd' or 'export' never reaches another one
+ *    - A session ends when its client closes the connection or runs 'exit'
+ *
+ * 2. Streams:
+ *    - The session's stdout and stderr are pipes read by the server, which
+ *      sends what arrives as frames: "out N\n" or "err N\n" and N bytes
+ *    - After each line the client receives "status N\n", once everything
+ *      the line wrote before finishing has been sent: the status goes over
+ *      a socket pair, and the session waits for the server to acknowledge
+ *      it (after draining stdout and stderr) before it runs the next line
+ *    - Descriptors sent with SCM_RIGHTS along with the first line are used
+ *      directly instead (stdin, stdout, stderr, in that order; fewer may be
+ *      sent), so output reaches the client's own files without a copy and
+ *      the connection only carries the status frames
+ *    - stdin is /dev/null otherwise, so a command never swallows the lines
+ *      that follow it
+ *
+ * 3. Event Loop:
+ *    - One epoll set holds the listening socket, the pipes of all sessions
+ *      and a signalfd: SIGCHLD reaps sessions, SIGINT and SIGTERM stop the
+ *      server
+ *    - Connections are written without blocking; while a frame is pending
+ *      the session's pipes are not read, so a slow client only slows down
+ *      its own commands (through their full pipe)
+ *
+ * Implementation Details:
+ * - A stale socket file (nobody accepting on it) is replaced, and the
+ *   socket is removed when the server stops
+ * - Frames carry at most FRAME_DATA bytes; the client table doubles
+ * - Each session is a process group, which is sent SIGHUP if its client
+ *   hangs up (or the server stops), ending the commands still running
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "server.h"
+
+#define MAX_EVENTS 64
+#define FRAME_DATA 65536
+#define FRAME_HEADER 16     // Room for "out 65536\n"
+#define PASSED_FDS 3        // stdin, stdout and stderr
+
+// A session's pipes, then the other event sources (epoll data is
+// slot << 3 | source)
+enum { STREAM_OUT, STREAM_ERR, STREAM_STATUS, STREAM_COUNT };
+enum { SOURCE_CONN = STREAM_COUNT, SOURCE_LISTEN, SOURCE_SIGNAL };
+
+typedef struct {
+    int conn;                   // The connection (-1: free slot)
+    int pipes[STREAM_COUNT];    // Server ends of the session's pipes (-1 at end of file)
+    pid_t pid;                  // The session (-1 once reaped)
+    char *frame;                // FRAME_HEADER + FRAME_DATA bytes
+    size_t frame_sent;          // Offset of the first byte of the frame not yet written
+    size_t frame_len;           // Offset of its end (0: no frame)
+    int held;                   // The pipes are out of the epoll set (see hold())
+} Client;
+
+static Client *clients = NULL;
+static int client_capacity = 0;
+static int epoll_fd = -1;
+static int listen_fd = -1;
+static int signal_fd = -1;
+static int status_fd = -1;      // In a session: its end of the status socket pair
+
+/*
+ * watch: Adds 'fd' to the epoll set as 'source' of client 'slot'.
+ */
+static void watch(int fd, uint32_t events, int slot, int source) {
+    struct epoll_event ev = { .events = events };
+    ev.data.u64 = (uint64_t)slot << 3 | source;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * hold: While a frame is pending, waits for room on the connection instead
+ * of reading the session's pipes; afterwards the other way round. The
+ * pipes are taken out of the set, as a hangup would be reported anyway.
+ */
+static void hold(int slot, int pending) {
+    Client *c = &clients[slot];
+    if (c->held == pending)
+        return;
+    c->held = pending;
+    struct epoll_event ev = { .events = pending ? EPOLLOUT : 0 };
+    ev.data.u64 = (uint64_t)slot << 3 | SOURCE_CONN;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->conn, &ev);
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (c->pipes[i] == -1)
+            continue;
+        if (pending)
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->pipes[i], NULL);
+        else
+            watch(c->pipes[i], EPOLLIN, slot, i);
+    }
+}
+
+/*
+ * close_client: Closes a connection and the pipes of its session; if the
+ * client hung up, the session's process group is sent SIGHUP.
+ */
+static void close_client(int slot, int hangup) {
+    Client *c = &clients[slot];
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (c->pipes[i] != -1)
+            close(c->pipes[i]);
+        c->pipes[i] = -1;
+    }
+    if (hangup && c->pid > 0)
+        kill(-c->pid, SIGHUP);
+
+    // Lines the session never read (after 'exit') are discarded: closing
+    // with unread data would reset the connection, losing the last frames
+    char scrap[4096];
+    while (recv(c->conn, scrap, sizeof(scrap), MSG_DONTWAIT) > 0)
+        ;
+    close(c->conn);
+    c->conn = -1;
+    c->frame_len = c->frame_sent = 0;
+    c->held = 0;
+}
+
+/*
+ * flush: Writes as much of the pending frame as the connection takes.
+ *
+ * Returns:
+ *   0 once the frame is sent, 1 if some is left, -1 if the client is gone.
+ */
+static int flush(Client *c) {
+    while (c->frame_sent < c->frame_len) {
+        ssize_t n = send(c->conn, c->frame + c->frame_sent, c->frame_len - c->frame_sent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (n < 0)
+            return -1;
+        c->frame_sent += n;
+    }
+    c->frame_len = c->frame_sent = 0;
+    return 0;
+}
+
+/*
+ * next_frame: Reads the next frame from the session's pipes: output first,
+ * status lines only once stdout and stderr have nothing more right now.
+ *
+ * Returns:
+ *   1 if a frame is ready, 0 if no pipe has data.
+ */
+static int next_frame(Client *c) {
+    static const char *const names[] = { "out", "err" };
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (c->pipes[i] == -1)
+            continue;
+        // Status lines are sent as the session wrote them, output after
+        // a header written in front of it
+        size_t start = i == STREAM_STATUS ? 0 : FRAME_HEADER;
+        ssize_t n = read(c->pipes[i], c->frame + start, FRAME_DATA);
+        if (n < 0 && errno == EINTR) {
+            i--;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (n <= 0) {
+            close(c->pipes[i]);
+            c->pipes[i] = -1;
+            continue;
+        }
+        c->frame_sent = 0;
+        c->frame_len = start + n;
+        if (i == STREAM_STATUS) {
+            // The session may go on: what it wrote so far has been read
+            while (send(c->pipes[i], "", 1, MSG_NOSIGNAL) < 0 && errno == EINTR)
+                ;
+        } else {
+            char header[FRAME_HEADER];
+            int len = snprintf(header, sizeof(header), "%s %zd\n", names[i], n);
+            c->frame_sent = FRAME_HEADER - len;
+            memcpy(c->frame + c->frame_sent, header, len);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * pump: Forwards what the session of client 'slot' wrote until its pipes
+ * are empty or the connection is full. The client is closed once all its
+ * pipes are at end of file or if it went away.
+ */
+static void pump(int slot) {
+    Client *c = &clients[slot];
+    int state = flush(c);
+    while (state == 0 && next_frame(c))
+        state = flush(c);
+    if (state < 0) {
+        close_client(slot, 1);
+        return;
+    }
+    hold(slot, state == 1);
+
+    int open = 0;
+    for (int i = 0; i < STREAM_COUNT; i++)
+        open += c->pipes[i] != -1;
+    if (!open && state == 0)
+        close_client(slot, 0);
+}
+
+/*
+ * read_first_line:
+ *
+ * Reads the first line of a connection one byte at a time, so nothing
+ * after it is taken from the session's input, and collects descriptors
+ * the client sent with it.
+ *
+ * Parameters:
+ *   conn - The connection.
+ *   fds - Receives up to PASSED_FDS descriptors (close-on-exec).
+ *   count - Receives how many were passed.
+ *
+ * Returns:
+ *   The line without its newline (malloc'd), or NULL at end of file.
+ */
+static char *read_first_line(int conn, int *fds, int *count) {
+    size_t capacity = 256;
+    size_t len = 0;
+    char *line = malloc(capacity);
+    int eof = 0;
+    if (!line) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    *count = 0;
+
+    while (1) {
+        char control[CMSG_SPACE(PASSED_FDS * sizeof(int))];
+        char c;
+        struct iovec iov = { &c, 1 };
+        struct msghdr msg = { 0 };
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); n > 0 && cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+                continue;
+            int passed = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int *data = (int *)CMSG_DATA(cm);
+            for (int i = 0; i < passed; i++) {
+                if (*count < PASSED_FDS)
+                    fds[(*count)++] = data[i];
+                else
+                    close(data[i]);
+            }
+        }
+
+        eof = n <= 0;
+        if (eof || c == '\n')
+            break;
+        if (len + 1 == capacity) {
+            capacity *= 2;
+            char *grown = realloc(line, capacity);
+            if (!grown) {
+                fprintf(stderr, "myshell: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+            line = grown;
+        }
+        line[len++] = c;
+    }
+
+    if (eof && len == 0) {
+        free(line);
+        return NULL;
+    }
+    line[len] = '\0';
+    return line;
+}
+
+/*
+ * run_session: Body of a session process (see start_session()). Never
+ * returns.
+ */
+static void run_session(int conn, int pipes[][2], ServerSession session) {
+    // Only this connection and the write ends of its pipes are kept
+    close(epoll_fd);
+    close(listen_fd);
+    close(signal_fd);
+    for (int i = 0; i < client_capacity; i++) {
+        if (clients[i].conn == -1)
+            continue;
+        close(clients[i].conn);
+        for (int j = 0; j < STREAM_COUNT; j++) {
+            if (clients[i].pipes[j] != -1)
+                close(clients[i].pipes[j]);
+        }
+    }
+    for (int i = 0; i < STREAM_COUNT; i++)
+        close(pipes[i][0]);
+
+    setpgid(0, 0);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd >= 0)
+        dup2(null_fd, STDIN_FILENO);
+    dup2(pipes[STREAM_OUT][1], STDOUT_FILENO);
+    dup2(pipes[STREAM_ERR][1], STDERR_FILENO);
+    status_fd = pipes[STREAM_STATUS][1];
+
+    int fds[PASSED_FDS];
+    int count;
+    char *first = read_first_line(conn, fds, &count);
+    for (int i = 0; i < count; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    close(pipes[STREAM_OUT][1]);
+    close(pipes[STREAM_ERR][1]);
+    if (null_fd >= 0)
+        close(null_fd);
+
+    int status = session(conn, first);
+    free(first);
+    fflush(stdout);
+    exit(status);
+}
+
+/*
+ * start_session: Forks the session of a new connection and adds its pipes
+ * to the event loop.
+ */
+static void start_session(int conn, ServerSession session) {
+    int slot = 0;
+    while (slot < client_capacity && clients[slot].conn != -1)
+        slot++;
+    if (slot == client_capacity) {
+        int capacity = client_capacity ? 2 * client_capacity : 16;
+        Client *grown = realloc(clients, capacity * sizeof(Client));
+        if (!grown) {
+            fprintf(stderr, "myshell: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = client_capacity; i < capacity; i++) {
+            grown[i].conn = -1;
+            grown[i].frame = NULL;
+        }
+        clients = grown;
+        client_capacity = capacity;
+    }
+    Client *c = &clients[slot];
+    if (!c->frame && !(c->frame = malloc(FRAME_HEADER + FRAME_DATA))) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int pipes[STREAM_COUNT][2];
+    int made = 0;
+    while (made < STREAM_COUNT &&
+           (made == STREAM_STATUS
+                ? socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pipes[made])
+                : pipe2(pipes[made], O_CLOEXEC)) == 0)
+        made++;
+    pid_t pid = -1;
+    if (made == STREAM_COUNT) {
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0)
+            run_session(conn, pipes, session);
+    }
+    if (pid < 0) {
+        perror(made == STREAM_COUNT ? "myshell: fork" : "myshell: pipe");
+        for (int i = 0; i < made; i++) {
+            close(pipes[i][0]);
+            close(pipes[i][1]);
+        }
+        close(conn);
+        return;
+    }
+
+    c->conn = conn;
+    c->pid = pid;
+    c->frame_len = c->frame_sent = 0;
+    c->held = 0;
+    watch(conn, 0, slot, SOURCE_CONN);
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        close(pipes[i][1]);
+        c->pipes[i] = pipes[i][0];
+        fcntl(c->pipes[i], F_SETFL, O_NONBLOCK);
+        watch(c->pipes[i], EPOLLIN, slot, i);
+    }
+}
+
+/*
+ * reap_sessions: Collects sessions (and anything else) that exited.
+ */
+static void reap_sessions(void) {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int i = 0; i < client_capacity; i++) {
+            if (clients[i].conn != -1 && clients[i].pid == pid)
+                clients[i].pid = -1;
+        }
+    }
+}
+
+/*
+ * open_socket: Creates the listening socket at 'path', replacing a stale
+ * socket file left by a server that is gone.
+ *
+ * Returns:
+ *   The socket, or -1 after printing an error.
+ */
+static int open_socket(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "myshell: %s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("myshell: socket");
+        return -1;
+    }
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        struct stat st;
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int stale = probe >= 0 && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) &&
+                    connect(probe, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+                    errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+        if (stale && unlink(path) == 0)
+            bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        else
+            errno = EADDRINUSE;
+    }
+    if (!bound || listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "myshell: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * server_run: Runs the server (see server.h).
+ */
+int server_run(const char *path, ServerSession session) {
+    listen_fd = open_socket(path);
+    if (listen_fd < 0)
+        return 1;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd < 0 || epoll_fd < 0) {
+        perror("myshell: server");
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+    watch(listen_fd, EPOLLIN, 0, SOURCE_LISTEN);
+    watch(signal_fd, EPOLLIN, 0, SOURCE_SIGNAL);
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            perror("myshell: epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int source = events[i].data.u64 & 7;
+            int slot = events[i].data.u64 >> 3;
+            if (source == SOURCE_LISTEN) {
+                int conn;
+                while ((conn = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    // The session reads its lines with blocking reads; the
+                    // server's sends do not wait (MSG_DONTWAIT)
+                    fcntl(conn, F_SETFL, 0);
+                    start_session(conn, session);
+                }
+            } else if (source == SOURCE_SIGNAL) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo != SIGCHLD)
+                        running = 0;
+                }
+                reap_sessions();
+            } else if (clients[slot].conn == -1) {
+                // Closed by an earlier event of this batch
+            } else if (source == SOURCE_CONN && (events[i].events & (EPOLLHUP | EPOLLERR)) &&
+                       !(events[i].events & EPOLLOUT)) {
+                close_client(slot, 1);
+            } else {
+                pump(slot);
+            }
+        }
+    }
+
+    for (int i = 0; i < client_capacity; i++) {
+        if (clients[i].conn != -1)
+            close_client(i, 1);
+        free(clients[i].frame);
+    }
+    free(clients);
+    close(listen_fd);
+    close(epoll_fd);
+    close(signal_fd);
+    unlink(path);
+    return 0;
+}
+
+void server_report(int status) {
+    if (status_fd < 0)
+        return;
+    char line[32];
+    int len = snprintf(line, sizeof(line), "status %d\n", status);
+    while (write(status_fd, line, len) < 0 && errno == EINTR)
+        ;
+    char ack;
+    while (read(status_fd, &ack, 1) < 0 && errno == EINTR)
+        ;
+}
@@ -0,0 +1,18 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Runs the command lines of one connection: 'conn' is the connection,
+// 'first' its first line (NULL if it closed without sending one). Returns
+// the session's exit status.
+typedef int (*ServerSession)(int conn, char *first);
+
+// Listens on the Unix socket at 'path' and runs every connection in its
+// own session process (see server.c) until SIGINT or SIGTERM. Returns the
+// shell's exit status: 0, or 1 if the socket could not be set up.
+int server_run(const char *path, ServerSession session);
+
+// In a session: tells the client the status of the line just run (after
+// the line's output has been flushed)
+void server_report(int status);
+
+#endif // SERVER_H
@@ -0,0 +1,445 @@
+/*
+ * spawn.c - Process Launch Engine
+ *
+ * This file implements how the shell starts external programs.
+ * Instead of duplicating the whole shell with fork() and rebuilding the
+ * child's file descriptor table inside the child, the executor describes
+ * the child's redirections and pipe wiring as a precomputed list of fd
+ * actions (a SpawnPlan) and hands it to this engine.
+ *
+ * Key Components:
+ *
+ * 1. Spawn Plans:
+ *    - Ordered dup2/close actions built by the parent
+ *    - Translated directly into posix_spawn file actions
+ *
+ * 2. Launch Paths:
+ *    - posix_spawn(), which glibc implements with clone(CLONE_VM|CLONE_VFORK)
+ *      so no page tables are copied regardless of the shell's heap size
+ *    - fork()+execve() fallback for systems where posix_spawn is refused
+ *    - fork() without exec for builtins that must run in a subshell
+ *
+ * 3. Placement:
+ *    - A plan may carry a SpawnPlacement: a CPU set, a nice increment, an
+ *      I/O priority and a cgroup v2 directory, applied in the child before
+ *      it execs, so the shell itself keeps its own
+ *    - posix_spawn cannot set these up, so a placed child takes the fork path
+ *    - With a cgroup, an exec'd child is created in it by
+ *      clone3(CLONE_INTO_CGROUP): it never runs a cycle outside it, and no
+ *      migration is charged to the shell's cgroup
+ *
+ * 4. Error Reporting:
+ *    - Both paths report exec failures back to the parent as an errno
+ *      value, so the caller prints diagnostics before the child is reaped
+ *
+ * Implementation Details:
+ * - File descriptors owned by the shell are created with O_CLOEXEC, so
+ *   children only see the fds named in their plan plus stdin/out/err
+ * - The fork fallback reports exec errors through a close-on-exec pipe
+ * - Children start with an empty signal mask; the shell keeps SIGCHLD
+ *   blocked for its job reaper and that must not leak into programs
+ * - Children also get the default action for the job control signals an
+ *   interactive shell ignores (SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU)
+ * - A plan can place the child in a process group; the parent sets the
+ *   group as well, so it exists before the next stage joins it
+ * - clone3() runs no atfork handlers and leaves the C library's locks as
+ *   they were, so only children that go straight to exec are made with it;
+ *   a builtin's child, and any child where clone3 is refused, is forked and
+ *   joins the cgroup by writing to its cgroup.procs
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/sched.h>
+#include "spawn.h"
+
+#define INITIAL_PLAN_SIZE 4
+#define IOPRIO_WHO_PROCESS 1
+#define CPU_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+extern char **environ;
+
+// Signals an interactive shell ignores and its children must not
+static const int job_control_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+#define JOB_CONTROL_SIGNALS (int)(sizeof(job_control_signals) / sizeof(job_control_signals[0]))
+
+/*
+ * prepare_child: Puts a forked child in its process group and restores the
+ * signal state a program expects.
+ */
+static void prepare_child(const SpawnPlan *plan) {
+    if (plan->pgroup >= 0)
+        setpgid(0, plan->pgroup);
+    for (int i = 0; i < JOB_CONTROL_SIGNALS; i++)
+        signal(job_control_signals[i], SIG_DFL);
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+}
+
+/*
+ * set_group: Parent side of the process group assignment. Errors are
+ * ignored: the child may already have exec'd or exited, in which case it
+ * set its group itself.
+ */
+static void set_group(pid_t child, const SpawnPlan *plan) {
+    if (plan->pgroup >= 0)
+        setpgid(child, plan->pgroup ? plan->pgroup : child);
+}
+
+/*
+ * spawn_plan_init: Initializes an empty plan.
+ */
+void spawn_plan_init(SpawnPlan *plan) {
+    plan->actions = NULL;
+    plan->count = 0;
+    plan->capacity = 0;
+    plan->pgroup = -1;
+    plan->envp = NULL;
+    plan->placement = NULL;
+}
+
+/*
+ * spawn_placement_init: Initializes a placement that leaves the child where
+ * the shell runs.
+ */
+void spawn_placement_init(SpawnPlacement *placement) {
+    memset(placement, 0, sizeof(*placement));
+    placement->cgroup_fd = -1;
+}
+
+void spawn_placement_add_cpu(SpawnPlacement *placement, int cpu) {
+    if (cpu < 0 || cpu >= SPAWN_MAX_CPUS)
+        return;
+    placement->cpus[cpu / CPU_WORD_BITS] |= 1UL << (cpu % CPU_WORD_BITS);
+    placement->set_cpus = 1;
+}
+
+/*
+ * plan_append: Appends an action to the plan, growing it as needed.
+ *
+ * Returns:
+ *   0 on success, -1 if memory allocation fails.
+ */
+static int plan_append(SpawnPlan *plan, SpawnActionType type, int fd, int target_fd) {
+    if (plan->count >= plan->capacity) {
+        int new_capacity = plan->capacity ? plan->capacity * 2 : INITIAL_PLAN_SIZE;
+        SpawnAction *actions = realloc(plan->actions, new_capacity * sizeof(SpawnAction));
+        if (!actions) {
+            perror("myshell: allocation error");
+            return -1;
+        }
+        plan->actions = actions;
+        plan->capacity = new_capacity;
+    }
+    plan->actions[plan->count].type = type;
+    plan->actions[plan->count].fd = fd;
+    plan->actions[plan->count].target_fd = target_fd;
+    plan->count++;
+    return 0;
+}
+
+int spawn_plan_dup2(SpawnPlan *plan, int fd, int target_fd) {
+    return plan_append(plan, SPAWN_DUP2, fd, target_fd);
+}
+
+int spawn_plan_close(SpawnPlan *plan, int fd) {
+    return plan_append(plan, SPAWN_CLOSE, fd, -1);
+}
+
+void spawn_plan_free(SpawnPlan *plan) {
+    free(plan->actions);
+    spawn_plan_init(plan);
+}
+
+/*
+ * spawn_with_posix_spawn: Launches the command with posix_spawn().
+ *
+ * Returns:
+ *   0 on success, or the errno value reported by posix_spawn().
+ */
+static int spawn_with_posix_spawn(const char *path, char **argv, const SpawnPlan *plan, pid_t *pid) {
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err != 0) {
+        return err;
+    }
+
+    for (int i = 0; i < plan->count && err == 0; i++) {
+        const SpawnAction *action = &plan->actions[i];
+        if (action->type == SPAWN_DUP2) {
+            // POSIX specifies that dup2 onto itself clears FD_CLOEXEC
+            err = posix_spawn_file_actions_adddup2(&actions, action->fd, action->target_fd);
+        } else {
+            err = posix_spawn_file_actions_addclose(&actions, action->fd);
+        }
+    }
+
+    posix_spawnattr_t attr;
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    for (int i = 0; i < JOB_CONTROL_SIGNALS; i++)
+        sigaddset(&defaults, job_control_signals[i]);
+    if (err == 0) {
+        err = posix_spawnattr_init(&attr);
+        if (err != 0) {
+            posix_spawn_file_actions_destroy(&actions);
+            return err;
+        }
+        short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+        if (plan->pgroup >= 0)
+            flags |= POSIX_SPAWN_SETPGROUP;
+        err = posix_spawnattr_setsigmask(&attr, &empty);
+        if (err == 0)
+            err = posix_spawnattr_setsigdefault(&attr, &defaults);
+        if (err == 0 && plan->pgroup >= 0)
+            err = posix_spawnattr_setpgroup(&attr, plan->pgroup);
+        if (err == 0)
+            err = posix_spawnattr_setflags(&attr, flags);
+        if (err == 0)
+            err = posix_spawn(pid, path, &actions, &attr, argv, plan->envp ? plan->envp : environ);
+        posix_spawnattr_destroy(&attr);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+
+/*
+ * apply_plan: Applies the plan to the current process (fork fallback child).
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failing action.
+ */
+static int apply_plan(const SpawnPlan *plan) {
+    for (int i = 0; i < plan->count; i++) {
+        const SpawnAction *action = &plan->actions[i];
+        if (action->type == SPAWN_DUP2) {
+            if (action->fd == action->target_fd) {
+                int flags = fcntl(action->fd, F_GETFD);
+                if (flags < 0 || fcntl(action->fd, F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+                    return errno;
+                }
+            } else if (dup2(action->fd, action->target_fd) < 0) {
+                return errno;
+            }
+        } else if (close(action->fd) < 0 && errno != EBADF) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+/*
+ * apply_placement: Applies the plan's placement to the current process (a
+ * forked child). 'joined' tells whether the child was created in the
+ * placement's cgroup already; if not, it moves itself there.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failing step.
+ */
+static int apply_placement(const SpawnPlan *plan, int joined) {
+    const SpawnPlacement *placement = plan->placement;
+    if (!placement)
+        return 0;
+
+    if (placement->cgroup_fd >= 0 && !joined) {
+        int fd = openat(placement->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+        int err = write(fd, "0\n", 2) < 0 ? errno : 0;
+        close(fd);
+        if (err != 0)
+            return err;
+    }
+    if (placement->set_cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < SPAWN_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (placement->cpus[cpu / CPU_WORD_BITS] & (1UL << (cpu % CPU_WORD_BITS)))
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) < 0)
+            return errno;
+    }
+    if (placement->nice != 0) {
+        errno = 0;
+        if (nice(placement->nice) == -1 && errno != 0)
+            return errno;
+    }
+    if (placement->ioprio != 0 &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, placement->ioprio) < 0)
+        return errno;
+    return 0;
+}
+
+/*
+ * fork_child: Creates the child of the fork paths. When 'exec' is set (the
+ * child only applies its plan and execs) and the plan names a cgroup, the
+ * child is created in it with clone3(CLONE_INTO_CGROUP) where the kernel
+ * has it; *joined then tells the child it is there already.
+ *
+ * Returns:
+ *   As fork(): the child's pid in the parent, 0 in the child, -1 on error.
+ */
+static pid_t fork_child(const SpawnPlan *plan, int exec, int *joined) {
+    *joined = 0;
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+    if (exec && plan->placement && plan->placement->cgroup_fd >= 0) {
+        struct clone_args args;
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = plan->placement->cgroup_fd;
+        long child = syscall(SYS_clone3, &args, sizeof(args));
+        if (child >= 0) {
+            *joined = 1;
+            return child;
+        }
+        // Kernels before 5.7 know clone3 but not CLONE_INTO_CGROUP
+        if (errno != ENOSYS && errno != E2BIG && errno != EINVAL)
+            return -1;
+    }
+#else
+    (void)exec;
+    (void)plan;
+#endif
+    return fork();
+}
+
+/*
+ * spawn_with_fork: Launches the command with fork() and execve().
+ *
+ * The child writes its errno to a close-on-exec pipe if the plan or the exec
+ * fails, so the parent can report the error exactly as posix_spawn would.
+ * Placed children are launched here, their placement applied after the plan.
+ *
+ * Returns:
+ *   0 on success, or an errno value describing the failure.
+ */
+static int spawn_with_fork(const char *path, char **argv, const SpawnPlan *plan, pid_t *pid) {
+    int status_pipe[2];
+    if (pipe2(status_pipe, O_CLOEXEC) < 0) {
+        return errno;
+    }
+
+    int joined;
+    pid_t child = fork_child(plan, 1, &joined);
+    if (child < 0) {
+        int err = errno;
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        return err;
+    }
+
+    if (child == 0) {
+        prepare_child(plan);
+        close(status_pipe[0]);
+        int err = apply_plan(plan);
+        if (err == 0)
+            err = apply_placement(plan, joined);
+        if (err == 0) {
+            execve(path, argv, plan->envp ? plan->envp : environ);
+            err = errno;
+        }
+        ssize_t written = write(status_pipe[1], &err, sizeof(err));
+        (void)written;
+        _exit(127);
+    }
+
+    set_group(child, plan);
+    close(status_pipe[1]);
+    int err = 0;
+    ssize_t n;
+    do {
+        n = read(status_pipe[0], &err, sizeof(err));
+    } while (n < 0 && errno == EINTR);
+    close(status_pipe[0]);
+
+    if (n == (ssize_t)sizeof(err)) {
+        // The child never reached the program; reap it here
+        waitpid(child, NULL, 0);
+        return err;
+    }
+
+    *pid = child;
+    return 0;
+}
+
+/*
+ * spawn_function: Runs a shell function in a forked child.
+ *
+ * Used for builtins that are pipeline stages or background jobs: the
+ * child applies the plan and its placement, calls 'fn' and exits with its
+ * return value. Pending stdout data is flushed first so the child does not
+ * repeat it.
+ *
+ * Returns:
+ *   0 on success, or an errno value if fork() failed.
+ */
+int spawn_function(int (*fn)(char **), char **argv, const SpawnPlan *plan, pid_t *pid) {
+    fflush(stdout);
+    int joined;
+    pid_t child = fork_child(plan, 0, &joined);
+    if (child < 0) {
+        return errno;
+    }
+
+    if (child == 0) {
+        prepare_child(plan);
+        int err = apply_plan(plan);
+        if (err == 0)
+            err = apply_placement(plan, joined);
+        if (err != 0) {
+            fprintf(stderr, "myshell: %s: %s\n", argv[0], strerror(err));
+            _exit(1);
+        }
+        if (plan->envp)
+            environ = plan->envp;
+        int status = fn(argv);
+        fflush(stdout);
+        _exit(status & 0xff);
+    }
+
+    set_group(child, plan);
+    *pid = child;
+    return 0;
+}
+
+/*
+ * spawn_process: Launches the executable at 'path' with the plan applied.
+ *
+ * posix_spawn() is tried first. If the C library refuses the request
+ * (ENOSYS/EINVAL), the launch is retried with the fork() fallback, which
+ * placed children take directly.
+ *
+ * Parameters:
+ *   path - Executable path, usually resolved through the path cache.
+ *   argv - NULL-terminated argument array.
+ *   plan - fd actions and placement to apply in the child before exec.
+ *   pid  - Receives the child's pid on success.
+ *
+ * Returns:
+ *   0 on success, or an errno value describing the failure.
+ */
+int spawn_process(const char *path, char **argv, const SpawnPlan *plan, pid_t *pid) {
+    if (plan->placement)
+        return spawn_with_fork(path, argv, plan, pid);
+    int err = spawn_with_posix_spawn(path, argv, plan, pid);
+    if (err == ENOSYS || err == EINVAL) {
+        err = spawn_with_fork(path, argv, plan, pid);
+    }
+    return err;
+}
@@ -0,0 +1,76 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+// Kinds of file descriptor actions applied in a child before exec
+typedef enum {
+    SPAWN_DUP2,     // dup2(fd, target_fd)
+    SPAWN_CLOSE     // close(fd)
+} SpawnActionType;
+
+// A single precomputed fd action
+typedef struct {
+    SpawnActionType type;
+    int fd;         // Source fd (DUP2) or fd to close (CLOSE)
+    int target_fd;  // Destination fd (DUP2 only)
+} SpawnAction;
+
+// Largest number of CPUs a placement can name
+#define SPAWN_MAX_CPUS 1024
+
+// Where a child runs: CPUs, scheduling priorities and cgroup, set up in the
+// child before it execs
+typedef struct {
+    int set_cpus;       // Restrict the child to the CPUs in 'cpus'
+    unsigned long cpus[SPAWN_MAX_CPUS / (8 * sizeof(unsigned long))];  // CPU bit mask
+    int nice;           // Added to the child's nice value (0: unchanged)
+    int ioprio;         // I/O priority for ioprio_set() (0: unchanged)
+    int cgroup_fd;      // cgroup v2 directory the child starts in (-1: the shell's)
+} SpawnPlacement;
+
+// Ordered list of fd actions describing a child's redirections and pipe
+// wiring, and the process group the child joins
+typedef struct {
+    SpawnAction *actions;
+    int count;
+    int capacity;
+    pid_t pgroup;   // -1: stay in the shell's group, 0: lead a new group, >0: join it
+    char **envp;    // The child's environment (NULL: the shell's 'environ')
+    const SpawnPlacement *placement;    // Where the child runs (NULL: like the shell)
+} SpawnPlan;
+
+// Initializes a placement that changes nothing
+void spawn_placement_init(SpawnPlacement *placement);
+
+// Adds CPU 'cpu' to a placement's CPU set (and makes it restrict the child)
+void spawn_placement_add_cpu(SpawnPlacement *placement, int cpu);
+
+// Initializes an empty plan (the child stays in the shell's process group
+// and inherits its environment)
+void spawn_plan_init(SpawnPlan *plan);
+
+// Appends an action making 'fd' available as 'target_fd' in the child.
+// Returns 0 on success, -1 on allocation failure.
+int spawn_plan_dup2(SpawnPlan *plan, int fd, int target_fd);
+
+// Appends an action closing 'fd' in the child.
+// Returns 0 on success, -1 on allocation failure.
+int spawn_plan_close(SpawnPlan *plan, int fd);
+
+// Releases the memory held by a plan (does not close any fds)
+void spawn_plan_free(SpawnPlan *plan);
+
+// Launches the executable at 'path' with 'argv' and the plan applied.
+// Uses posix_spawn, falling back to fork()+execve() when it is unavailable
+// or the plan has a placement, which posix_spawn cannot set up.
+// Returns 0 and stores the child pid in *pid, or returns an errno value
+// describing why the command could not be started.
+int spawn_process(const char *path, char **argv, const SpawnPlan *plan, pid_t *pid);
+
+// Forks a child that applies the plan, runs fn(argv) and exits with its
+// return value (used for builtins in pipelines and background jobs).
+// Returns 0 and stores the child pid in *pid, or an errno value.
+int spawn_function(int (*fn)(char **), char **argv, const SpawnPlan *plan, pid_t *pid);
+
+#endif // SPAWN_H
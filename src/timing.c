@@ -0,0 +1,128 @@
+/*
+ * timing.c - Pipeline Timing and Resource Reports
+ *
+ * This file formats the per-stage statistics the executor collects with
+ * wait4(): wall time, user/system CPU, peak RSS, context switches and page
+ * faults. They are printed by the 'time' keyword and, when 'set timelog=FILE'
+ * is active, appended to a log as one JSON object per stage.
+ *
+ * JSON Record Fields:
+ * - ts        Wall-clock time the record was written (seconds since the epoch)
+ * - pipeline  Sequence number of the pipeline within this shell
+ * - stage     Index of the stage in its pipeline
+ * - pid       Child pid (-1 for stages that ran inside the shell)
+ * - command   The stage's argv joined with spaces
+ * - status    Exit code (128 + signal number if killed by a signal)
+ * - real, user, sys            Seconds
+ * - maxrss_kb, nvcsw, nivcsw, minflt, majflt   As reported by getrusage(2)
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "timing.h"
+
+/*
+ * elapsed: Seconds between two CLOCK_MONOTONIC timestamps.
+ */
+static double elapsed(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/*
+ * exit_code: Converts a wait status into a shell exit code.
+ */
+static int exit_code(int status) {
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+/*
+ * print_command: Writes a stage's argv joined with spaces.
+ */
+static void print_command(FILE *out, char **args) {
+    for (int i = 0; args[i] != NULL; i++) {
+        fprintf(out, i == 0 ? "%s" : " %s", args[i]);
+    }
+}
+
+/*
+ * print_json_command: Writes a stage's argv as a JSON string.
+ */
+static void print_json_command(FILE *out, char **args) {
+    fputc('"', out);
+    for (int i = 0; args[i] != NULL; i++) {
+        if (i > 0)
+            fputc(' ', out);
+        for (const unsigned char *p = (const unsigned char *)args[i]; *p; p++) {
+            if (*p == '"' || *p == '\\')
+                fprintf(out, "\\%c", *p);
+            else if (*p < 0x20)
+                fprintf(out, "\\u%04x", *p);
+            else
+                fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+ * timing_print: Prints the 'time' report for a finished pipeline.
+ *
+ * One row per stage, followed by the wall time of the whole pipeline
+ * (first launch to last exit).
+ */
+void timing_print(const Command *commands, const StageStats *stats, int count) {
+    const struct timespec *first = &stats[0].start;
+    const struct timespec *last = &stats[0].end;
+
+    fprintf(stderr, "%5s %9s %9s %9s %10s %7s %7s %8s %7s  %s\n",
+            "stage", "real", "user", "sys", "maxrss", "vcsw", "ivcsw",
+            "minflt", "majflt", "command");
+    for (int i = 0; i < count; i++) {
+        const StageStats *s = &stats[i];
+        fprintf(stderr, "%5d %8.3fs %8.3fs %8.3fs %8ldKB %7ld %7ld %8ld %7ld  ",
+                i, elapsed(&s->start, &s->end),
+                timeval_seconds(&s->usage.ru_utime),
+                timeval_seconds(&s->usage.ru_stime),
+                s->usage.ru_maxrss, s->usage.ru_nvcsw, s->usage.ru_nivcsw,
+                s->usage.ru_minflt, s->usage.ru_majflt);
+        print_command(stderr, commands[i].args);
+        fputc('\n', stderr);
+        if (elapsed(last, &s->end) > 0)
+            last = &s->end;
+    }
+    fprintf(stderr, "real %.3fs\n", elapsed(first, last));
+}
+
+/*
+ * timing_log: Appends the JSON records of a finished pipeline to 'log'.
+ */
+void timing_log(FILE *log, const Command *commands, const StageStats *stats, int count) {
+    static long pipeline_seq = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    pipeline_seq++;
+
+    for (int i = 0; i < count; i++) {
+        const StageStats *s = &stats[i];
+        fprintf(log, "{\"ts\":%ld.%06ld,\"pipeline\":%ld,\"stage\":%d,\"pid\":%ld,\"command\":",
+                (long)now.tv_sec, now.tv_nsec / 1000, pipeline_seq, i, (long)s->pid);
+        print_json_command(log, commands[i].args);
+        fprintf(log, ",\"status\":%d,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+                "\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,\"minflt\":%ld,\"majflt\":%ld}\n",
+                exit_code(s->status), elapsed(&s->start, &s->end),
+                timeval_seconds(&s->usage.ru_utime),
+                timeval_seconds(&s->usage.ru_stime),
+                s->usage.ru_maxrss, s->usage.ru_nvcsw, s->usage.ru_nivcsw,
+                s->usage.ru_minflt, s->usage.ru_majflt);
+    }
+    fflush(log);
+}
@@ -0,0 +1,13 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include "executor.h"
+
+// Prints a per-stage timing and resource report of a finished pipeline to stderr
+void timing_print(const Command *commands, const StageStats *stats, int count);
+
+// Appends one JSON line per stage of a finished pipeline to 'log'
+void timing_log(FILE *log, const Command *commands, const StageStats *stats, int count);
+
+#endif // TIMING_H
@@ -0,0 +1,241 @@
+/*
+ * trace.c - Execution Tracing
+ *
+ * This file records how long each phase of running a command line takes
+ * and writes the result as Chrome trace events, which chrome://tracing and
+ * the Perfetto UI show as a timeline:
+ *
+ *   MYSHELL_TRACE=FILE myshell ...   trace from startup into FILE
+ *   set tracefile=FILE               where 'set -o trace' writes
+ *                                    (default: myshell-trace.json)
+ *   set -o trace / set +o trace      start / stop tracing
+ *
+ * Key Components:
+ *
+ * 1. Spans:
+ *    - line: a whole command line; tokenize and split: lexing it and
+ *      dividing it into pipelines (or restore, for a parse cache hit)
+ *    - command: building a stage's argv, with its expansions; redirect:
+ *      opening its files; spawn: launching it; wait: waiting for the stages
+ *    - stage: a process from its launch to its reap, on a row of its own
+ *      (the pid), with its exit status
+ *
+ * 2. Event Buffer:
+ *    - Fixed-size records in a static array; the shell records from a
+ *      single thread, so appending takes neither a lock nor an allocation
+ *      nor a system call, only the clock read
+ *    - Formatted and appended to the file in batches: when the array is
+ *      full, when tracing stops and at exit
+ *
+ * Implementation Details:
+ * - Timestamps are CLOCK_MONOTONIC, written in microseconds
+ * - The file is a JSON array that is never closed, which both viewers
+ *   accept, so several shells (or server sessions) can append to it
+ * - A forked child drops the events it inherited, so none is written twice
+ * - With tracing off, an instrumented spot only tests trace_enabled
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define TRACE_EVENTS 4096
+#define TRACE_DETAIL 48
+#define TRACE_DEFAULT_FILE "myshell-trace.json"
+#define EVENT_MAX 512       // Longest formatted event (a detail escapes to 6x)
+
+typedef struct {
+    const char *name;           // Span name (a string literal)
+    const char *key;            // Name of 'value' (NULL: no value)
+    uint64_t start;             // Nanoseconds
+    uint64_t end;
+    int tid;                    // Row: 0 for the shell, else a child's pid
+    int value;
+    char detail[TRACE_DETAIL];  // Command or line, truncated
+} TraceEvent;
+
+int trace_enabled = 0;
+
+static TraceEvent events[TRACE_EVENTS];
+static int event_count = 0;
+static int trace_fd = -1;
+static char *trace_path = NULL;     // NULL until 'set tracefile' or MYSHELL_TRACE
+static int named = 0;               // This process has written its name event
+static int hooks_installed = 0;
+
+uint64_t trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return trace_time(&ts);
+}
+
+/*
+ * write_all: Appends 'len' bytes to the trace file.
+ */
+static void write_all(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(trace_fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        data += n;
+        len -= n;
+    }
+}
+
+/*
+ * format_event: Writes one event as a JSON object (and a comma) to 'out',
+ * which has room for EVENT_MAX bytes. Returns the length.
+ */
+static size_t format_event(char *out, const TraceEvent *e, int pid) {
+    uint64_t dur = e->end > e->start ? e->end - e->start : 0;
+    size_t len = snprintf(out, EVENT_MAX,
+                          "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                          "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"args\":{",
+                          e->name, pid, e->tid ? e->tid : pid,
+                          (unsigned long long)(e->start / 1000), (unsigned long long)(e->start % 1000),
+                          (unsigned long long)(dur / 1000), (unsigned long long)(dur % 1000));
+    if (e->key)
+        len += snprintf(out + len, EVENT_MAX - len, "\"%s\":%d%s", e->key, e->value,
+                        e->detail[0] ? "," : "");
+    if (e->detail[0]) {
+        len += snprintf(out + len, EVENT_MAX - len, "\"detail\":\"");
+        for (const char *p = e->detail; *p; p++) {
+            unsigned char c = (unsigned char)*p;
+            if (c == '"' || c == '\\')
+                len += snprintf(out + len, EVENT_MAX - len, "\\%c", c);
+            else if (c < 0x20)
+                len += snprintf(out + len, EVENT_MAX - len, "\\u%04x", c);
+            else
+                out[len++] = c;
+        }
+        out[len++] = '"';
+    }
+    len += snprintf(out + len, EVENT_MAX - len, "}},\n");
+    return len;
+}
+
+/*
+ * flush_events: Appends the recorded events to the trace file and empties
+ * the buffer. A new file gets the opening '[' first.
+ */
+static void flush_events(void) {
+    static char out[65536];
+    size_t len = 0;
+    int pid = getpid();
+
+    if (trace_fd < 0 || event_count == 0) {
+        event_count = 0;
+        return;
+    }
+    struct stat st;
+    if (fstat(trace_fd, &st) == 0 && st.st_size == 0)
+        len += snprintf(out, sizeof(out), "[\n");
+    if (!named) {
+        len += snprintf(out + len, sizeof(out) - len,
+                        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                        "\"args\":{\"name\":\"myshell\"}},\n", pid, pid);
+        named = 1;
+    }
+    for (int i = 0; i < event_count; i++) {
+        if (len + EVENT_MAX > sizeof(out)) {
+            write_all(out, len);
+            len = 0;
+        }
+        len += format_event(out + len, &events[i], pid);
+    }
+    write_all(out, len);
+    event_count = 0;
+}
+
+/*
+ * forked: Runs in the child of every fork(): the events so far are the
+ * parent's to write.
+ */
+static void forked(void) {
+    event_count = 0;
+    named = 0;
+}
+
+void trace_span(const char *name, uint64_t start, uint64_t end, int tid,
+                const char *key, int value, const char *detail) {
+    if (!trace_enabled)
+        return;
+    if (event_count == TRACE_EVENTS)
+        flush_events();
+    TraceEvent *e = &events[event_count++];
+    e->name = name;
+    e->key = key;
+    e->start = start;
+    e->end = end;
+    e->tid = tid;
+    e->value = value;
+    size_t n = detail ? strnlen(detail, TRACE_DETAIL - 1) : 0;
+    memcpy(e->detail, detail ? detail : "", n);
+    e->detail[n] = '\0';
+}
+
+void trace_end(const char *name, uint64_t start, const char *key, int value,
+               const char *detail) {
+    if (start != 0)
+        trace_span(name, start, trace_clock(), 0, key, value, detail);
+}
+
+const char *trace_file(void) {
+    return trace_path ? trace_path : TRACE_DEFAULT_FILE;
+}
+
+int trace_set(int on) {
+    if (!on) {
+        if (trace_enabled) {
+            flush_events();
+            close(trace_fd);
+            trace_fd = -1;
+            trace_enabled = 0;
+        }
+        return 0;
+    }
+    if (trace_enabled)
+        return 0;
+
+    int fd = open(trace_file(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "myshell: trace: %s: %s\n", trace_file(), strerror(errno));
+        return 1;
+    }
+    if (!hooks_installed) {
+        atexit(flush_events);
+        pthread_atfork(NULL, NULL, forked);
+        hooks_installed = 1;
+    }
+    trace_fd = fd;
+    trace_enabled = 1;
+    return 0;
+}
+
+int trace_set_file(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) {
+        fprintf(stderr, "myshell: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    int was_enabled = trace_enabled;
+    trace_set(0);
+    free(trace_path);
+    trace_path = copy;
+    return was_enabled ? trace_set(1) : 0;
+}
+
+void trace_init(void) {
+    const char *path = getenv("MYSHELL_TRACE");
+    if (path && *path && trace_set_file(path) == 0)
+        trace_set(1);
+}
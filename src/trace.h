@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Set while events are recorded ('set -o trace' or MYSHELL_TRACE=FILE)
+extern int trace_enabled;
+
+// Returns the CLOCK_MONOTONIC time in nanoseconds
+uint64_t trace_clock(void);
+
+// Returns the start of a span, or 0 if tracing is off; a span started at 0
+// is not recorded, so a disabled call site costs one test
+static inline uint64_t trace_begin(void) {
+    return trace_enabled ? trace_clock() : 0;
+}
+
+// Converts a CLOCK_MONOTONIC timespec to trace time
+static inline uint64_t trace_time(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000u + ts->tv_nsec;
+}
+
+// Records span 'name' from 'start' to now on the shell's row. 'key' names
+// 'value' in the event's arguments (NULL for none); 'detail' (may be NULL)
+// is a command or line, truncated.
+void trace_end(const char *name, uint64_t start, const char *key, int value,
+               const char *detail);
+
+// Records a span with both ends given, on row 'tid' (a child's pid)
+void trace_span(const char *name, uint64_t start, uint64_t end, int tid,
+                const char *key, int value, const char *detail);
+
+// Turns tracing on (opening the trace file) or off (flushing it). Returns 0,
+// or 1 after printing an error.
+int trace_set(int on);
+
+// Sets the trace file ('set tracefile=FILE'); takes effect when tracing is
+// next turned on. Returns 0, or 1 after printing an error.
+int trace_set_file(const char *path);
+
+// Returns the trace file's path
+const char *trace_file(void);
+
+// Starts tracing to $MYSHELL_TRACE if it is set
+void trace_init(void);
+
+#endif // TRACE_H
@@ -0,0 +1,396 @@
+/*
+ * vars.c - Shell Variables and Environment
+ *
+ * This file keeps the shell's variables and the environment its commands
+ * are started with. The process environment is imported at startup; from
+ * then on the table below is the only copy, and 'environ' points at an
+ * array built from its exported entries.
+ *
+ * Key Components:
+ *
+ * 1. Hash Table:
+ *    - Open addressing with linear probing (FNV-1a hash), like the path
+ *      cache; grows at 50% load, deletes with backward shifting
+ *    - Lookups take a name and a length, so '$NAME' inside a word is found
+ *      without copying the name out
+ *
+ * 2. Copy-on-Write Environment:
+ *    - Each variable keeps its "NAME=value" string, which the environment
+ *      array points at directly
+ *    - The array is rebuilt (and 'environ' updated) only when an exported
+ *      variable changes, so starting a command costs nothing extra; the
+ *      replaced string is freed once no array refers to it
+ *
+ * 3. Prefix Assignments:
+ *    - 'NAME=value command' gets an overlay: an arena copy of the array with
+ *      its own strings for the assigned names, built for that command only
+ *    - A spawned command is started with it; an in-process builtin has
+ *      'environ' pointed at it for the call (builtin_run())
+ *
+ * 4. Builtins:
+ *    - 'export' lists exported variables, 'export NAME[=value]...' sets and
+ *      exports them; 'unset NAME...' removes them
+ *
+ * Implementation Details:
+ * - Names are letters, digits and '_', not starting with a digit
+ * - getenv() keeps working, since it reads the same array
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "vars.h"
+
+#define INITIAL_VARS_SIZE 64
+
+extern char **environ;
+
+typedef struct {
+    char *name;     // Variable name (NULL for an empty slot)
+    char *entry;    // "NAME=value", or NULL if it has no value
+    int exported;   // Part of the environment of commands
+} Var;
+
+static Var *vars = NULL;
+static size_t capacity = 0;
+static size_t used = 0;
+static char **env = NULL;       // The array 'environ' points at (NULL: the inherited one)
+
+/*
+ * oom: Reports an allocation failure and exits.
+ */
+static void oom(void) {
+    fprintf(stderr, "myshell: allocation error\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * hash_name: FNV-1a hash of the first 'len' bytes of a name.
+ */
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * find_slot: Returns the slot holding the variable named by the first
+ * 'len' bytes of 'name', or the empty slot where it would be inserted.
+ * The table must have been allocated.
+ */
+static size_t find_slot(const char *name, size_t len) {
+    size_t mask = capacity - 1;
+    size_t i = hash_name(name, len) & mask;
+    while (vars[i].name != NULL &&
+           (strncmp(vars[i].name, name, len) != 0 || vars[i].name[len] != '\0')) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * grow_table: Doubles the table size and rehashes all variables.
+ */
+static void grow_table(void) {
+    size_t new_capacity = capacity ? capacity * 2 : INITIAL_VARS_SIZE;
+    Var *new_vars = calloc(new_capacity, sizeof(Var));
+    if (!new_vars)
+        oom();
+
+    Var *old_vars = vars;
+    size_t old_capacity = capacity;
+    vars = new_vars;
+    capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_vars[i].name != NULL)
+            vars[find_slot(old_vars[i].name, strlen(old_vars[i].name))] = old_vars[i];
+    }
+    free(old_vars);
+}
+
+/*
+ * rebuild_env: Points 'environ' at a new array of the exported variables.
+ * Called after every change that affects the environment.
+ */
+static void rebuild_env(void) {
+    size_t count = 0;
+    for (size_t i = 0; i < capacity; i++)
+        count += vars[i].name && vars[i].exported && vars[i].entry;
+    char **array = malloc((count + 1) * sizeof(char *));
+    if (!array)
+        oom();
+    count = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (vars[i].name && vars[i].exported && vars[i].entry)
+            array[count++] = vars[i].entry;
+    }
+    array[count] = NULL;
+
+    free(env);
+    env = array;
+    environ = env;
+}
+
+/*
+ * lookup: Returns the variable named by 'len' bytes of 'name', creating
+ * it (unset and not exported) if 'create' is set; NULL if there is none.
+ */
+static Var *lookup(const char *name, size_t len, int create) {
+    if (capacity == 0) {
+        if (!create)
+            return NULL;
+        grow_table();
+    }
+    size_t i = find_slot(name, len);
+    if (vars[i].name != NULL)
+        return &vars[i];
+    if (!create)
+        return NULL;
+    if (2 * (used + 1) > capacity) {
+        grow_table();
+        i = find_slot(name, len);
+    }
+    vars[i].name = malloc(len + 1);
+    if (!vars[i].name)
+        oom();
+    memcpy(vars[i].name, name, len);
+    vars[i].name[len] = '\0';
+    vars[i].entry = NULL;
+    vars[i].exported = 0;
+    used++;
+    return &vars[i];
+}
+
+/*
+ * store: Sets the variable of an assignment "NAME=value" whose name is
+ * 'len' bytes long, and exports it if 'export' is set.
+ */
+static void store(const char *assignment, size_t len, int export) {
+    Var *var = lookup(assignment, len, 1);
+    char *old = var->entry;
+    var->entry = strdup(assignment);
+    if (!var->entry)
+        oom();
+    var->exported |= export;
+    if (var->exported)
+        rebuild_env();
+    free(old);
+}
+
+void vars_init(void) {
+    // The inherited array stays valid until the first rebuild
+    for (char **e = environ; *e; e++) {
+        size_t len = vars_name_length(*e);
+        if (len == 0 || (*e)[len] != '=')
+            continue;
+        Var *var = lookup(*e, len, 1);
+        free(var->entry);
+        var->entry = strdup(*e);
+        if (!var->entry)
+            oom();
+        var->exported = 1;
+    }
+    rebuild_env();
+}
+
+void vars_clear(void) {
+    for (size_t i = 0; i < capacity; i++) {
+        free(vars[i].name);
+        free(vars[i].entry);
+        vars[i].name = NULL;
+        vars[i].entry = NULL;
+    }
+    used = 0;
+    rebuild_env();
+}
+
+void vars_each(void (*fn)(const char *name, const char *entry, int exported, void *ctx),
+               void *ctx) {
+    for (size_t i = 0; i < capacity; i++) {
+        if (vars[i].name != NULL)
+            fn(vars[i].name, vars[i].entry, vars[i].exported, ctx);
+    }
+}
+
+size_t vars_name_length(const char *s) {
+    if (!isalpha((unsigned char)s[0]) && s[0] != '_')
+        return 0;
+    size_t len = 1;
+    while (isalnum((unsigned char)s[len]) || s[len] == '_')
+        len++;
+    return len;
+}
+
+const char *vars_lookup(const char *name, size_t len) {
+    Var *var = lookup(name, len, 0);
+    return var && var->entry ? var->entry + len + 1 : NULL;
+}
+
+const char *vars_get(const char *name) {
+    return vars_lookup(name, strlen(name));
+}
+
+int vars_assign(const char *assignment, int export) {
+    size_t len = vars_name_length(assignment);
+    if (len == 0 || assignment[len] != '=')
+        return -1;
+    store(assignment, len, export);
+    return 0;
+}
+
+void vars_unset(const char *name) {
+    if (capacity == 0)
+        return;
+    size_t mask = capacity - 1;
+    size_t i = find_slot(name, strlen(name));
+    if (vars[i].name == NULL)
+        return;
+    int exported = vars[i].exported && vars[i].entry;
+    char *entry = vars[i].entry;
+    free(vars[i].name);
+    vars[i].name = NULL;
+    vars[i].entry = NULL;
+    used--;
+
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (vars[j].name == NULL)
+            break;
+        size_t home = hash_name(vars[j].name, strlen(vars[j].name)) & mask;
+        // Move the entry back if its home slot is not in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            vars[i] = vars[j];
+            vars[j].name = NULL;
+            vars[j].entry = NULL;
+            i = j;
+        }
+    }
+    if (exported)
+        rebuild_env();
+    free(entry);
+}
+
+/*
+ * vars_overlay: Builds the environment of a command with prefix
+ * assignments.
+ *
+ * Parameters:
+ *   arena - The per-line arena that owns the array.
+ *   assigns - "NAME=value" strings, later ones taking precedence.
+ *   count - Number of assignments.
+ *
+ * Returns:
+ *   A NULL-terminated arena array: the exported variables without the
+ *   assigned names, followed by the assignments.
+ */
+char **vars_overlay(Arena *arena, char **assigns, int count) {
+    size_t n = 0;
+    for (char **e = environ; e && *e; e++)
+        n++;
+    char **array = arena_alloc(arena, (n + count + 1) * sizeof(char *));
+    n = 0;
+    for (char **e = environ; e && *e; e++) {
+        size_t len = strcspn(*e, "=");
+        int replaced = 0;
+        for (int i = 0; i < count && !replaced; i++)
+            replaced = strncmp(assigns[i], *e, len + 1) == 0;
+        if (!replaced)
+            array[n++] = *e;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t len = strcspn(assigns[i], "=");
+        int replaced = 0;
+        for (int j = i + 1; j < count && !replaced; j++)
+            replaced = strncmp(assigns[j], assigns[i], len + 1) == 0;
+        if (!replaced)
+            array[n++] = assigns[i];
+    }
+    array[n] = NULL;
+    return array;
+}
+
+/*
+ * compare_names: qsort comparator for variable pointers, by name.
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp((*(Var *const *)a)->name, (*(Var *const *)b)->name);
+}
+
+/*
+ * export_builtin: Implements 'export'.
+ *
+ *   export                  - list exported variables, sorted by name
+ *   export NAME=value...    - set and export variables
+ *   export NAME...          - export variables (once they have a value)
+ *
+ * Returns:
+ *   0, or 1 if a name was not valid.
+ */
+int export_builtin(char **args) {
+    if (args[1] == NULL) {
+        Var **list = malloc((used ? used : 1) * sizeof(Var *));
+        if (!list)
+            oom();
+        size_t n = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (vars[i].name && vars[i].exported)
+                list[n++] = &vars[i];
+        }
+        qsort(list, n, sizeof(Var *), compare_names);
+        for (size_t i = 0; i < n; i++) {
+            if (list[i]->entry)
+                printf("export %s=\"%s\"\n", list[i]->name,
+                       list[i]->entry + strlen(list[i]->name) + 1);
+            else
+                printf("export %s\n", list[i]->name);
+        }
+        free(list);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        size_t len = vars_name_length(args[i]);
+        if (len > 0 && args[i][len] == '=') {
+            store(args[i], len, 1);
+        } else if (len > 0 && args[i][len] == '\0') {
+            Var *var = lookup(args[i], len, 1);
+            if (!var->exported) {
+                var->exported = 1;
+                if (var->entry)
+                    rebuild_env();
+            }
+        } else {
+            fprintf(stderr, "myshell: export: '%s': not a valid identifier\n", args[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/*
+ * unset_builtin: Implements 'unset NAME...'.
+ *
+ * Returns:
+ *   0, or 1 if a name was not valid.
+ */
+int unset_builtin(char **args) {
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        size_t len = vars_name_length(args[i]);
+        if (len == 0 || args[i][len] != '\0') {
+            fprintf(stderr, "myshell: unset: '%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        vars_unset(args[i]);
+    }
+    return status;
+}
@@ -0,0 +1,50 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Imports the process environment as exported variables; 'environ' then
+// points at the shell's own array, rebuilt whenever an exported variable
+// changes
+void vars_init(void);
+
+// Removes every variable (before restoring saved ones)
+void vars_clear(void);
+
+// Calls fn(name, entry, exported, ctx) for every variable; 'entry' is its
+// "NAME=value" string, or NULL if it has no value
+void vars_each(void (*fn)(const char *name, const char *entry, int exported, void *ctx),
+               void *ctx);
+
+// Returns the length of the variable name at the start of 's' (0 if 's'
+// does not start with one)
+size_t vars_name_length(const char *s);
+
+// Returns the value of the variable named by the first 'len' bytes of
+// 'name', or NULL if it is not set
+const char *vars_lookup(const char *name, size_t len);
+
+// Returns the value of variable 'name', or NULL if it is not set
+const char *vars_get(const char *name);
+
+// Sets a variable from an assignment "NAME=value" (exporting it if
+// 'export' is set; an exported variable stays exported). Returns 0, or -1
+// if it is not an assignment.
+int vars_assign(const char *assignment, int export);
+
+// Removes variable 'name'
+void vars_unset(const char *name);
+
+// Returns the environment for a command run with the prefix assignments
+// 'assigns' ("NAME=value", 'count' of them): an arena array holding the
+// exported variables, with the assigned names replaced
+char **vars_overlay(Arena *arena, char **assigns, int count);
+
+// Implements the 'export' builtin: list, or set and export variables
+int export_builtin(char **args);
+
+// Implements the 'unset' builtin
+int unset_builtin(char **args);
+
+#endif // VARS_H
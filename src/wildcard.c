@@ -0,0 +1,273 @@
+/*
+ * wildcard.c - Pathname Expansion
+ *
+ * This file expands the unquoted '*', '?' and '[...]' of command arguments
+ * into the names of the matching files, inside the shell: no 'sh -c' and
+ * no glob(3), whose directory reads could not be cached.
+ *
+ * Key Components:
+ *
+ * 1. Matcher:
+ *    - '*' matches any run of bytes, '?' any one byte, '[abc]', '[a-z]' a
+ *      byte of the set and '[!...]' (or '[^...]') one outside it
+ *    - Only the latest '*' is ever retried, so matching a name costs at
+ *      most (pattern length x name length) steps
+ *    - Bytes behind EXPAND_ESCAPE (quoted in the input) match literally
+ *
+ * 2. Directory Walk:
+ *    - The pattern is taken one '/'-separated component at a time: literal
+ *      components are appended without reading anything, the others are
+ *      matched against the directory's listing
+ *    - Listings come from the directory cache (dircache.c), which reads a
+ *      directory again only if its device, inode or mtime changed, so the
+ *      same glob repeated by a script does no readdir()
+ *    - A trailing '/' only matches directories
+ *
+ * 3. Results:
+ *    - Collected in an arena array whose capacity doubles, so tens of
+ *      thousands of matches are not copied over and over
+ *    - Listings are sorted, so the results of a single wildcard component
+ *      already are; otherwise they are sorted once at the end
+ *
+ * Implementation Details:
+ * - Names starting with '.' only match a component that starts with '.'
+ * - A pattern that matches nothing is left to the caller, which keeps it
+ *   as a literal word like other shells do
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "wildcard.h"
+#include "dircache.h"
+#include "expand.h"
+
+// Paths matched so far
+typedef struct {
+    Arena *arena;
+    char **paths;
+    int count;
+    int capacity;
+} Matches;
+
+/*
+ * add_match: Appends a path, doubling the array as needed.
+ */
+static void add_match(Matches *m, char *path) {
+    if (m->count == m->capacity) {
+        int capacity = m->capacity ? 2 * m->capacity : 16;
+        char **grown = arena_alloc(m->arena, capacity * sizeof(char *));
+        if (m->count)
+            memcpy(grown, m->paths, m->count * sizeof(char *));
+        m->paths = grown;
+        m->capacity = capacity;
+    }
+    m->paths[m->count++] = path;
+}
+
+/*
+ * bracket_end: Returns the ']' closing the bracket expression whose
+ * contents start at 'p' (after '['), or NULL if it is not closed within
+ * the path component. A ']' right after the '[' (or '[!') is a member.
+ */
+static const char *bracket_end(const char *p) {
+    if (*p == '!' || *p == '^')
+        p++;
+    if (*p == ']')
+        p++;
+    for (; *p && *p != '/'; p++) {
+        if (*p == EXPAND_ESCAPE && p[1])
+            p++;
+        else if (*p == ']')
+            return p;
+    }
+    return NULL;
+}
+
+/*
+ * bracket_match: Returns 1 if byte 'c' is matched by the bracket
+ * expression [p, close) (the contents between '[' and ']').
+ */
+static int bracket_match(const char *p, const char *close, unsigned char c) {
+    int negate = *p == '!' || *p == '^';
+    int found = 0;
+    p += negate;
+    while (p < close) {
+        if (*p == EXPAND_ESCAPE && p + 1 < close)
+            p++;
+        unsigned char lo = (unsigned char)*p++;
+        unsigned char hi = lo;
+        if (*p == '-' && p + 1 < close) {
+            p++;
+            if (*p == EXPAND_ESCAPE && p + 1 < close)
+                p++;
+            hi = (unsigned char)*p++;
+        }
+        if (c >= lo && c <= hi)
+            found = 1;
+    }
+    return found != negate;
+}
+
+int wildcard_active(const char *p) {
+    for (; *p; p++) {
+        if (*p == EXPAND_ESCAPE && p[1])
+            p++;
+        else if (*p == '*' || *p == '?' || (*p == '[' && bracket_end(p + 1)))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * wildcard_match: Matches a name against one pattern component.
+ *
+ * On a mismatch after a '*', the '*' takes one more byte and matching
+ * resumes behind it; earlier stars never need to be retried.
+ */
+int wildcard_match(const char *pattern, const char *name) {
+    const char *p = pattern;
+    const char *star = NULL;        // Pattern position after the latest '*'
+    const char *resume = NULL;      // Name position that '*' extends to next
+
+    if (*name == '.' && *p != '.' && !(*p == EXPAND_ESCAPE && p[1] == '.'))
+        return 0;
+    while (*name) {
+        const char *close;
+        if (*p == '*') {
+            star = ++p;
+            resume = name;
+            continue;
+        }
+        if (*p == '?') {
+            p++;
+            name++;
+            continue;
+        }
+        if (*p == '[' && (close = bracket_end(p + 1)) != NULL) {
+            if (bracket_match(p + 1, close, (unsigned char)*name)) {
+                p = close + 1;
+                name++;
+                continue;
+            }
+        } else {
+            const char *literal = *p == EXPAND_ESCAPE && p[1] ? p + 1 : p;
+            if (*literal != '\0' && *literal == *name) {
+                p = literal + 1;
+                name++;
+                continue;
+            }
+        }
+        if (!star)
+            return 0;
+        p = star;
+        name = ++resume;
+    }
+    while (*p == '*')
+        p++;
+    return *p == '\0';
+}
+
+/*
+ * join: Returns dir + the first 'len' bytes of 'name' (without their
+ * escapes) + suffix, in the arena.
+ */
+static char *join(Arena *arena, const char *dir, const char *name, size_t len,
+                  const char *suffix) {
+    size_t dir_len = strlen(dir);
+    size_t suffix_len = strlen(suffix);
+    char *path = arena_alloc(arena, dir_len + len + suffix_len + 1);
+    char *out = path;
+    memcpy(out, dir, dir_len);
+    out += dir_len;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == EXPAND_ESCAPE && i + 1 < len)
+            i++;
+        *out++ = name[i];
+    }
+    memcpy(out, suffix, suffix_len + 1);
+    return path;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * walk:
+ *
+ * Matches 'pattern' against the paths under 'dir' and adds the matches.
+ *
+ * Parameters:
+ *   m - The matches so far.
+ *   dir - The directory reached so far: "" for the working directory,
+ *         otherwise a path ending with '/'.
+ *   pattern - The remaining components.
+ */
+static void walk(Matches *m, const char *dir, const char *pattern) {
+    const char *slash = strchr(pattern, '/');
+    size_t len = slash ? (size_t)(slash - pattern) : strlen(pattern);
+    const char *rest = slash;
+    while (rest && *rest == '/')
+        rest++;
+    int dirs_only = rest && *rest == '\0';  // The pattern ends with '/'
+    if (dirs_only)
+        rest = NULL;
+    const char *suffix = dirs_only || rest ? "/" : "";
+
+    char *component = arena_strndup(m->arena, pattern, len);
+    if (!wildcard_active(component)) {
+        char *path = join(m->arena, dir, component, len, suffix);
+        struct stat st;
+        if (rest)
+            walk(m, path, rest);
+        else if (dirs_only ? stat(path, &st) == 0 && S_ISDIR(st.st_mode) : lstat(path, &st) == 0)
+            add_match(m, path);
+        return;
+    }
+
+    const char *list_dir = *dir ? dir : ".";
+    DirListing listing;
+    if (dir_cache_get(list_dir, &listing) < 0)
+        return;
+
+    // The listing only lasts until the next lookup: take the names first
+    Matches found = { m->arena, NULL, 0, 0 };
+    for (size_t i = 0; i < listing.count; i++) {
+        const DirEntry *entry = &listing.entries[i];
+        if (!wildcard_match(component, entry->name))
+            continue;
+        if ((rest || dirs_only) && !dir_entry_is_dir(list_dir, entry))
+            continue;
+        char *path = join(m->arena, dir, entry->name, strlen(entry->name), suffix);
+        if (rest)
+            add_match(&found, path);
+        else
+            add_match(m, path);
+    }
+    for (int i = 0; i < found.count; i++)
+        walk(m, found.paths[i], rest);
+}
+
+/*
+ * wildcard_expand: Expands a pathname pattern (see wildcard.h).
+ */
+char **wildcard_expand(Arena *arena, const char *pattern, int *count) {
+    Matches m = { arena, NULL, 0, 0 };
+
+    // An absolute pattern starts at its leading slashes
+    size_t root = strspn(pattern, "/");
+    const char *dir = root ? arena_strndup(arena, pattern, root) : "";
+    if (pattern[root] != '\0')
+        walk(&m, dir, pattern + root);
+
+    for (int i = 1; i < m.count; i++) {
+        if (strcmp(m.paths[i - 1], m.paths[i]) > 0) {
+            qsort(m.paths, m.count, sizeof(char *), compare_paths);
+            break;
+        }
+    }
+    *count = m.count;
+    return m.count ? m.paths : NULL;
+}
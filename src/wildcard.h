@@ -0,0 +1,19 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include "arena.h"
+
+// Returns 1 if 'pattern' contains an unquoted wildcard ('*', '?' or a
+// closed '[...]'); bytes behind EXPAND_ESCAPE are literal
+int wildcard_active(const char *pattern);
+
+// Returns 1 if 'name' matches the single path component 'pattern'. A
+// leading '.' of the name must be matched literally.
+int wildcard_match(const char *pattern, const char *name);
+
+// Expands a pathname pattern into the arena: returns an array of the
+// matching paths, sorted, and stores their number in *count. Returns NULL
+// (with *count 0) if nothing matches.
+char **wildcard_expand(Arena *arena, const char *pattern, int *count);
+
+#endif // WILDCARD_H